@@ -0,0 +1,159 @@
+/*
+ * Buffer replacement benchmark.
+ *
+ * Point lookups over a small hot key set run while a batch job sweeps the
+ * whole leaf chain, a few leaves per lookup. The hit ratio of the lookups
+ * and of all page references is reported for each policy.
+ *
+ * usage: replace_bench [num_keys] [num_buf] [num_lookups] [sweep_step]
+ */
+#include "api.h"
+#include "buffer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+static const char* TABLE_NAME { "replace_bench.db" };
+
+static constexpr int VAL_SIZE { 100 };
+static constexpr int NUM_HOT_KEYS { 64 };
+
+static const std::pair<ReplacePolicy, const char*> POLICIES[] {
+	{ ReplacePolicy::LRU, "LRU" },
+	{ ReplacePolicy::CLOCK, "CLOCK" },
+	{ ReplacePolicy::CLOCK_PRO, "CLOCK-Pro" },
+	{ ReplacePolicy::TWO_Q, "2Q" },
+	{ ReplacePolicy::ARC, "ARC" },
+};
+
+struct Sweep {
+	int64_t table_id;
+	pagenum_t leftmost;
+	pagenum_t next;
+};
+
+static double hit_ratio(const BufferStats& s) {
+	uint64_t total = s.hits + s.misses;
+	return total ? 100.0 * s.hits / total : 0.0;
+}
+
+/** Follow the leftmost children from the root down to the first leaf. */
+static pagenum_t find_leftmost_leaf(int64_t table_id) {
+	pagenum_t page_no;
+	{
+		PageGuard header(table_id, 0);
+		page_no = GET_HEADER_ROOT_PAGE_NO(header.as<HeaderPage>());
+	}
+	while (page_no != 0) {
+		PageGuard guard(table_id, page_no);
+		if (GET_IS_LEAF(guard.get()))
+			break;
+		page_no = INTERNAL_VAL(guard.as<InternalPage>(), 0);
+	}
+	return page_no;
+}
+
+/** Read the next leaves of the chain and wrap around at the end. */
+static void sweep_step(Sweep& sweep, int num_pages) {
+	for (int i = 0; i < num_pages; ++i) {
+		if (sweep.next == 0)
+			sweep.next = sweep.leftmost;
+		PageGuard guard(sweep.table_id, sweep.next);
+		sweep.next = GET_LEAF_SIBLING(guard.as<LeafPage>());
+	}
+}
+
+static int load_table(int num_keys) {
+	int64_t table_id;
+	char value[VAL_SIZE];
+	std::vector<int64_t> keys(num_keys);
+	std::mt19937 gen(1);
+
+	for (int i = 0; i < num_keys; ++i)
+		keys[i] = i;
+	std::shuffle(keys.begin(), keys.end(), gen);
+	memset(value, 'v', VAL_SIZE);
+
+	unlink(TABLE_NAME);
+	if (init_db(1024) != 0)
+		return -1;
+	table_id = open_table(const_cast<char*>(TABLE_NAME));
+	if (table_id < 0)
+		return -1;
+	for (auto key : keys) {
+		if (db_insert(table_id, key, value, VAL_SIZE) != 0)
+			return -1;
+	}
+	return shutdown_db();
+}
+
+int main(int argc, char** argv) {
+	int num_keys = argc > 1 ? atoi(argv[1]) : 50000;
+	int num_buf = argc > 2 ? atoi(argv[2]) : 128;
+	int num_lookups = argc > 3 ? atoi(argv[3]) : 200000;
+	int step = argc > 4 ? atoi(argv[4]) : 2;
+
+	char ret_val[MAX_VAL_SIZE];
+	uint16_t ret_size;
+
+	if (load_table(num_keys) != 0) {
+		fprintf(stderr, "load failed\n");
+		return 1;
+	}
+
+	std::mt19937 key_gen(2);
+	std::vector<int64_t> hot_keys(NUM_HOT_KEYS);
+	for (auto& key : hot_keys)
+		key = key_gen() % num_keys;
+
+	printf("keys %d, frames %d, lookups %d, %d leaves swept per lookup\n",
+			num_keys, num_buf, num_lookups, step);
+	printf("%-10s %12s %12s %10s\n", "policy", "lookup hit%", "total hit%", "ms");
+
+	for (const auto& policy : POLICIES) {
+		BufferStats lookup {}, s;
+		std::mt19937 gen(3);
+		int64_t key;
+
+		if (init_db(num_buf, policy.first) != 0)
+			return 1;
+		Sweep sweep { open_table(const_cast<char*>(TABLE_NAME)), 0, 0 };
+		sweep.leftmost = find_leftmost_leaf(sweep.table_id);
+		buffer_reset_stats();
+
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < num_lookups; ++i) {
+			/** 90% of the lookups go to the hot keys. */
+			key = gen() % 10 ? hot_keys[gen() % NUM_HOT_KEYS] : gen() % num_keys;
+
+			buffer_get_stats(&s);
+			if (db_find(sweep.table_id, key, ret_val, &ret_size) != 0) {
+				fprintf(stderr, "key %" PRId64 " not found\n", key);
+				return 1;
+			}
+			uint64_t hits = s.hits, misses = s.misses;
+			buffer_get_stats(&s);
+			lookup.hits += s.hits - hits;
+			lookup.misses += s.misses - misses;
+
+			sweep_step(sweep, step);
+		}
+		auto end = std::chrono::steady_clock::now();
+		buffer_get_stats(&s);
+
+		printf("%-10s %12.2f %12.2f %10lld\n", policy.second,
+				hit_ratio(lookup), hit_ratio(s),
+				(long long)std::chrono::duration_cast<std::chrono::milliseconds>(
+					end - start).count());
+		shutdown_db();
+	}
+	unlink(TABLE_NAME);
+	return 0;
+}
@@ -0,0 +1,106 @@
+/*
+ * In-page search benchmark.
+ *
+ * Searches a full internal page of each format and a full leaf page for
+ * random keys with the linear, binary and SIMD searches, and reports the
+ * time per search.
+ * The pages stay in the cache, so this is the CPU cost of the search alone.
+ *
+ * usage: search_bench [num_searches]
+ */
+#include "page.h"
+#include "page_search.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+static constexpr int LEAF_KEYS { (int)((PG_SIZE - PG_HEADER_SIZE) /
+		(SLOT_SIZE + MIN_VAL_SIZE)) };
+static constexpr int INTERNAL_KEYS { INTERNAL_ORDER - 1 };
+
+static const std::pair<PageSearch, const char*> SEARCHES[] {
+	{ PageSearch::LINEAR, "linear" },
+	{ PageSearch::BINARY, "binary" },
+	{ PageSearch::SIMD, "simd" },
+};
+
+/** Keys 0, 2, 4, ... so that half of the searched keys are missing. */
+static void fill_pages(InternalPage* internal_pages, LeafPage* leaf_page) {
+	for (uint32_t format : { INTERNAL_INTERLEAVED, INTERNAL_SEPARATED }) {
+		InternalPage* internal_page = &internal_pages[format];
+		memset(internal_page, 0, PG_SIZE);
+		SET_INTERNAL_FORMAT(internal_page, format);
+		SET_NUM_KEYS(internal_page, INTERNAL_KEYS);
+		for (int i = 0; i < INTERNAL_KEYS; ++i)
+			INTERNAL_KEY(internal_page, i) = 2 * i;
+	}
+
+	memset(leaf_page, 0, PG_SIZE);
+	SET_NUM_KEYS(leaf_page, LEAF_KEYS);
+	for (int i = 0; i < LEAF_KEYS; ++i)
+		LEAF_KEY(leaf_page, i) = 2 * i;
+}
+
+template <typename F>
+static double time_searches(const std::vector<int64_t>& keys, F search,
+		int64_t* checksum) {
+	int64_t sum = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (auto key : keys)
+		sum += search(key);
+	auto end = std::chrono::steady_clock::now();
+	*checksum = sum;
+	return std::chrono::duration<double, std::nano>(end - start).count() /
+		keys.size();
+}
+
+int main(int argc, char** argv) {
+	int num_searches = argc > 1 ? atoi(argv[1]) : 10000000;
+
+	static InternalPage internal_pages[2];
+	static LeafPage leaf_page;
+	fill_pages(internal_pages, &leaf_page);
+
+	std::mt19937_64 gen(1);
+	std::vector<int64_t> internal_keys(num_searches), leaf_keys(num_searches);
+	for (int i = 0; i < num_searches; ++i) {
+		internal_keys[i] = gen() % (2 * INTERNAL_KEYS + 1) - 1;
+		leaf_keys[i] = gen() % (2 * LEAF_KEYS + 1) - 1;
+	}
+
+	printf("searches %d, internal keys %d, leaf keys %d, simd %s\n",
+			num_searches, INTERNAL_KEYS, LEAF_KEYS,
+			page_search_simd() ? "avx2" : "none (binary)");
+	printf("%-8s %16s %16s %10s\n", "search",
+			"interleaved ns", "separated ns", "leaf ns");
+
+	int64_t expected[3] = { 0, 0, 0 };
+	for (const auto& search : SEARCHES) {
+		int64_t checksum[3];
+		double ns[3];
+		for (uint32_t format : { INTERNAL_INTERLEAVED, INTERNAL_SEPARATED }) {
+			ns[format] = time_searches(internal_keys, [&](int64_t key) {
+				return internal_upper_bound(&internal_pages[format],
+						INTERNAL_KEYS, key, search.first);
+			}, &checksum[format]);
+		}
+		ns[2] = time_searches(leaf_keys, [&](int64_t key) {
+			return leaf_lower_bound(&leaf_page, LEAF_KEYS, key, search.first);
+		}, &checksum[2]);
+
+		/** Every search must find the same positions as the linear one. */
+		if (search.first == PageSearch::LINEAR) {
+			memcpy(expected, checksum, sizeof(expected));
+		} else if (memcmp(expected, checksum, sizeof(expected)) != 0 ||
+				checksum[0] != checksum[1]) {
+			fprintf(stderr, "%s search disagrees\n", search.second);
+			return 1;
+		}
+		printf("%-8s %16.2f %16.2f %10.2f\n", search.second, ns[0], ns[1], ns[2]);
+	}
+	return 0;
+}
@@ -3,7 +3,15 @@
 
 #include <stdint.h>
 
-int64_t open_table(char* pathname);
+#include "policy.h"
+
+struct Cursor;
+
+int64_t open_table(char* pathname, TableMode mode = TableMode::READ_WRITE,
+		AccessHint hint = AccessHint::RANDOM);
+
+// Change the access hint of a table opened with TableMode::READ_ONLY_MMAP
+int db_advise_table(int64_t table_id, AccessHint hint);
 
 int db_insert(int64_t table_id, int64_t key, char* value, uint16_t val_size);
 
@@ -11,7 +19,60 @@ int db_find(int64_t table_id, int64_t key, char* ret_val, uint16_t* val_size);
 
 int db_delete(int64_t table_id, int64_t key);
 
-int init_db(int num_buf);
+// Batches of keys, in any order. They are sorted, and the keys that fall
+// into one leaf are handled together after a single descent. status[i]
+// gets what the single-key call would return for keys[i]; of equal keys in
+// one insert batch, the first one is inserted. Return the number of keys
+// that succeeded, or -1 on an error.
+int db_insert_batch(int64_t table_id, int num_keys, const int64_t* keys,
+		char** values, const uint16_t* val_sizes, int* status);
+
+// ret_vals and val_sizes may be nullptr to only check the keys.
+int db_find_batch(int64_t table_id, int num_keys, const int64_t* keys,
+		char** ret_vals, uint16_t* val_sizes, int* status);
+
+int db_delete_batch(int64_t table_id, int num_keys, const int64_t* keys,
+		int* status);
+
+// Records with begin_key <= key <= end_key, in key order. A cursor reads
+// one record per cursor_next() and holds no latch in between, so the table
+// may change meanwhile: every record that stays in the range is returned
+// once, and records inserted behind the cursor are not. cursor_next()
+// returns 0 with a record, 1 at the end and -1 on an error.
+// open_cursor() returns nullptr for an unknown or READ_ONLY_MMAP table.
+// Close every cursor before shutdown_db().
+Cursor* open_cursor(int64_t table_id, int64_t begin_key, int64_t end_key);
+int cursor_next(Cursor* cursor, int64_t* key, char* ret_val,
+		uint16_t* val_size);
+void cursor_close(Cursor* cursor);
+
+// Call callback on each record of the range until it returns non-zero.
+// Return the number of calls, or -1 on an error.
+int db_scan(int64_t table_id, int64_t begin_key, int64_t end_key,
+		int (*callback)(int64_t key, const char* value, uint16_t val_size,
+			void* arg),
+		void* arg);
+
+// Load a table from records in key order, much faster than db_insert()
+// into an empty table: next() fills in the next record and returns 0, or
+// returns non-zero at the end. An empty table is built directly, with its
+// pages filled to fill_factor (0.5 to 1) to leave room for later inserts.
+// Otherwise, and for the records after a key out of order, it falls back
+// to db_insert() and skips duplicate keys. Return the number of records
+// loaded, or -1 on an error, which leaves the table as it was.
+int64_t db_bulk_load(int64_t table_id,
+		int (*next)(int64_t* key, char* value, uint16_t* val_size, void* arg),
+		void* arg, double fill_factor = 0.9);
+
+int db_sync_table(int64_t table_id);
+
+// With warm_restart, shutdown_db() saves which pages were cached and
+// open_table() starts reading them back in the background.
+// Return -1 on a failure, after closing whatever was opened.
+int init_db(int num_buf, ReplacePolicy policy = ReplacePolicy::CLOCK,
+		SyncMode sync_mode = SyncMode::PER_WRITE,
+		IoBackendType io_backend = IoBackendType::POSIX,
+		bool direct_io = false, bool warm_restart = false);
 
 int shutdown_db();
 
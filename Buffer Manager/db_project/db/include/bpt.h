@@ -3,6 +3,8 @@
 
 #include <stdint.h>
 
+#include "buffer.h"
+
 int find_record(int64_t tid, int64_t key,
 		char* ret_val, uint16_t* size);
 
@@ -11,4 +13,70 @@ int insert_record(int64_t tid, int64_t key,
 
 int delete_record(int64_t tid, int64_t key);
 
+// Forget the rightmost leaf remembered for the table id, which now names
+// another table file.
+void forget_rightmost_leaf(int64_t tid);
+
+// The same for arrays of keys, sorted first so that the keys of one leaf
+// are done after one descent. status gets the result of each key as the
+// single-key call would return it. Return the number of keys that
+// succeeded, or -1 on a buffer error.
+int find_records(int64_t tid, int num_keys, const int64_t* keys,
+		char** ret_vals, uint16_t* sizes, int* status);
+
+int insert_records(int64_t tid, int num_keys, const int64_t* keys,
+		char** vals, const uint16_t* sizes, int* status);
+
+int delete_records(int64_t tid, int num_keys, const int64_t* keys,
+		int* status);
+
+/*
+ * Cursor over the records of a table in key order, up to end_key. It keeps
+ * the leaf it is on pinned but not latched between calls. If the leaf
+ * changed in the meantime, the next call finds its place again from the
+ * root, so records inserted ahead of it are returned and records deleted
+ * ahead of it are not.
+ */
+struct Cursor {
+	int64_t table_id;
+	int64_t next_key;	// smallest key not returned yet
+	int64_t end_key;
+	bool done;
+	int slot;	// of next_key in the leaf, while the leaf is unchanged
+	PageGuard leaf;
+};
+
+// Start a cursor at begin_key, up to end_key included.
+void open_record_cursor(Cursor* cursor, int64_t tid,
+		int64_t begin_key, int64_t end_key);
+
+// Copy the next record out. Return 0 if there was one, 1 at the end and
+// -1 on a buffer error.
+int next_record(Cursor* cursor, int64_t* key,
+		char* ret_val, uint16_t* size);
+
+void close_record_cursor(Cursor* cursor);
+
+// Call callback on every record with a key in [begin_key, end_key], in
+// key order, until it returns non-zero. Return the number of calls or -1.
+int scan_records(int64_t tid, int64_t begin_key, int64_t end_key,
+		int (*callback)(int64_t key, const char* val, uint16_t size,
+			void* arg),
+		void* arg);
+
+// Load the records next() gives, in key order, into the table. next()
+// returns 0 with a record and non-zero at the end. An empty table is built
+// from the bottom up with pages filled to fill_factor (0.5 to 1); records
+// that come after a key out of order, or all of them if the table has
+// records, are inserted one by one. Return the number of records loaded,
+// or -1 on an error (e.g. a record of a bad size); the records loaded up
+// to it are then deleted again, so the table is left as it was.
+int64_t bulk_load_records(int64_t tid,
+		int (*next)(int64_t* key, char* val, uint16_t* size, void* arg),
+		void* arg, double fill_factor);
+
+// find_record() on a table opened with TableMode::READ_ONLY_MMAP
+int find_record_mapped(int64_t tid, int64_t key,
+		char* ret_val, uint16_t* size);
+
 #endif /* DB_BPT_H_ */
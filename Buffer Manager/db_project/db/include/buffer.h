@@ -2,26 +2,155 @@
 #define DB_BUFFER_H_
 
 #include "page.h"
-#include <memory>
+#include "replacer.h"
+
+#include <atomic>
+#include <shared_mutex>
 
 struct ControlBlock {
     int64_t table_id;
     pagenum_t page_num;
     uint32_t is_dirty;
     uint32_t is_pinned;
-    int next_idx;
-    int prev_idx;
+    uint32_t io_pending;
+    uint64_t last_access;
     void * frame;
+    std::shared_mutex latch; // content of the frame
+    std::atomic<uint64_t> version; // odd while latched EXCLUSIVE
+};
+
+// Latch on the content of a pinned frame. OPTIMISTIC takes no latch but
+// remembers the frame's version, so a reader can check afterwards that no
+// EXCLUSIVE holder changed the frame in the meantime.
+enum class LatchMode {
+    NONE,
+    SHARED,
+    EXCLUSIVE,
+    OPTIMISTIC,
 };
 
-int init_buffer(int num_buf);
-pagenum_t buffer_alloc_page(int64_t table_id);
+struct BufferStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t read_ahead; // pages read ahead along leaf sibling chains
+};
+
+// With warm_restart, shutdown_buffer() saves the pages cached of each
+// table next to its file ("<path>.bufdump"), most recently used first, and
+// buffer_load_dump() reads them back in.
+// The pool is split into num_partitions partitions (rounded down to a power
+// of two) by a hash of the page, each with its own latch, page table and
+// replacer. 0 picks it from the number of cores and the pool size.
+int init_buffer(int num_buf, ReplacePolicy policy = ReplacePolicy::CLOCK,
+                bool warm_restart = false, int num_partitions = 0);
+int buffer_num_partitions();
+// Allocate a page, next to hint if it is not 0 (see file_alloc_page()).
+pagenum_t buffer_alloc_page(int64_t table_id, pagenum_t hint = 0);
 void buffer_free_page(int64_t table_id, pagenum_t pagenum);
-void buffer_read_page(int64_t table_id, pagenum_t pagenum, const std::shared_ptr<Page>& dest);
-void buffer_write_page(int64_t table_id, pagenum_t pagenum, const Page* src);
 int shutdown_buffer();
 
-void control_read_LRU(int buf_index);
-void control_new_LRU(int buf_index);
+// Pin the page in a frame and return its index.
+// Return -1 if the page is not cached and every frame is pinned, or if it
+// cannot be read.
+// A pin of a leaf right after its left sibling also starts reading the next
+// leaves of the sibling chain, more of them the longer the scan goes on.
+int buffer_pin_page(int64_t table_id, pagenum_t pagenum);
+void buffer_unpin_page(int buf_index);
+
+// Start reading the pages that are not cached into free or evicted frames
+// without waiting. A pin of such a page waits for its read. Return the
+// number of reads started; it stops early when every frame is pinned.
+int buffer_prefetch(int64_t table_id, const pagenum_t* pagenums, int count);
+
+// Queue the pages of the table's dump for background prefetch into free
+// frames, in batches sorted by page number, and remove the dump. Return the
+// number of pages queued (0 without warm_restart or a dump).
+int buffer_load_dump(int64_t table_id);
+// Wait until the queued dump pages have been read in.
+void buffer_wait_warmup();
+
+void buffer_mark_dirty(int buf_index);
+// Latch the content of a pinned frame. Several SHARED holders or one
+// EXCLUSIVE holder; a thread may latch a frame EXCLUSIVE again while it
+// holds it. NONE and OPTIMISTIC do nothing.
+void buffer_latch_page(int buf_index, LatchMode mode);
+void buffer_unlatch_page(int buf_index, LatchMode mode);
+// Version of a pinned frame, waiting while another thread holds it
+// EXCLUSIVE. It changes on every EXCLUSIVE latch and unlatch.
+uint64_t buffer_read_version(int buf_index);
+// Whether the frame is still at the version. Reads of the frame made
+// before a true result saw a consistent page.
+bool buffer_validate(int buf_index, uint64_t version);
+Page* buffer_get_frame(int buf_index);
+pagenum_t buffer_get_page_num(int buf_index);
+
+// Start the background flusher. It wakes up when at least high_ratio of
+// the frames are dirty, or every interval_ms, and writes dirty unpinned
+// pages back until at most low_ratio of the frames are dirty.
+// shutdown_buffer() stops it.
+int buffer_start_flusher(double high_ratio = 0.5, double low_ratio = 0.25,
+                         int interval_ms = 100);
+void buffer_stop_flusher();
+
+// Write the table's dirty unpinned pages back as one batch and sync the
+// table file. Return 0 on success.
+int buffer_flush_table(int64_t table_id);
+
+// Hit/miss counters of buffer_pin_page() since init or the last reset.
+void buffer_get_stats(BufferStats* stats);
+void buffer_reset_stats();
+
+/*
+ * PageGuard pins a page for its lifetime and hands out a pointer directly
+ * into the frame, so nothing is copied. Modifications must be followed by
+ * mark_dirty(); the page is unpinned when the guard is released/destroyed.
+ * With a LatchMode, the frame is also latched while the guard holds it.
+ * An OPTIMISTIC guard only reads the frame's version; validate() tells if
+ * what was read since is still good, and latch() upgrades it to a real
+ * latch as long as the frame has not changed.
+ */
+class PageGuard {
+
+	public:
+		PageGuard(): buf_index(-1), frame(nullptr), mode(LatchMode::NONE),
+			version(0) {};
+		PageGuard(int64_t table_id, pagenum_t pagenum,
+				LatchMode mode = LatchMode::NONE);
+		~PageGuard() { release(); };
+
+		PageGuard(PageGuard&& other) noexcept;
+		PageGuard& operator=(PageGuard&& other) noexcept;
+
+		Page* get() const { return frame; }
+		Page* operator->() const { return frame; }
+		explicit operator bool() const { return frame != nullptr; }
+
+		template <typename T>
+		T* as() const { return reinterpret_cast<T*>(frame); }
+
+		pagenum_t page_no() const { return buffer_get_page_num(buf_index); }
+
+		void mark_dirty();
+		void release();
+
+		// For an OPTIMISTIC guard: whether the frame has not changed since
+		// the pin.
+		bool validate() const;
+		// Latch an OPTIMISTIC guard SHARED or EXCLUSIVE. Return false if
+		// the frame changed since the pin; the guard holds the latch anyway.
+		bool latch(LatchMode mode);
+		// Let go of the latch but keep the pin, as an OPTIMISTIC guard at the
+		// version the frame has after this guard's own changes.
+		void unlatch();
+
+	private:
+		PageGuard(const PageGuard &);
+		PageGuard &operator=(const PageGuard &);
+
+		int buf_index;
+		Page* frame;
+		LatchMode mode;
+		uint64_t version;
+};
 
 #endif /* DB_BUFFER_H*/
@@ -2,11 +2,20 @@
 #define DB_FILE_H_
 
 #include "page.h"
+#include "policy.h"
 #include <atomic>
+#include <functional>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <utility>
 #include <unordered_map>
 
 using std::unordered_map;
 
+// Free-space map of an open table file (file.cc)
+struct TableSpace;
+
 class DiskManager {
 	
 	private:
@@ -23,6 +32,16 @@ class DiskManager {
 		int64_t get_table_id(int fd);
 		int get_fd(int64_t table_id);
 
+		void set_space(int64_t table_id, std::unique_ptr<TableSpace> space);
+		TableSpace* get_space(int64_t table_id);
+
+		void set_mapping(int64_t table_id, const Page* pages,
+				pagenum_t num_of_pages);
+		const Page* get_mapping(int64_t table_id, pagenum_t* num_of_pages);
+
+		void set_path(int64_t table_id, const char* pathname);
+		std::string get_path(int64_t table_id);
+
 		void close_table_files();
 
 	private:
@@ -31,27 +50,96 @@ class DiskManager {
 
 		// Map table id with file descriptor
 		unordered_map<int64_t, int> map_tid_to_fd;
+		// Map table id with its free-space map
+		unordered_map<int64_t, std::unique_ptr<TableSpace>> map_tid_to_space;
+		// Map table id with the mapping of a read-only table
+		unordered_map<int64_t, std::pair<const Page*, pagenum_t>> map_tid_to_mapping;
+		// Map table id with the pathname it was opened with
+		unordered_map<int64_t, std::string> map_tid_to_path;
+		// Read-mostly: page I/O from any thread only looks up fds
+		std::shared_mutex latch;
 };
 
 /** Disk Manager APIs */
 
-int open_disk_manager();
+int open_disk_manager(SyncMode mode = SyncMode::PER_WRITE,
+		IoBackendType backend = IoBackendType::POSIX,
+		bool direct_io = false);
 int close_disk_manager();
 
-// Open existing table file or create one if it doesn't exist
+// Name of the I/O backend in use ("posix" or "io_uring")
+const char* file_io_backend_name();
+
+// Tell the backend that most I/O targets [base, base + len), e.g. the
+// buffer pool frames. Return -1 if the backend does not use it.
+int file_register_buffer(void* base, size_t len);
+void file_unregister_buffer();
+
+// Open existing table file or create one if it doesn't exist.
+// With direct_io, the file is opened with O_DIRECT when the file system
+// supports it; pages not aligned to PG_SIZE then go through a bounce page.
 int64_t file_open_table_file(const char* pathname);
 
-// Allocate an on-disk page from the free page list
-pagenum_t file_alloc_page(int64_t table_id);
+// Pathname the table was opened with, or "" if it is not open
+std::string file_table_path(int64_t table_id);
+
+// Open an existing table file read-only and map the whole file. Return -1
+// if it cannot be opened or mapped.
+int64_t file_open_table_mmap(const char* pathname, AccessHint hint);
+
+// Change the madvise(2) hint of a mapped table
+int file_advise_table(int64_t table_id, AccessHint hint);
+
+// Pages of a mapped table (page number = index) and their number, or
+// nullptr if the table is not mapped
+const Page* file_mapped_pages(int64_t table_id, pagenum_t* num_of_pages);
 
-// Free an on-disk page to the free page list
+// Number of pages the table file has room for. Valid page numbers are below it.
+pagenum_t file_num_pages(int64_t table_id);
+
+// Allocate an on-disk page. The free-space map is searched in memory; the
+// file grows by doubling with fallocate(2) when it is full.
+// With a hint, the page is placed right after it when possible, or at the
+// start of an extent reserved for pages allocated near each other.
+pagenum_t file_alloc_page(int64_t table_id, pagenum_t hint = 0);
+
+// Return an on-disk page to the free-space map
 void file_free_page(int64_t table_id, pagenum_t pagenum);
 
-// Read an on-disk page into the in-memory page structure(dest)
-void file_read_page(int64_t table_id, pagenum_t pagenum, Page* dest);
+// Read an on-disk page into the in-memory page structure(dest).
+// Return -1 if the whole page could not be read.
+int file_read_page(int64_t table_id, pagenum_t pagenum, Page* dest);
+
+// Queue an asynchronous read of a page into dest. callback(0) runs when it
+// is done (callback(-1) on error), possibly on another thread.
+void file_read_page_async(int64_t table_id, pagenum_t pagenum, Page* dest,
+		std::function<void(int)> callback);
+
+// Send the queued asynchronous reads to the device
+void file_submit();
+
+// Read count consecutive on-disk pages starting at pagenum into dests
+void file_read_pages(int64_t table_id, pagenum_t pagenum,
+		Page* const* dests, int count);
+
+// Write an in-memory page(src) to the on-disk page. With barrier, the page
+// is synced before returning whatever the sync mode is.
+void file_write_page(int64_t table_id, pagenum_t pagenum, const Page* src,
+		bool barrier = false);
+
+// Write count in-memory pages(srcs) to the on-disk pages(pagenums, sorted)
+// as one batch
+void file_write_batch(int64_t table_id, const pagenum_t* pagenums,
+		const Page* const* srcs, int count);
+
+// Flush the written pages of the table to the device (fdatasync).
+// The barrier for SyncMode::DEFERRED.
+int file_sync_table(int64_t table_id);
 
-// Write an in-memory page(src) to the on-disk page
-void file_write_page(int64_t table_id, pagenum_t pagenum, const Page* src);
+// file_sync_table() and then save the free-space map as up to date, so the
+// next open after a crash need not rebuild it. Every page the tree refers
+// to must have been written already.
+int file_checkpoint_table(int64_t table_id);
 
 // Close the database file
 void file_close_table_files();
@@ -0,0 +1,76 @@
+#ifndef DB_FREE_SPACE_MAP_H_
+#define DB_FREE_SPACE_MAP_H_
+
+#include "page.h"
+
+#include <vector>
+
+/*
+ * In-memory free-space map of a table file: one bit per page, set if the
+ * page is in use. A second level keeps one bit per 64-page word that still
+ * has a free page, so a search skips full regions 4096 pages at a time.
+ * Bits past size() are kept set so they are never handed out.
+ *
+ * A word is also an extent: a run of EXTENT_PAGES pages that can be
+ * reserved for allocations near a given page (e.g. a chain of sibling
+ * leaves), which the other allocations then stay out of.
+ */
+constexpr pagenum_t EXTENT_PAGES = 64;
+
+class FreeSpaceMap {
+
+	public:
+		explicit FreeSpaceMap(pagenum_t num_of_pages = 0);
+		~FreeSpaceMap() {};
+
+		pagenum_t size() const { return num_of_pages; }
+		pagenum_t num_free() const { return free_count; }
+
+		// Grow the map. The new pages are free.
+		void resize(pagenum_t num_of_pages);
+
+		bool is_used(pagenum_t pagenum) const {
+			return (bits[pagenum / 64] >> (pagenum % 64)) & 1;
+		}
+		void set_used(pagenum_t pagenum);
+		void set_free(pagenum_t pagenum);
+
+		// First free page at or after hint, wrapping around to the start.
+		// Return 0 (the header page, always in use) if every page is used.
+		pagenum_t find_free(pagenum_t hint) const;
+		// Same, skipping reserved extents. 0 if they hold every free page.
+		pagenum_t find_free_unreserved(pagenum_t hint) const;
+		// First free page in (pagenum, end of its extent), or 0.
+		pagenum_t find_free_after(pagenum_t pagenum) const;
+
+		// Reserve the first empty, unreserved extent at or after the one
+		// holding hint (wrapping around) and return its first page, or 0.
+		pagenum_t reserve_extent(pagenum_t hint);
+		// Reserve the extent holding the page.
+		void reserve(pagenum_t pagenum);
+		bool is_reserved(pagenum_t pagenum) const {
+			return reserved[pagenum / EXTENT_PAGES];
+		}
+
+		// Raw words of the first level, 64 pages per word.
+		const uint64_t* words() const { return bits.data(); }
+		size_t num_words() const { return bits.size(); }
+		// Replace words [first, first + count) and recount.
+		void load_words(size_t first, const uint64_t* src, size_t count);
+
+	private:
+		void update_summary(size_t word);
+		pagenum_t find_from(const std::vector<uint64_t>& summary,
+				size_t word) const;
+		pagenum_t find(const std::vector<uint64_t>& summary,
+				pagenum_t hint) const;
+
+		std::vector<uint64_t> bits;
+		std::vector<uint64_t> has_free;	// bit w: bits[w] is not full
+		std::vector<uint64_t> has_free_unreserved;	// ... and not reserved
+		std::vector<uint8_t> reserved;
+		pagenum_t num_of_pages;
+		pagenum_t free_count;
+};
+
+#endif /* DB_FREE_SPACE_MAP_H */
@@ -2,11 +2,15 @@
 #define DB_INDEX_H_
 
 #include "page.h"
+#include "policy.h"
 
+#include <atomic>
 #include <string>
 #include <unordered_map>
 #include <memory>
 
+struct Cursor;
+
 class IndexManager {
 	private:
 		class Table {
@@ -15,20 +19,21 @@ class IndexManager {
 
 				std::string table_name;
 				int64_t table_id;
+				bool read_only;	// mapped with TableMode::READ_ONLY_MMAP
 
-				/** temp statistics */
-				int64_t num_recs;
-				int64_t num_finds;
-				int64_t num_dels;
+				/** temp statistics, counted by concurrent calls */
+				std::atomic<int64_t> num_recs;
+				std::atomic<int64_t> num_finds;
+				std::atomic<int64_t> num_dels;
 
 				void inc_num_recs() { num_recs++; }
 				void inc_num_finds() { num_finds++; }
 				void inc_num_dels() { num_dels++; }
 
 			public:
-				explicit Table(const char* pathname, int64_t tid):
-					table_name(pathname), table_id(tid), num_recs(0),
-					num_finds(0), num_dels(0) {};
+				explicit Table(const char* pathname, int64_t tid, bool read_only):
+					table_name(pathname), table_id(tid), read_only(read_only),
+					num_recs(0), num_finds(0), num_dels(0) {};
 
 				~Table(){};
 		};
@@ -36,13 +41,28 @@ class IndexManager {
 	private:
 		std::unordered_map<int64_t, std::unique_ptr<Table>> map_tid_to_tab;
 
-		void upd_tab_info(int64_t table_id, const char* table_name);
+		void upd_tab_info(int64_t table_id, const char* table_name,
+				bool read_only);
+		bool is_read_only(int64_t table_id) const;
 			
 	public:
-		int64_t open_table(const char* pathname);
+		int64_t open_table(const char* pathname, TableMode mode, AccessHint hint);
 		int find_rec(int64_t tid, int64_t key, char* val, uint16_t* size);
 		int insert_rec(int64_t tid, int64_t key, char* ret_val, uint16_t size);
 		int delete_rec(int64_t tid, int64_t key);
+		int find_recs(int64_t tid, int num_keys, const int64_t* keys,
+				char** vals, uint16_t* sizes, int* status);
+		int insert_recs(int64_t tid, int num_keys, const int64_t* keys,
+				char** vals, const uint16_t* sizes, int* status);
+		int delete_recs(int64_t tid, int num_keys, const int64_t* keys,
+				int* status);
+		Cursor* open_cursor(int64_t tid, int64_t begin_key, int64_t end_key);
+		int scan_recs(int64_t tid, int64_t begin_key, int64_t end_key,
+				int (*callback)(int64_t, const char*, uint16_t, void*),
+				void* arg);
+		int64_t bulk_load(int64_t tid,
+				int (*next)(int64_t*, char*, uint16_t*, void*),
+				void* arg, double fill_factor);
 
 	private:
 		IndexManager(const IndexManager &);
@@ -60,7 +80,9 @@ class IndexManager {
 int open_index_manager();
 int close_index_manager();
 
-int64_t open_table_file(const char* pathname);
+int64_t open_table_file(const char* pathname,
+		TableMode mode = TableMode::READ_WRITE,
+		AccessHint hint = AccessHint::RANDOM);
 
 int db_insert_record(int64_t table_id, 
 		int64_t key,
@@ -75,5 +97,46 @@ int db_find_record(int64_t table_id,
 int db_delete_record(int64_t table_id, 
 		int64_t key);
 
+int db_find_records(int64_t table_id,
+		int num_keys,
+		const int64_t* keys,
+		char** ret_vals,
+		uint16_t* val_sizes,
+		int* status);
+
+int db_insert_records(int64_t table_id,
+		int num_keys,
+		const int64_t* keys,
+		char** values,
+		const uint16_t* val_sizes,
+		int* status);
+
+int db_delete_records(int64_t table_id,
+		int num_keys,
+		const int64_t* keys,
+		int* status);
+
+Cursor* db_open_cursor(int64_t table_id,
+		int64_t begin_key,
+		int64_t end_key);
+
+int db_cursor_next(Cursor* cursor,
+		int64_t* key,
+		char* ret_val,
+		uint16_t* val_size);
+
+void db_close_cursor(Cursor* cursor);
+
+int db_scan_records(int64_t table_id,
+		int64_t begin_key,
+		int64_t end_key,
+		int (*callback)(int64_t, const char*, uint16_t, void*),
+		void* arg);
+
+int64_t db_bulk_load_records(int64_t table_id,
+		int (*next)(int64_t*, char*, uint16_t*, void*),
+		void* arg,
+		double fill_factor);
+
 
 #endif /* DB_INDEX_H */
@@ -0,0 +1,50 @@
+#ifndef DB_IO_BACKEND_H_
+#define DB_IO_BACKEND_H_
+
+#include "policy.h"
+
+#include <functional>
+#include <memory>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+// Result of an asynchronous request: bytes transferred or -errno
+using IoCallback = std::function<void(ssize_t)>;
+
+/*
+ * Page I/O of the disk manager. The synchronous calls follow pread(2) and
+ * friends and may be issued from any thread.
+ *
+ * read_async() only queues a read; submit() sends every queued request to
+ * the device at once, and the callback runs when the read completes,
+ * possibly on a backend thread. Callbacks must not wait for other I/O.
+ *
+ * register_buffer() announces the memory most I/O goes to (the buffer
+ * pool frames) so a backend can map it once instead of per request.
+ */
+class IoBackend {
+	public:
+		virtual ~IoBackend() {};
+
+		virtual const char* name() const = 0;
+
+		virtual ssize_t read(int fd, void* buf, size_t len, off_t off) = 0;
+		virtual ssize_t write(int fd, const void* buf, size_t len, off_t off) = 0;
+		virtual ssize_t readv(int fd, const struct iovec* iov, int cnt, off_t off) = 0;
+		virtual ssize_t writev(int fd, const struct iovec* iov, int cnt, off_t off) = 0;
+		virtual int datasync(int fd) = 0;
+
+		virtual void read_async(int fd, void* buf, size_t len, off_t off,
+				IoCallback callback) = 0;
+		virtual void submit() = 0;
+
+		virtual int register_buffer(void* /* base */, size_t /* len */) {
+			return -1;
+		};
+		virtual void unregister_buffer() {};
+};
+
+// Create the backend. IO_URING falls back to POSIX if the kernel refuses it.
+std::unique_ptr<IoBackend> make_io_backend(IoBackendType type);
+
+#endif /* DB_IO_BACKEND_H */
@@ -1,6 +1,5 @@
 #ifndef __DB_MSG_H_
 #define __DB_MSG_H_
-#define DBG_PRINT
 
 #include <iostream>
 
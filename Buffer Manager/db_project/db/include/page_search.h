@@ -0,0 +1,37 @@
+#ifndef DB_PAGE_SEARCH_H_
+#define DB_PAGE_SEARCH_H_
+
+#include "page.h"
+
+/*
+ * Key search inside a tree page. Each search has a linear scan, a
+ * branch-free binary search and a vector version; BEST is the fastest one
+ * the CPU supports, picked once at run time.
+ * The vector version of the internal page search uses AVX2 for the last few
+ * keys after the binary search, on either internal page format. Leaf slots
+ * are 12 bytes apart and a leaf holds a few dozen keys at most, so there
+ * SIMD is the binary search.
+ * num_keys is passed in so that a reader of a page being changed can bound
+ * it first.
+ */
+enum class PageSearch {
+	LINEAR,
+	BINARY,
+	SIMD,
+	BEST,
+};
+
+// Number of keys of the internal page that are <= key, i.e. the index of
+// the child that covers the key.
+int internal_upper_bound(const InternalPage* page, int num_keys, int64_t key,
+		PageSearch how = PageSearch::BEST);
+
+// Number of slots of the leaf whose key is < key: the slot of the key if it
+// is there, and where it goes otherwise.
+int leaf_lower_bound(const LeafPage* page, int num_keys, int64_t key,
+		PageSearch how = PageSearch::BEST);
+
+// Whether PageSearch::SIMD has a vector path on this CPU.
+bool page_search_simd();
+
+#endif /* DB_PAGE_SEARCH_H */
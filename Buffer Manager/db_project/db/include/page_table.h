@@ -0,0 +1,60 @@
+#ifndef DB_PAGE_TABLE_H_
+#define DB_PAGE_TABLE_H_
+
+#include "page.h"
+
+#include <memory>
+
+/*
+ * Page directory of the buffer pool: (table id, page number) -> frame index.
+ * Open addressing with linear probing over a flat array sized once from the
+ * number of frames (load factor <= 1/2), so a lookup is one or two adjacent
+ * cache lines and nothing is allocated after construction. Deletion shifts
+ * the following run back instead of leaving tombstones.
+ */
+class PageTable {
+
+	private:
+		struct Entry {
+			int64_t table_id;
+			pagenum_t page_num;
+			int buf_index;	// -1 if the slot is empty
+		};
+
+	public:
+		explicit PageTable(int num_buf);
+		~PageTable() {};
+
+		// Return the frame index of the page, or -1 if it is not cached.
+		int find(int64_t table_id, pagenum_t pagenum) const {
+			for (size_t i = slot_of(table_id, pagenum); ; i = (i + 1) & mask) {
+				const Entry& e = entries[i];
+				if (e.buf_index == -1)
+					return -1;
+				if (e.page_num == pagenum && e.table_id == table_id)
+					return e.buf_index;
+			}
+		}
+
+		void insert(int64_t table_id, pagenum_t pagenum, int buf_index);
+		void erase(int64_t table_id, pagenum_t pagenum);
+		void clear();
+
+		size_t capacity() const { return mask + 1; }
+
+	private:
+		PageTable(const PageTable &);
+		PageTable &operator=(const PageTable &);
+
+		size_t slot_of(int64_t table_id, pagenum_t pagenum) const {
+			uint64_t h = pagenum * 0x9E3779B97F4A7C15ULL;
+			h ^= (uint64_t)table_id * 0xC2B2AE3D27D4EB4FULL;
+			h ^= h >> 29;
+			return (size_t)h & mask;
+		}
+
+		std::unique_ptr<Entry[]> entries;
+		size_t mask;
+};
+
+#endif /* DB_PAGE_TABLE_H */
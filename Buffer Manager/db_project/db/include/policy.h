@@ -0,0 +1,55 @@
+#ifndef DB_POLICY_H_
+#define DB_POLICY_H_
+
+/** Policies selectable at init_db(). */
+
+// Buffer replacement policy
+enum class ReplacePolicy {
+	LRU,
+	CLOCK,
+	CLOCK_PRO,
+	TWO_Q,
+	ARC,
+};
+
+/*
+ * When the disk manager syncs page writes.
+ * PER_WRITE : every page write or batch write is synced before it returns.
+ * PER_BATCH : batch writes are synced once at the end; single page writes
+ *             become durable with the next batch or file_sync_table().
+ * DEFERRED  : nothing is synced until file_sync_table() or close.
+ * Free-space map saves are ordered with barriers in every mode.
+ */
+enum class SyncMode {
+	PER_WRITE,
+	PER_BATCH,
+	DEFERRED,
+};
+
+// Page I/O backend of the disk manager
+enum class IoBackendType {
+	POSIX,
+	IO_URING,
+};
+
+/** Modes selectable at open_table(). */
+
+/*
+ * How a table is served.
+ * READ_WRITE     : through the buffer pool.
+ * READ_ONLY_MMAP : the file is mapped read-only and finds walk the pages in
+ *                  place, with no buffer pool or copy; inserts and deletes
+ *                  fail. The file must not change while it is open.
+ */
+enum class TableMode {
+	READ_WRITE,
+	READ_ONLY_MMAP,
+};
+
+// Access pattern of a mapped table, passed on to madvise(2)
+enum class AccessHint {
+	RANDOM,
+	SEQUENTIAL,
+};
+
+#endif /* DB_POLICY_H */
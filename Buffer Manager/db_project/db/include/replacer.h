@@ -0,0 +1,225 @@
+#ifndef DB_REPLACER_H_
+#define DB_REPLACER_H_
+
+#include "page.h"
+#include "policy.h"
+
+#include <memory>
+#include <vector>
+
+struct ControlBlock;
+class PageTable;
+
+/*
+ * Replacement policy of the buffer pool. It works on frame indexes of the
+ * ControlBlock array and reads is_pinned/table_id/page_num from it.
+ *
+ * on_insert() : a page has just been loaded into the frame.
+ * on_access() : a cached page in the frame was hit.
+ * on_remove() : the frame was emptied without going through pick_victim().
+ * pick_victim() : choose an unpinned frame and detach it from the policy.
+ *                 Return -1 if every frame is pinned.
+ * pick_clean_victim() : pick_victim() passing over dirty frames as if they
+ *                 were pinned, so their state is left as it is.
+ */
+class Replacer {
+	public:
+		Replacer(ControlBlock* cb, int num_buf)
+			: cb(cb), num_buf(num_buf), skip_dirty(false) {};
+		virtual ~Replacer() {};
+
+		virtual void on_insert(int buf_index) = 0;
+		virtual void on_access(int buf_index) = 0;
+		virtual void on_remove(int buf_index) = 0;
+		virtual int pick_victim() = 0;
+		int pick_clean_victim();
+
+	protected:
+		// Unpinned, and clean within pick_clean_victim()
+		bool evictable(int buf_index) const;
+
+		ControlBlock* cb;
+		int num_buf;
+
+	private:
+		bool skip_dirty;
+};
+
+std::unique_ptr<Replacer> make_replacer(
+		ReplacePolicy policy, ControlBlock* cb, int num_buf);
+
+/** LRU list. The victim is the least recently used unpinned frame. */
+class LRUReplacer : public Replacer {
+	public:
+		LRUReplacer(ControlBlock* cb, int num_buf);
+
+		void on_insert(int buf_index) override;
+		void on_access(int buf_index) override;
+		void on_remove(int buf_index) override;
+		int pick_victim() override;
+
+	private:
+		void unlink(int buf_index);
+
+		std::vector<int> next_idx;
+		std::vector<int> prev_idx;
+		int recent_buf_idx;
+		int last_buf_idx;
+};
+
+/** CLOCK (second chance). One reference bit per frame and one hand. */
+class ClockReplacer : public Replacer {
+	public:
+		ClockReplacer(ControlBlock* cb, int num_buf);
+
+		void on_insert(int buf_index) override;
+		void on_access(int buf_index) override;
+		void on_remove(int buf_index) override;
+		int pick_victim() override;
+
+	private:
+		std::vector<uint8_t> ref_bit;
+		std::vector<uint8_t> in_use;
+		int hand;
+};
+
+/*
+ * CLOCK-Pro (Jiang, Chen, Zhang. USENIX ATC 2005).
+ * Pages are hot or cold. A cold page starts a test period when it is loaded
+ * or re-referenced, and its metadata stays in the clock as a non-resident
+ * entry after eviction until the test period ends; a fault on it during the
+ * test period makes it hot. The resident cold target (m_c) adapts with the
+ * outcome of test periods. Node ids [0, num_buf) are frames, and
+ * [num_buf, 2 * num_buf) are non-resident entries.
+ */
+class ClockProReplacer : public Replacer {
+	public:
+		ClockProReplacer(ControlBlock* cb, int num_buf);
+		~ClockProReplacer();
+
+		void on_insert(int buf_index) override;
+		void on_access(int buf_index) override;
+		void on_remove(int buf_index) override;
+		int pick_victim() override;
+
+	private:
+		struct Node {
+			int next;
+			int prev;
+			int64_t table_id;	// non-resident entries only
+			pagenum_t page_num;	// non-resident entries only
+			uint8_t linked;
+			uint8_t hot;
+			uint8_t test;
+			uint8_t ref;
+		};
+
+		void link_at_head(int id);
+		void unlink(int id);
+		void replace_node(int old_id, int new_id);
+		void run_hand_hot();
+		void run_hand_test();
+		void drop_non_resident(int id);
+		void dec_cold_target();
+
+		std::vector<Node> nodes;
+		std::vector<int> free_non_resident;
+		std::unique_ptr<PageTable> non_resident;
+
+		int hand_hot;
+		int hand_cold;
+		int hand_test;
+
+		int num_hot;
+		int num_cold;
+		int num_non_resident;
+		int cold_target;	// m_c
+};
+
+/*
+ * Base of the list based policies (2Q, ARC). Node ids [0, num_buf) are
+ * frames and [num_buf, num_buf + num_ghost) are ghost entries, which remember
+ * only the page id of an evicted page. Every node is on at most one list;
+ * the head of a list is the most recently inserted node.
+ */
+class ListReplacer : public Replacer {
+	public:
+		ListReplacer(ControlBlock* cb, int num_buf, int num_lists, int num_ghost);
+		~ListReplacer();
+
+		void on_remove(int buf_index) override;
+
+	protected:
+		void push_front(int list, int id);
+		void unlink(int id);
+		int list_of(int id) const { return this->owner[id]; }
+		int size_of(int list) const { return this->count[list]; }
+		int back(int list) const { return this->tail[list]; }
+
+		// Least recently inserted unpinned frame of the list, or -1.
+		int unpinned_back(int list) const;
+
+		// Remember the page of the frame on the ghost list. The oldest
+		// entry of drop_list is dropped first if every ghost is in use.
+		void push_ghost(int list, int buf_index, int drop_list);
+		// Ghost node id of the page, or -1.
+		int find_ghost(int64_t table_id, pagenum_t pagenum) const;
+		void drop_ghost(int id);
+
+	private:
+		std::vector<int> next;
+		std::vector<int> prev;
+		std::vector<int> owner;	// -1 if not on a list
+		std::vector<int> head;
+		std::vector<int> tail;
+		std::vector<int> count;
+
+		std::vector<int64_t> ghost_table_id;
+		std::vector<pagenum_t> ghost_page_num;
+		std::vector<int> free_ghost;
+		std::unique_ptr<PageTable> ghosts;
+};
+
+/*
+ * 2Q (Johnson, Shasha. VLDB 1994).
+ * A new page enters the FIFO A1in and is not promoted by hits there, so a
+ * sweep only cycles through A1in. Pages evicted from A1in are remembered in
+ * A1out; a fault on one of them puts the page on the LRU list Am.
+ */
+class TwoQReplacer : public ListReplacer {
+	public:
+		TwoQReplacer(ControlBlock* cb, int num_buf);
+
+		void on_insert(int buf_index) override;
+		void on_access(int buf_index) override;
+		int pick_victim() override;
+
+	private:
+		enum { A1IN, AM, A1OUT };
+
+		int k_in;	// target size of A1in
+};
+
+/*
+ * ARC (Megiddo, Modha. FAST 2003).
+ * T1 holds pages seen once and T2 pages seen at least twice, with ghost
+ * lists B1/B2 of their evicted pages. A fault on a ghost moves the target
+ * size p of T1 towards the list it came from. The victim is picked before
+ * the faulting page is known, so the adaptation is applied on insert and
+ * takes effect from the next eviction.
+ */
+class ARCReplacer : public ListReplacer {
+	public:
+		ARCReplacer(ControlBlock* cb, int num_buf);
+
+		void on_insert(int buf_index) override;
+		void on_access(int buf_index) override;
+		int pick_victim() override;
+
+	private:
+		enum { T1, T2, B1, B2 };
+
+		int p;
+};
+
+#endif /* DB_REPLACER_H */
@@ -3,8 +3,15 @@
 #include "file.h"
 #include "buffer.h"
 
-int64_t open_table(char* pathname) {
-	return open_table_file(pathname);
+int64_t open_table(char* pathname, TableMode mode, AccessHint hint) {
+	int64_t ret = open_table_file(pathname, mode, hint);
+	if (ret > 0 && mode == TableMode::READ_WRITE)
+		buffer_load_dump(ret);
+	return ret;
+}
+
+int db_advise_table(int64_t table_id, AccessHint hint) {
+	return file_advise_table(table_id, hint);
 }
 
 int db_insert(int64_t table_id, int64_t key, 
@@ -21,17 +28,75 @@ int db_delete(int64_t table_id, int64_t key) {
 	return db_delete_record(table_id, key);
 }
 
-int init_db(int num_buf) {
+int db_insert_batch(int64_t table_id, int num_keys, const int64_t* keys,
+		char** values, const uint16_t* val_sizes, int* status) {
+	return db_insert_records(table_id, num_keys, keys, values, val_sizes,
+			status);
+}
+
+int db_find_batch(int64_t table_id, int num_keys, const int64_t* keys,
+		char** ret_vals, uint16_t* val_sizes, int* status) {
+	return db_find_records(table_id, num_keys, keys, ret_vals, val_sizes,
+			status);
+}
+
+int db_delete_batch(int64_t table_id, int num_keys, const int64_t* keys,
+		int* status) {
+	return db_delete_records(table_id, num_keys, keys, status);
+}
+
+Cursor* open_cursor(int64_t table_id, int64_t begin_key, int64_t end_key) {
+	return db_open_cursor(table_id, begin_key, end_key);
+}
+
+int cursor_next(Cursor* cursor, int64_t* key, char* ret_val,
+		uint16_t* val_size) {
+	return db_cursor_next(cursor, key, ret_val, val_size);
+}
+
+void cursor_close(Cursor* cursor) {
+	db_close_cursor(cursor);
+}
+
+int db_scan(int64_t table_id, int64_t begin_key, int64_t end_key,
+		int (*callback)(int64_t, const char*, uint16_t, void*), void* arg) {
+	return db_scan_records(table_id, begin_key, end_key, callback, arg);
+}
+
+int64_t db_bulk_load(int64_t table_id,
+		int (*next)(int64_t*, char*, uint16_t*, void*),
+		void* arg, double fill_factor) {
+	return db_bulk_load_records(table_id, next, arg, fill_factor);
+}
+
+int db_sync_table(int64_t table_id) {
+	return buffer_flush_table(table_id);
+}
+
+int init_db(int num_buf, ReplacePolicy policy, SyncMode sync_mode,
+		IoBackendType io_backend, bool direct_io, bool warm_restart) {
 	int ret;
 	ret = open_index_manager();
 	if (ret != 0)
 		return -1;
-    ret = init_buffer(num_buf);
-    if (ret != 0)
-        return -1;
-	ret = open_disk_manager();
-	if (ret != 0)
+	ret = open_disk_manager(sync_mode, io_backend, direct_io);
+	if (ret != 0) {
+		close_index_manager();
+		return -1;
+	}
+	ret = init_buffer(num_buf, policy, warm_restart);
+	if (ret != 0) {
+		close_disk_manager();
+		close_index_manager();
 		return -1;
+	}
+	ret = buffer_start_flusher();
+	if (ret != 0) {
+		shutdown_buffer();
+		close_disk_manager();
+		close_index_manager();
+		return -1;
+	}
 	return 0;
 }
 
@@ -40,9 +105,9 @@ int shutdown_db() {
 	ret = close_index_manager();
 	if (ret != 0)
 		return -1;
-    ret = shutdown_buffer();
-    if (ret != 0)
-        return -1;
+	ret = shutdown_buffer();
+	if (ret != 0)
+		return -1;
 	ret = close_disk_manager();
 	if (ret != 0)
 		return -1;
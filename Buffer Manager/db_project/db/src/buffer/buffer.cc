@@ -1,196 +1,1122 @@
 #include "buffer.h"
 #include "file.h"
+#include "free_space_map.h"
+#include "page_table.h"
 #include "msg.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <memory>
-#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
 #include <vector>
+#include <cstdio>
 #include <cstring>
+#include <cstdlib>
 
 ControlBlock * buf_CB;
 Page * Frames;
-std::map<std::pair<int64_t,pagenum_t>,int> hash;
-std::vector<int> unused_buf;
-int recent_buf_idx, buffer_num;
+int buffer_num;
+
+/*
+ * The pool is split into partitions by a hash of (table id, page number).
+ * A partition owns a contiguous range of frames and has its own latch,
+ * page table, replacer and unused list, so pins of pages that fall into
+ * different partitions do not contend. Frame indexes are global; the
+ * replacer of a partition works on indexes relative to base.
+ *
+ * A miss whose partition has every frame pinned spills into another one:
+ * the page is cached in a frame of that partition and in its page table.
+ * spilled counts the pages of a partition that live elsewhere; it only goes
+ * up with every latch held, so a lookup that holds the home latch and sees
+ * 0 need not look anywhere else.
+ *
+ * The latch of a partition protects the control blocks of its frames.
+ * Frames being read in or written back are pinned and io_pending is set;
+ * the I/O runs without the latch, and anyone who wants such a frame waits
+ * on io_done of the partition. The content of a pinned frame is protected
+ * by the frame's own latch (see buffer_latch_page()).
+ */
+struct alignas(64) Partition {
+    std::mutex latch;
+    std::condition_variable io_done;
+    std::unique_ptr<PageTable> hash;
+    std::unique_ptr<Replacer> replacer;
+    std::vector<int> unused_buf;
+    int base;
+    int num_buf;
+    std::atomic<int> spilled;
+    BufferStats stats;
+};
+constexpr int MAX_PARTITIONS = 64;
+constexpr int MIN_PARTITION_FRAMES = 64;
+std::unique_ptr<Partition[]> partitions;
+int num_partitions; // a power of two
+std::vector<int> frame_partition;
+std::atomic<int> dirty_num;
+std::atomic<uint64_t> read_ahead_pages;
+
+/** A dirty frame as collect_dirty() saw it */
+struct DirtyFrame {
+    int64_t table_id;
+    pagenum_t page_num;
+    int buf_index;
+};
+
+/** Serializes allocations with the checkpoint of buffer_flush_table(). */
+std::mutex space_latch;
+
+/** Background flusher */
+std::thread flusher;
+std::mutex flusher_latch;
+std::condition_variable flusher_wakeup;
+bool flusher_stop;
+std::atomic<int> flusher_high;
+int flusher_low;
+std::chrono::milliseconds flusher_interval;
+
+/*
+ * Warm restart. last_access of a frame is the access_clock of its last pin,
+ * which orders the dump. The warmer thread has warm_latch of its own and
+ * prefetches the queued batches only into unused frames.
+ */
+constexpr uint64_t DUMP_MAGIC = 0x31504d5546554221; // "!BUFDMP1"
+constexpr int WARM_BATCH = 64;
+bool dump_enabled;
+std::atomic<uint64_t> access_clock;
+std::thread warmer;
+std::mutex warm_latch;
+std::condition_variable warm_wakeup;
+std::condition_variable warm_done;
+std::deque<std::pair<int64_t, std::vector<pagenum_t>>> warm_jobs;
+bool warm_busy;
+bool warm_stop;
+
+/*
+ * Read-ahead along the leaf sibling chain. A leaf pinned right after its
+ * left sibling by the same thread continues a scan; the window then grows
+ * from RA_MIN_WINDOW by doubling, and every other leaf pin halves it. The
+ * state is per thread, so point lookups share nothing for it; epoch tells
+ * a state left from an earlier pool.
+ */
+struct ReadAhead {
+    uint64_t epoch;
+    int64_t table_id;
+    pagenum_t expect; // sibling of the last leaf pinned
+    int window;
+};
+constexpr int RA_MIN_WINDOW = 4;
+constexpr int RA_MAX_WINDOW = 64;
+thread_local ReadAhead read_ahead_state;
+uint64_t buffer_epoch;
+int ra_max_window;
+
+/*
+ * Frames the thread holds EXCLUSIVE and how many times, so that a structure
+ * change can pin and latch a page it already holds. There are a few of them
+ * at a time at most.
+ */
+thread_local std::vector<std::pair<int, int>> exclusive_held;
+
+/*
+ * Frames take_frame() may give. ANY evicts a victim and writes it back if
+ * it is dirty. CLEAN passes over dirty frames, so that a prefetch never
+ * waits for a write; UNUSED takes no victim at all.
+ */
+enum class FrameSource { ANY, CLEAN, UNUSED };
+
+/** static function decl */
+static Partition& partition_of(int64_t table_id, pagenum_t pagenum);
+static Partition& frame_owner(int buf_index);
+static int find_frame(Partition& part, int64_t table_id, pagenum_t pagenum);
+static void set_dirty(int buf_index);
+static void flush_frame(int buf_index);
+static void wait_io(Partition& part, std::unique_lock<std::mutex>& lock,
+                    int buf_index);
+static void collect_dirty(std::vector<DirtyFrame>& found, int64_t table_id,
+                          bool include_pinned);
+static void claim(const std::vector<DirtyFrame>& found,
+                  std::vector<int>& batch, bool include_pinned);
+static void write_back(const std::vector<int>& batch);
+static int flush_batch(int need);
+static void flusher_main();
+static bool io_in_progress(const Partition& part);
+static void wait_all_io();
+static int take_frame(Partition& part, FrameSource source);
+static int start_reads(int64_t table_id, const pagenum_t* pagenums, int count,
+                       FrameSource source);
+static void pin_hit(Partition& owner, int buf_index);
+static int load_frame(Partition& owner, std::unique_lock<std::mutex>& lock,
+                      int64_t table_id, pagenum_t pagenum, int buf_index);
+static int pin_spilled(Partition& home, int64_t table_id, pagenum_t pagenum);
+static bool leaf_sibling(int buf_index, pagenum_t* sibling);
+static void read_ahead(int buf_index);
+static std::string dump_path(int64_t table_id);
+static void save_dumps();
+static int read_dump(const std::string& path, std::vector<pagenum_t>& pagenums);
+static void warmer_main();
+static void stop_warmer();
+
+/** High bits of the hash; the page table of a partition uses the low ones. */
+static Partition& partition_of(int64_t table_id, pagenum_t pagenum){
+    uint64_t h = (pagenum ^ ((uint64_t)table_id << 40)) * 0xD6E8FEB86659FD93ULL;
+    return partitions[(h >> 48) & (num_partitions - 1)];
+}
+
+static Partition& frame_owner(int buf_index){
+    return partitions[frame_partition[buf_index]];
+}
+
+static int find_frame(Partition& part, int64_t table_id, pagenum_t pagenum){
+    return part.hash->find(table_id, pagenum);
+}
+
+/** The partition latch of the frame is held. */
+static void set_dirty(int buf_index){
+    if(buf_CB[buf_index].is_dirty){ return; }
+    buf_CB[buf_index].is_dirty = 1;
+    if(++dirty_num >= flusher_high){ flusher_wakeup.notify_one(); }
+}
+
+/** Write the frame back if it is dirty. */
+static void flush_frame(int buf_index){
+    if(!buf_CB[buf_index].is_dirty){ return; }
+    file_write_page(buf_CB[buf_index].table_id,
+                    buf_CB[buf_index].page_num,
+                    &Frames[buf_index]);
+    buf_CB[buf_index].is_dirty = 0;
+    dirty_num--;
+}
+
+/** Wait until the flusher is done with the frame. */
+static void wait_io(Partition& part, std::unique_lock<std::mutex>& lock,
+                    int buf_index){
+    while(buf_CB[buf_index].io_pending){ part.io_done.wait(lock); }
+}
+
+/*
+ * Dirty frames sorted by (table, page). Only frames of table_id unless it
+ * is 0, and only unpinned ones unless include_pinned. The partitions are
+ * latched one at a time, so the frames are only candidates for claim().
+ */
+static void collect_dirty(std::vector<DirtyFrame>& found, int64_t table_id,
+                          bool include_pinned){
+    for(int p = 0; p < num_partitions; p++){
+        Partition& part = partitions[p];
+        std::lock_guard<std::mutex> lock(part.latch);
+        for(int k = part.base; k < part.base + part.num_buf; k++){
+            if(!buf_CB[k].is_dirty || buf_CB[k].io_pending){ continue; }
+            if(buf_CB[k].is_pinned && !include_pinned){ continue; }
+            if(table_id != 0 && buf_CB[k].table_id != table_id){ continue; }
+            found.push_back({buf_CB[k].table_id, buf_CB[k].page_num, k});
+        }
+    }
+    std::sort(found.begin(), found.end(), [](const DirtyFrame& a,
+                                              const DirtyFrame& b){
+        if(a.table_id != b.table_id){ return a.table_id < b.table_id; }
+        return a.page_num < b.page_num;
+    });
+}
+
+/*
+ * Claim the collected frames for writing back: those that still hold the
+ * same page, dirty (and unpinned unless include_pinned), are pinned, marked
+ * io_pending and clean, and go to the batch in the collected order.
+ */
+static void claim(const std::vector<DirtyFrame>& found,
+                  std::vector<int>& batch, bool include_pinned){
+    std::vector<uint8_t> keep(found.size(), 0);
+
+    for(int p = 0; p < num_partitions; p++){
+        Partition& part = partitions[p];
+        std::unique_lock<std::mutex> lock(part.latch, std::defer_lock);
+        for(size_t i = 0; i < found.size(); i++){
+            int k = found[i].buf_index;
+            if(frame_partition[k] != p){ continue; }
+            if(!lock.owns_lock()){ lock.lock(); }
+            if(buf_CB[k].table_id != found[i].table_id
+               || buf_CB[k].page_num != found[i].page_num){ continue; }
+            if(!buf_CB[k].is_dirty || buf_CB[k].io_pending){ continue; }
+            if(buf_CB[k].is_pinned && !include_pinned){ continue; }
+            buf_CB[k].is_pinned++;
+            buf_CB[k].io_pending = 1;
+            buf_CB[k].is_dirty = 0;
+            dirty_num--;
+            keep[i] = 1;
+        }
+    }
+    for(size_t i = 0; i < found.size(); i++){
+        if(keep[i]){ batch.push_back(found[i].buf_index); }
+    }
+}
+
+/*
+ * Write the claimed frames back with one batch write per table, without
+ * any latch, and release them. Nobody latches an unpinned frame, so the
+ * content of the frames does not change during the write.
+ */
+static void write_back(const std::vector<int>& batch){
+    std::vector<pagenum_t> pagenums;
+    std::vector<const Page*> srcs;
+    size_t i, j;
+
+    if(batch.empty()){ return; }
+    for(i = 0; i < batch.size(); i = j){
+        pagenums.clear();
+        srcs.clear();
+        for(j = i; j < batch.size()
+            && buf_CB[batch[j]].table_id == buf_CB[batch[i]].table_id; j++){
+            pagenums.push_back(buf_CB[batch[j]].page_num);
+            srcs.push_back(&Frames[batch[j]]);
+        }
+        file_write_batch(buf_CB[batch[i]].table_id,
+                         pagenums.data(), srcs.data(), srcs.size());
+    }
+
+    for(int p = 0; p < num_partitions; p++){
+        Partition& part = partitions[p];
+        std::unique_lock<std::mutex> lock(part.latch, std::defer_lock);
+        for(int k : batch){
+            if(frame_partition[k] != p){ continue; }
+            if(!lock.owns_lock()){ lock.lock(); }
+            buf_CB[k].io_pending = 0;
+            buf_CB[k].is_pinned--;
+        }
+        if(lock.owns_lock()){ part.io_done.notify_all(); }
+    }
+}
+
+/*
+ * Write back at least 'need' dirty unpinned frames in (table, page) order.
+ * Return the number of frames written.
+ */
+static int flush_batch(int need){
+    std::vector<DirtyFrame> found;
+    std::vector<int> batch;
+    size_t n;
+
+    collect_dirty(found, 0, false);
+
+    // take 'need' frames, finishing the run the last one belongs to
+    n = std::min(found.size(), (size_t)std::max(need, 0));
+    while(n > 0 && n < found.size()
+          && found[n].table_id == found[n-1].table_id
+          && found[n].page_num == found[n-1].page_num + 1){
+        n++;
+    }
+    found.resize(n);
+    claim(found, batch, false);
+    write_back(batch);
+    return batch.size();
+}
+
+/*
+ * An unused frame of the partition, or an evicted victim as source allows.
+ * -1 if there is none.
+ */
+static int take_frame(Partition& part, FrameSource source){
+    int victim_idx;
+
+    if(part.unused_buf.size() != 0){ // use unused buf
+        victim_idx = part.unused_buf.back();
+        part.unused_buf.pop_back();
+        return victim_idx;
+    }
+    if(source == FrameSource::UNUSED){ return -1; }
+
+    // choose victim by the replacement policy
+    victim_idx = source == FrameSource::CLEAN
+                 ? part.replacer->pick_clean_victim()
+                 : part.replacer->pick_victim();
+    if(victim_idx != -1){
+        victim_idx += part.base;
+        //evict it
+        flush_frame(victim_idx);
+        part.hash->erase(buf_CB[victim_idx].table_id,
+                         buf_CB[victim_idx].page_num);
+        Partition& home = partition_of(buf_CB[victim_idx].table_id,
+                                       buf_CB[victim_idx].page_num);
+        if(&home != &part){ home.spilled--; }
+    }
+    return victim_idx;
+}
+
+static bool io_in_progress(const Partition& part){
+    for(int k = part.base; k < part.base + part.num_buf; k++){
+        if(buf_CB[k].io_pending){ return true; }
+    }
+    return false;
+}
+
+static void wait_all_io(){
+    for(int p = 0; p < num_partitions; p++){
+        std::unique_lock<std::mutex> lock(partitions[p].latch);
+        while(io_in_progress(partitions[p])){ partitions[p].io_done.wait(lock); }
+    }
+}
+
+static void flusher_main(){
+    std::unique_lock<std::mutex> lock(flusher_latch);
+    bool idle = false;
+
+    while(!flusher_stop){
+        // sleep a full interval if the last round found nothing to write
+        if(idle || dirty_num < flusher_high){
+            flusher_wakeup.wait_for(lock, flusher_interval);
+        }
+        if(flusher_stop){ break; }
+        lock.unlock();
+        idle = dirty_num <= flusher_low
+               || flush_batch(dirty_num - flusher_low) == 0;
+        lock.lock();
+    }
+}
+
+/** Sidecar file of the table's dump, or "" if the table is unknown. */
+static std::string dump_path(int64_t table_id){
+    std::string path = file_table_path(table_id);
+    return path.empty() ? path : path + ".bufdump";
+}
+
+/*
+ * Write one dump per table: magic, count, then the page numbers of its
+ * cached frames, most recently used first. A dump is written to a
+ * temporary file and renamed, so a crash leaves the old one or none.
+ * Nothing else runs on the pool any more.
+ */
+static void save_dumps(){
+    std::vector<int> frames;
+    std::vector<pagenum_t> pagenums;
+    size_t i, j;
+
+    for(int k = 0; k < buffer_num; k++){
+        Partition& part = frame_owner(k);
+        if(find_frame(part, buf_CB[k].table_id, buf_CB[k].page_num) == k){
+            frames.push_back(k);
+        }
+    }
+    std::sort(frames.begin(), frames.end(), [](int a, int b){
+        if(buf_CB[a].table_id != buf_CB[b].table_id){
+            return buf_CB[a].table_id < buf_CB[b].table_id;
+        }
+        return buf_CB[a].last_access > buf_CB[b].last_access;
+    });
+
+    for(i = 0; i < frames.size(); i = j){
+        int64_t table_id = buf_CB[frames[i]].table_id;
+        pagenums.clear();
+        for(j = i; j < frames.size()
+            && buf_CB[frames[j]].table_id == table_id; j++){
+            pagenums.push_back(buf_CB[frames[j]].page_num);
+        }
+
+        std::string path = dump_path(table_id);
+        if(path.empty()){ continue; }
+        std::string tmp = path + ".tmp";
+        uint64_t head[2] = {DUMP_MAGIC, pagenums.size()};
+        FILE* fp = std::fopen(tmp.c_str(), "wb");
+        if(fp == nullptr){
+            MSG("cannot write ", tmp, "\n");
+            continue;
+        }
+        bool ok = std::fwrite(head, sizeof(head), 1, fp) == 1
+            && std::fwrite(pagenums.data(), sizeof(pagenum_t),
+                           pagenums.size(), fp) == pagenums.size();
+        ok = std::fclose(fp) == 0 && ok;
+        if(!ok || std::rename(tmp.c_str(), path.c_str()) != 0){
+            MSG("cannot write ", path, "\n");
+            std::remove(tmp.c_str());
+        }
+    }
+}
+
+/** Read a dump. Return -1 if it is missing or malformed. */
+static int read_dump(const std::string& path, std::vector<pagenum_t>& pagenums){
+    uint64_t head[2];
+    FILE* fp = std::fopen(path.c_str(), "rb");
+    if(fp == nullptr){ return -1; }
+
+    bool ok = std::fread(head, sizeof(head), 1, fp) == 1
+        && head[0] == DUMP_MAGIC;
+    if(ok){
+        // a dump never holds more pages than the pool it came from
+        pagenums.resize(std::min<uint64_t>(head[1], 1 << 24));
+        ok = std::fread(pagenums.data(), sizeof(pagenum_t),
+                        pagenums.size(), fp) == pagenums.size();
+    }
+    std::fclose(fp);
+    return ok ? 0 : -1;
+}
+
+static void warmer_main(){
+    std::unique_lock<std::mutex> lock(warm_latch);
+
+    for(;;){
+        warm_wakeup.wait(lock, []{ return warm_stop || !warm_jobs.empty(); });
+        if(warm_stop){ break; }
+        auto job = std::move(warm_jobs.front());
+        warm_jobs.pop_front();
+        warm_busy = true;
+        lock.unlock();
+
+        // never evict the pages the workload already brought in
+        start_reads(job.first, job.second.data(), job.second.size(),
+                    FrameSource::UNUSED);
+
+        lock.lock();
+        warm_busy = false;
+        warm_done.notify_all();
+    }
+    warm_jobs.clear();
+    warm_done.notify_all();
+}
+
+static void stop_warmer(){
+    if(!warmer.joinable()){ return; }
+    {
+        std::lock_guard<std::mutex> lock(warm_latch);
+        warm_stop = true;
+    }
+    warm_wakeup.notify_one();
+    warmer.join();
+}
+
+int init_buffer(int num_buf, ReplacePolicy policy, bool warm_restart,
+                int num_parts){
 
-int init_buffer(int num_buf){
-    
     //Allocate the buffer pool with the given number of entries.
     buf_CB = new ControlBlock[num_buf];
-    Frames = new Page[num_buf];
-    
+    //Frames are page aligned so that O_DIRECT reads/writes need no copy.
+    Frames = static_cast<Page*>(std::aligned_alloc(PG_SIZE, sizeof(Page) * num_buf));
+    if(Frames == nullptr){
+        delete[] buf_CB;
+        return -1;
+    }
+
+    //Two partitions per core by default, each with enough frames for
+    //several threads to pin a path at once.
+    if(num_parts <= 0){
+        num_parts = std::min<int>(MAX_PARTITIONS,
+                2 * std::max(1u, std::thread::hardware_concurrency()));
+        num_parts = std::min(num_parts, num_buf / MIN_PARTITION_FRAMES);
+    }
+    num_parts = std::max(1, std::min(num_parts, num_buf));
+    num_partitions = 1;
+    while(num_partitions * 2 <= num_parts){ num_partitions *= 2; }
+
     //Initialize other fields for your own design.
-    for(int i=0; i<num_buf; i++){ unused_buf.push_back(i); }
+    for(int i=num_buf-1; i>=0; i--){
+        buf_CB[i].table_id = 0;
+        buf_CB[i].page_num = 0;
+        buf_CB[i].is_dirty = 0;
+        buf_CB[i].is_pinned = 0;
+        buf_CB[i].io_pending = 0;
+        buf_CB[i].last_access = 0;
+        buf_CB[i].version = 0;
+        buf_CB[i].frame = &Frames[i];
+    }
+    partitions = std::make_unique<Partition[]>(num_partitions);
+    frame_partition.assign(num_buf, 0);
+    for(int p = 0; p < num_partitions; p++){
+        Partition& part = partitions[p];
+        part.base = (int)((int64_t)num_buf * p / num_partitions);
+        part.num_buf = (int)((int64_t)num_buf * (p + 1) / num_partitions)
+                       - part.base;
+        part.hash = std::make_unique<PageTable>(part.num_buf);
+        part.spilled = 0;
+        part.replacer = make_replacer(policy, buf_CB + part.base, part.num_buf);
+        for(int k = part.base + part.num_buf - 1; k >= part.base; k--){
+            part.unused_buf.push_back(k);
+            frame_partition[k] = p;
+        }
+    }
     buffer_num = num_buf;
-    
+    dirty_num = 0;
+    flusher_high = num_buf + 1; // flusher is off until started
+    buffer_reset_stats();
+    buffer_epoch++;
+    ra_max_window = std::min(RA_MAX_WINDOW, num_buf / 4);
+    dump_enabled = warm_restart;
+    access_clock = 0;
+    warm_stop = false;
+    warm_busy = false;
+
+    // lets an io_uring backend map the frames once
+    file_register_buffer(Frames, sizeof(Page) * num_buf);
+
     return 0;
 }
 
-pagenum_t buffer_alloc_page(int64_t table_id){
-    MSG("buf alloc.\n");
-    pagenum_t ret_page_no;
-    std::pair<int64_t,pagenum_t> key = {table_id, 0};
-    
-    ret_page_no = file_alloc_page(table_id); //allocate page in disk first
-    
-    if(hash.find(key)!=hash.end()){
-        //update if header is on the buffer already
-        MSG("header found\n");
-        int header_buf_index = hash.find(key)->second;
-        HeaderPage head;
-        
-        memcpy(&head, reinterpret_cast<Page*>(buf_CB[header_buf_index].frame),sizeof(head));
-        SET_HEADER_ROOT_PAGE_NO(&head, ret_page_no);
-        memcpy(reinterpret_cast<Page*>(buf_CB[header_buf_index].frame),&head,sizeof(head));
-        
-        buf_CB[header_buf_index].is_dirty=0;
-    }
-    
-    std::pair<int64_t,pagenum_t> key_alloc = {table_id, ret_page_no};
-    
-    if(hash.find(key_alloc)!=hash.end()){
-        //update if allocated page is on the buffer already
-        MSG("alloc found\n");
-        int alloc_buf_index = hash.find(key_alloc)->second;
-        file_read_page(table_id,ret_page_no,&Frames[alloc_buf_index]);
-        buf_CB[alloc_buf_index].is_dirty=0;
-    }
-    
-    return ret_page_no;
+int buffer_num_partitions(){
+    return num_partitions;
+}
+
+/*
+ * The disk manager keeps the free-space map in memory and writes no page
+ * here, so no cached page goes stale. A cached frame of a freed page may
+ * still be written back; the page is free, so nothing reads it.
+ */
+pagenum_t buffer_alloc_page(int64_t table_id, pagenum_t hint){
+    std::lock_guard<std::mutex> lock(space_latch);
+    return file_alloc_page(table_id, hint);
 }
 
 void buffer_free_page(int64_t table_id, pagenum_t pagenum){
-    std::pair<int64_t,pagenum_t> key = {table_id, 0};
-    file_free_page(table_id,pagenum);
-    
-    if(hash.find(key)!=hash.end()){
-        //update if header is on the buffer already
-        int header_buf_index = hash.find(key)->second;
-        HeaderPage head;
-        
-        memcpy(&head,reinterpret_cast<Page*>(buf_CB[header_buf_index].frame),sizeof(head));
-        SET_HEADER_FREE_PAGE_NO(&head,pagenum);
-        memcpy(reinterpret_cast<Page*>(buf_CB[header_buf_index].frame),&head,sizeof(head));
-        
-        buf_CB[header_buf_index].is_dirty=0;
-    }
-}
-
-void control_read_LRU(int buf_index){
-    if(recent_buf_idx == buf_index) { return; }
-    
-    int next = buf_CB[buf_index].next_idx;
-    int prev = buf_CB[buf_index].prev_idx;
-    
-    if(next != -1 && prev != -1){
-        buf_CB[next].prev_idx = prev;
-    }
-    
-    buf_CB[prev].next_idx = next;
-    buf_CB[buf_index].next_idx = recent_buf_idx;
-    buf_CB[buf_index].prev_idx = -1;
-    
-    recent_buf_idx = buf_index;
-}
-
-void control_new_LRU(int buf_index){
-    buf_CB[buf_index].next_idx = recent_buf_idx;
-    buf_CB[buf_index].prev_idx = -1;
-    
-    recent_buf_idx = buf_index;
-}
-
-void buffer_read_page(int64_t table_id, pagenum_t pagenum, const std::shared_ptr<Page>& dest){
-    MSG("buf read",table_id,' ',pagenum,"\n");
-    
-    std::pair<int64_t,pagenum_t> key = {table_id, pagenum};
+    std::lock_guard<std::mutex> lock(space_latch);
+    file_free_page(table_id, pagenum);
+}
+
+int buffer_pin_page(int64_t table_id, pagenum_t pagenum){
+    Partition& part = partition_of(table_id, pagenum);
+    std::unique_lock<std::mutex> lock(part.latch);
     int buf_index;
-    
-    if(hash.find(key)!=hash.end()){ // already in buffer (hit)
-        buf_index=hash.find(key)->second;
-        buf_CB[buf_index].is_pinned++;
-        MSG("#####hit#####\n");
-        control_read_LRU(buf_index);
-        
-        dest =  std::make_shared<Page>(*reinterpret_cast<Page*>(buf_CB[buf_index].frame));
-        /*if(pagenum == 0){
-            HeaderPage head;
-            memcpy(&head, reinterpret_cast<Page*>(buf_CB[buf_index].frame),sizeof(head));
-            MSG("buf read - header root no : ",head.root_page_no,'\n');
-        }*/
-    }
-    else{
-        if(unused_buf.size() == 0){
-            // choose victim by LRU policy
-            int last_idx, victim_idx;
-            for(int i = recent_buf_idx; ; i=buf_CB[i].next_idx){
-                if(buf_CB[i].next_idx == -1){
-                    last_idx = i;
-                    break;
-                }
+
+    for(;;){
+        buf_index = find_frame(part, table_id, pagenum);
+        if(buf_index != -1){ // already in buffer (hit)
+            if(buf_CB[buf_index].io_pending){
+                part.io_done.wait(lock);
+                continue;
             }
-            
-            for(int i = last_idx; ; i=buf_CB[i].prev_idx){
-                if(buf_CB[i].is_pinned > 0){
-                    if(i == recent_buf_idx){
-                        MSG("Every buffer pool is pinned\n");
-                        exit(0);
-                    }
-                    continue;
-                }
-                victim_idx = i;
-                break;
+            pin_hit(part, buf_index);
+            lock.unlock();
+            read_ahead(buf_index);
+            return buf_index;
+        }
+        if(part.spilled != 0){ // it may be in another partition
+            lock.unlock();
+            return pin_spilled(part, table_id, pagenum);
+        }
+
+        buf_index = take_frame(part, FrameSource::ANY);
+        if(buf_index != -1){ break; }
+        if(!io_in_progress(part)){
+            if(num_partitions > 1){
+                lock.unlock();
+                return pin_spilled(part, table_id, pagenum);
             }
-            
-            //evict it
-            file_write_page(buf_CB[victim_idx].table_id,
-                            buf_CB[victim_idx].page_num,
-                            reinterpret_cast<Page*>(buf_CB[victim_idx].frame));
-            
-            buf_index = victim_idx;
-        }
-        else{ // use unused buf
-            buf_index = unused_buf.front();
-            unused_buf.erase(unused_buf.begin());
-        }
-        hash.insert(make_pair(key,buf_index));
-        file_read_page(table_id,pagenum,&Frames[buf_index]);
-        buf_CB[buf_index].frame = reinterpret_cast<Page*>(&Frames[buf_index]);
-            
+            MSG("Every buffer pool is pinned\n");
+            return -1;
+        }
+        // frames pinned for I/O come back soon
+        part.io_done.wait(lock);
+    }
+
+    return load_frame(part, lock, table_id, pagenum, buf_index);
+}
+
+/** The partition latch of the frame is held. */
+static void pin_hit(Partition& owner, int buf_index){
+    buf_CB[buf_index].is_pinned++;
+    if(dump_enabled){ buf_CB[buf_index].last_access = ++access_clock; }
+    owner.replacer->on_access(buf_index - owner.base);
+    owner.stats.hits++;
+}
+
+/*
+ * Read the page into the frame taken from owner, whose latch lock holds.
+ * The latch is let go during the read and on return.
+ */
+static int load_frame(Partition& owner, std::unique_lock<std::mutex>& lock,
+                      int64_t table_id, pagenum_t pagenum, int buf_index){
+    int ret;
+
+    owner.stats.misses++;
+    owner.hash->insert(table_id, pagenum, buf_index);
+
+    buf_CB[buf_index].table_id = table_id;
+    buf_CB[buf_index].page_num = pagenum;
+    buf_CB[buf_index].is_dirty = 0;
+    buf_CB[buf_index].is_pinned = 1;
+    buf_CB[buf_index].io_pending = 1;
+    if(dump_enabled){ buf_CB[buf_index].last_access = ++access_clock; }
+
+    owner.replacer->on_insert(buf_index - owner.base);
+
+    // other misses can be read in parallel
+    lock.unlock();
+    ret = file_read_page(table_id, pagenum, &Frames[buf_index]);
+    lock.lock();
+
+    buf_CB[buf_index].io_pending = 0;
+    owner.io_done.notify_all();
+    if(ret != 0){ // forget the page, as a failed read-ahead does
+        owner.hash->erase(table_id, pagenum);
+        owner.replacer->on_remove(buf_index - owner.base);
+        owner.unused_buf.push_back(buf_index);
+        buf_CB[buf_index].is_pinned = 0;
+        Partition& home = partition_of(table_id, pagenum);
+        if(&home != &owner){ home.spilled--; }
+        return -1;
+    }
+    lock.unlock();
+    read_ahead(buf_index);
+
+    return buf_index;
+}
+
+/*
+ * The miss path of a page whose home partition has spilled pages or no
+ * frame to give: look in every partition, and take a frame from the next
+ * one that has it if home has none. Every latch is held, in order, as
+ * buffer_flush_table() takes them; this path is only run when the pool is
+ * short of frames.
+ */
+static int pin_spilled(Partition& home, int64_t table_id, pagenum_t pagenum){
+    std::vector<std::unique_lock<std::mutex>> locks;
+    int first = &home - partitions.get();
+    int buf_index;
+    bool io = false;
+
+    for(;;){
+        for(int p = 0; p < num_partitions; p++){
+            locks.emplace_back(partitions[p].latch);
+        }
+
+        buf_index = find_frame(home, table_id, pagenum);
+        for(int p = 1; buf_index == -1 && home.spilled != 0
+                       && p < num_partitions; p++){
+            buf_index = find_frame(partitions[(first + p) % num_partitions],
+                                   table_id, pagenum);
+        }
+        if(buf_index != -1){
+            if(buf_CB[buf_index].io_pending){ // many latches: poll
+                locks.clear();
+                std::this_thread::yield();
+                continue;
+            }
+            pin_hit(frame_owner(buf_index), buf_index);
+            locks.clear();
+            read_ahead(buf_index);
+            return buf_index;
+        }
+
+        for(int p = 0; buf_index == -1 && p < num_partitions; p++){
+            Partition& part = partitions[(first + p) % num_partitions];
+            buf_index = take_frame(part, FrameSource::ANY);
+            io = io || io_in_progress(part);
+        }
+        if(buf_index != -1){ break; }
+        if(!io){
+            MSG("Every buffer pool is pinned\n");
+            return -1;
+        }
+        // frames pinned for I/O come back soon
+        locks.clear();
+        std::this_thread::yield();
+        io = false;
+    }
+
+    int owner = frame_partition[buf_index];
+    if(owner != first){ home.spilled++; }
+    std::unique_lock<std::mutex> lock = std::move(locks[owner]);
+    locks.clear();
+    return load_frame(partitions[owner], lock, table_id, pagenum, buf_index);
+}
+
+int buffer_prefetch(int64_t table_id, const pagenum_t* pagenums, int count){
+    return start_reads(table_id, pagenums, count, FrameSource::ANY);
+}
+
+/*
+ * Start reading the pages that are not cached into the frames take_frame()
+ * gives from source. A page whose partition has no frame to give, or has
+ * spilled pages, is skipped.
+ */
+static int start_reads(int64_t table_id, const pagenum_t* pagenums, int count,
+                       FrameSource source){
+    std::vector<std::pair<int, pagenum_t>> reads;
+    int buf_index;
+
+    for(int i = 0; i < count; i++){
+        Partition& part = partition_of(table_id, pagenums[i]);
+        std::lock_guard<std::mutex> lock(part.latch);
+        if(find_frame(part, table_id, pagenums[i]) != -1){ continue; }
+        if(part.spilled != 0){ continue; } // it may be elsewhere
+        buf_index = take_frame(part, source);
+        if(buf_index == -1){ continue; }
+
+        part.hash->insert(table_id, pagenums[i], buf_index);
         buf_CB[buf_index].table_id = table_id;
-        buf_CB[buf_index].page_num = pagenum;
+        buf_CB[buf_index].page_num = pagenums[i];
         buf_CB[buf_index].is_dirty = 0;
-        buf_CB[buf_index].is_pinned = 1;
-        
-        control_new_LRU(buf_index);
-        
-        dest =  std::make_shared<Page>(*reinterpret_cast<Page*>(buf_CB[buf_index].frame));
+        buf_CB[buf_index].is_pinned = 1; // held by the read
+        buf_CB[buf_index].io_pending = 1;
+        buf_CB[buf_index].last_access = 0; // not used yet
+        part.replacer->on_insert(buf_index - part.base);
+        reads.emplace_back(buf_index, pagenums[i]);
     }
+
+    for(auto& r : reads){
+        buf_index = r.first;
+        file_read_page_async(table_id, r.second, &Frames[buf_index],
+            [buf_index](int ret){
+                Partition& part = frame_owner(buf_index);
+                std::lock_guard<std::mutex> lock(part.latch);
+                if(ret != 0){ // forget the page
+                    part.hash->erase(buf_CB[buf_index].table_id,
+                                     buf_CB[buf_index].page_num);
+                    part.replacer->on_remove(buf_index - part.base);
+                    part.unused_buf.push_back(buf_index);
+                }
+                buf_CB[buf_index].io_pending = 0;
+                buf_CB[buf_index].is_pinned--;
+                part.io_done.notify_all();
+            });
+    }
+    file_submit();
+    return reads.size();
 }
 
-void buffer_write_page(int64_t table_id, pagenum_t pagenum, const Page* src){
-    std::pair<int64_t,pagenum_t> key = {table_id, pagenum};
-    int buf_index;
-    
-    if(hash.find(key)==hash.end()){
-        MSG("buffer write error : key not found\n");
+/*
+ * The right sibling of the leaf in the frame, read under a shared try-latch.
+ * False if the page is not a leaf or someone holds the latch EXCLUSIVE.
+ */
+static bool leaf_sibling(int buf_index, pagenum_t* sibling){
+    ControlBlock& cb = buf_CB[buf_index];
+    const LeafPage* leaf = reinterpret_cast<const LeafPage*>(&Frames[buf_index]);
+    bool is_leaf;
+
+    if(!cb.latch.try_lock_shared()){ return false; }
+    is_leaf = GET_IS_LEAF(leaf) == 1;
+    *sibling = is_leaf ? GET_LEAF_SIBLING(leaf) : 0;
+    cb.latch.unlock_shared();
+    return is_leaf;
+}
+
+/*
+ * Called without any latch, with the page of the pinned frame in memory.
+ * If it is a leaf that continues a scan, read the next window leaves of the
+ * chain ahead. The chain is followed through the leaves already in memory.
+ * Past the first one that is not, the next pages of its extent are guessed
+ * if the leaf was followed by the page after it, as a leaf is allocated
+ * right after its left sibling when there is room. A wrong guess costs a
+ * clean frame; dirty frames are left to the flusher.
+ * A leaf is only read under its shared latch; the chain ends at one that is
+ * latched EXCLUSIVE, and at a page past the end of the file.
+ */
+static void read_ahead(int buf_index){
+    int64_t table_id = buf_CB[buf_index].table_id;
+    pagenum_t pagenum = buf_CB[buf_index].page_num;
+    ReadAhead& ra = read_ahead_state;
+    std::vector<pagenum_t> pagenums;
+    pagenum_t sibling, next, num_pages;
+    bool contiguous;
+    int k;
+
+    if(ra_max_window == 0 || pagenum == 0){ return; }
+    if(!leaf_sibling(buf_index, &sibling)){ return; }
+
+    if(ra.epoch != buffer_epoch){ ra = {buffer_epoch, 0, 0, 0}; }
+    if(table_id != ra.table_id || pagenum != ra.expect){
+        ra.table_id = table_id;
+        ra.expect = sibling;
+        ra.window /= 2;
+        return;
     }
-    
-    buf_index=hash.find(key)->second;
-    buf_CB[buf_index].frame = const_cast<Page*>(src);
-    buf_CB[buf_index].is_dirty = 1;
+    ra.expect = sibling;
+    ra.window = ra.window == 0 ? std::min(RA_MIN_WINDOW, ra_max_window)
+                               : std::min(ra.window * 2, ra_max_window);
+    contiguous = ra.expect == pagenum + 1;
+
+    next = ra.expect;
+    num_pages = file_num_pages(table_id);
+    for(int i = 0; i < ra.window && next != 0 && next < num_pages; i++){
+        Partition& part = partition_of(table_id, next);
+        std::lock_guard<std::mutex> lock(part.latch);
+        k = find_frame(part, table_id, next);
+        if(k == -1){ pagenums.push_back(next); }
+        if(k != -1 && !buf_CB[k].io_pending){
+            next = leaf_sibling(k, &sibling) ? sibling : 0;
+        } else if(contiguous){
+            next = (next + 1) % EXTENT_PAGES == 0 ? 0 : next + 1;
+        } else {
+            next = 0;
+        }
+    }
+    if(pagenums.empty()){ return; }
+    read_ahead_pages += start_reads(table_id, pagenums.data(),
+                                    pagenums.size(), FrameSource::CLEAN);
+}
+
+int buffer_load_dump(int64_t table_id){
+    std::vector<pagenum_t> pagenums;
+
+    if(!dump_enabled){ return 0; }
+    std::string path = dump_path(table_id);
+    if(path.empty() || read_dump(path, pagenums) != 0){ return 0; }
+    // the pages are about to be cached; a crash must not load them twice
+    std::remove(path.c_str());
+    if((int)pagenums.size() > buffer_num){ pagenums.resize(buffer_num); }
+
+    std::lock_guard<std::mutex> lock(warm_latch);
+    for(size_t i = 0; i < pagenums.size(); i += WARM_BATCH){
+        auto first = pagenums.begin() + i;
+        auto last = pagenums.begin() + std::min(pagenums.size(), i + WARM_BATCH);
+        std::vector<pagenum_t> batch(first, last);
+        std::sort(batch.begin(), batch.end());
+        warm_jobs.emplace_back(table_id, std::move(batch));
+    }
+    if(!warmer.joinable()){ warmer = std::thread(warmer_main); }
+    warm_wakeup.notify_one();
+    return pagenums.size();
+}
+
+void buffer_wait_warmup(){
+    {
+        std::unique_lock<std::mutex> lock(warm_latch);
+        warm_done.wait(lock, []{ return warm_jobs.empty() && !warm_busy; });
+    }
+    wait_all_io();
+}
+
+void buffer_unpin_page(int buf_index){
+    std::lock_guard<std::mutex> lock(frame_owner(buf_index).latch);
+    assert(buf_CB[buf_index].is_pinned > 0);
     buf_CB[buf_index].is_pinned--;
 }
 
+void buffer_mark_dirty(int buf_index){
+    std::lock_guard<std::mutex> lock(frame_owner(buf_index).latch);
+    set_dirty(buf_index);
+}
+
+void buffer_latch_page(int buf_index, LatchMode mode){
+    ControlBlock& cb = buf_CB[buf_index];
+    if(mode == LatchMode::SHARED){ cb.latch.lock_shared(); return; }
+    if(mode != LatchMode::EXCLUSIVE){ return; }
+
+    for(auto& held : exclusive_held){
+        if(held.first == buf_index){ held.second++; return; }
+    }
+    cb.latch.lock();
+    // odd until the unlatch; readers that saw the old version fail validation
+    cb.version.store(cb.version.load(std::memory_order_relaxed) + 1,
+            std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    exclusive_held.emplace_back(buf_index, 1);
+}
+
+void buffer_unlatch_page(int buf_index, LatchMode mode){
+    ControlBlock& cb = buf_CB[buf_index];
+    if(mode == LatchMode::SHARED){ cb.latch.unlock_shared(); return; }
+    if(mode != LatchMode::EXCLUSIVE){ return; }
+
+    auto held = std::find_if(exclusive_held.begin(), exclusive_held.end(),
+            [buf_index](const std::pair<int, int>& h){
+                return h.first == buf_index;
+            });
+    assert(held != exclusive_held.end());
+    if(held == exclusive_held.end()){
+        MSG("frame ", buf_index, " is not latched exclusively\n");
+        return;
+    }
+    if(--held->second > 0){ return; }
+    exclusive_held.erase(held);
+    cb.version.store(cb.version.load(std::memory_order_relaxed) + 1,
+            std::memory_order_release);
+    cb.latch.unlock();
+}
+
+uint64_t buffer_read_version(int buf_index){
+    ControlBlock& cb = buf_CB[buf_index];
+    uint64_t version;
+    while((version = cb.version.load(std::memory_order_acquire)) & 1){
+        for(const auto& held : exclusive_held){
+            if(held.first == buf_index){ return version; }
+        }
+        std::this_thread::yield();
+    }
+    return version;
+}
+
+bool buffer_validate(int buf_index, uint64_t version){
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return buf_CB[buf_index].version.load(std::memory_order_relaxed) == version;
+}
+
+Page* buffer_get_frame(int buf_index){
+    return &Frames[buf_index];
+}
+
+pagenum_t buffer_get_page_num(int buf_index){
+    return buf_CB[buf_index].page_num;
+}
+
+void buffer_get_stats(BufferStats* out){
+    *out = {};
+    for(int p = 0; p < num_partitions; p++){
+        std::lock_guard<std::mutex> lock(partitions[p].latch);
+        out->hits += partitions[p].stats.hits;
+        out->misses += partitions[p].stats.misses;
+    }
+    out->read_ahead = read_ahead_pages;
+}
+
+void buffer_reset_stats(){
+    for(int p = 0; p < num_partitions; p++){
+        std::lock_guard<std::mutex> lock(partitions[p].latch);
+        partitions[p].stats = {};
+    }
+    read_ahead_pages = 0;
+}
+
+int buffer_start_flusher(double high_ratio, double low_ratio, int interval_ms){
+    if(flusher.joinable() || low_ratio > high_ratio){ return -1; }
+
+    std::lock_guard<std::mutex> lock(flusher_latch);
+    flusher_high = std::max(1, (int)(buffer_num * high_ratio));
+    flusher_low = std::min(flusher_high - 1, (int)(buffer_num * low_ratio));
+    flusher_interval = std::chrono::milliseconds(interval_ms);
+    flusher_stop = false;
+    flusher = std::thread(flusher_main);
+    return 0;
+}
+
+void buffer_stop_flusher(){
+    if(!flusher.joinable()){ return; }
+    {
+        std::lock_guard<std::mutex> lock(flusher_latch);
+        flusher_stop = true;
+        flusher_high = buffer_num + 1;
+    }
+    flusher_wakeup.notify_one();
+    flusher.join();
+}
+
+int buffer_flush_table(int64_t table_id){
+    std::vector<std::unique_lock<std::mutex>> locks;
+    std::vector<DirtyFrame> found;
+    std::vector<int> batch;
+    bool clean = true;
+
+    // pages under the flusher are written by it already
+    for(int p = 0; p < num_partitions; p++){
+        Partition& part = partitions[p];
+        std::unique_lock<std::mutex> lock(part.latch);
+        for(int k = part.base; k < part.base + part.num_buf; k++){
+            if(buf_CB[k].table_id == table_id){ wait_io(part, lock, k); }
+        }
+    }
+    collect_dirty(found, table_id, false);
+    claim(found, batch, false);
+    write_back(batch);
+
+    // With nothing of the table left in memory only, the free-space map is
+    // saved as up to date. Every partition is latched, in order, so that no
+    // page gets dirty meanwhile, and allocations wait on space_latch.
+    for(int p = 0; p < num_partitions; p++){
+        Partition& part = partitions[p];
+        locks.emplace_back(part.latch);
+        for(int k = part.base; k < part.base + part.num_buf; k++){
+            if(buf_CB[k].io_pending
+               || (buf_CB[k].is_dirty && buf_CB[k].table_id == table_id)){
+                clean = false;
+            }
+        }
+    }
+    if(clean){
+        std::lock_guard<std::mutex> lock(space_latch);
+        return file_checkpoint_table(table_id);
+    }
+    locks.clear();
+    return file_sync_table(table_id);
+}
+
 int shutdown_buffer(){
+    std::vector<DirtyFrame> found;
+    std::vector<int> batch;
+
+    stop_warmer();
+    buffer_stop_flusher();
     for(int i = 0; i<buffer_num; i++){
-        if(buf_CB[i].is_dirty){
-            file_write_page(buf_CB[i].table_id,
-                            buf_CB[i].page_num,
-                            reinterpret_cast<Page*>(buf_CB[i].frame));
+        if(buf_CB[i].is_pinned){
+            MSG("page ", buf_CB[i].page_num, " is still pinned\n");
         }
     }
+    wait_all_io(); // prefetches
+    collect_dirty(found, 0, true);
+    claim(found, batch, true);
+    write_back(batch);
+    if(dump_enabled){ save_dumps(); }
+
+    file_unregister_buffer();
     delete[] buf_CB;
-    delete[] Frames;
+    std::free(Frames);
+    partitions = nullptr;
+    num_partitions = 0;
+    frame_partition.clear();
     return 0;
 }
+
+/** PageGuard */
+PageGuard::PageGuard(int64_t table_id, pagenum_t pagenum, LatchMode mode)
+    : buf_index(-1), frame(nullptr), mode(mode), version(0) {
+    buf_index = buffer_pin_page(table_id, pagenum);
+    if(buf_index != -1){
+        if(mode == LatchMode::OPTIMISTIC){ version = buffer_read_version(buf_index); }
+        else{ buffer_latch_page(buf_index, mode); }
+        frame = buffer_get_frame(buf_index);
+    }
+}
+
+PageGuard::PageGuard(PageGuard&& other) noexcept
+    : buf_index(other.buf_index), frame(other.frame), mode(other.mode),
+      version(other.version) {
+    other.buf_index = -1;
+    other.frame = nullptr;
+}
+
+PageGuard& PageGuard::operator=(PageGuard&& other) noexcept {
+    if(this != &other){
+        release();
+        buf_index = other.buf_index;
+        frame = other.frame;
+        mode = other.mode;
+        version = other.version;
+        other.buf_index = -1;
+        other.frame = nullptr;
+    }
+    return *this;
+}
+
+void PageGuard::mark_dirty(){
+    assert(buf_index != -1);
+    buffer_mark_dirty(buf_index);
+}
+
+bool PageGuard::validate() const {
+    assert(buf_index != -1 && mode == LatchMode::OPTIMISTIC);
+    return buffer_validate(buf_index, version);
+}
+
+bool PageGuard::latch(LatchMode new_mode){
+    assert(buf_index != -1 && mode == LatchMode::OPTIMISTIC);
+    buffer_latch_page(buf_index, new_mode);
+    mode = new_mode;
+    // our own EXCLUSIVE latch made the version odd
+    return buffer_validate(buf_index,
+            new_mode == LatchMode::EXCLUSIVE ? version + 1 : version);
+}
+
+void PageGuard::unlatch(){
+    assert(buf_index != -1 && mode != LatchMode::OPTIMISTIC);
+    // nobody else changes the frame until the unlatch
+    uint64_t current = buffer_read_version(buf_index);
+    buffer_unlatch_page(buf_index, mode);
+    version = mode == LatchMode::EXCLUSIVE ? current + 1 : current;
+    mode = LatchMode::OPTIMISTIC;
+}
+
+void PageGuard::release(){
+    if(buf_index == -1){ return; }
+    buffer_unlatch_page(buf_index, mode);
+    buffer_unpin_page(buf_index);
+    buf_index = -1;
+    frame = nullptr;
+}
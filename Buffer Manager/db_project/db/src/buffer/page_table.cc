@@ -0,0 +1,59 @@
+#include "page_table.h"
+
+#include <cassert>
+
+PageTable::PageTable(int num_buf) {
+	size_t cap = 16;
+	while (cap < (size_t)num_buf * 2)
+		cap <<= 1;
+
+	this->entries = std::make_unique<Entry[]>(cap);
+	this->mask = cap - 1;
+	this->clear();
+}
+
+void PageTable::clear() {
+	for (size_t i = 0; i <= this->mask; ++i)
+		this->entries[i].buf_index = -1;
+}
+
+void PageTable::insert(int64_t table_id, pagenum_t pagenum, int buf_index) {
+	assert(buf_index >= 0);
+
+	size_t i = this->slot_of(table_id, pagenum);
+	while (this->entries[i].buf_index != -1) {
+		assert(this->entries[i].page_num != pagenum ||
+				this->entries[i].table_id != table_id);
+		i = (i + 1) & this->mask;
+	}
+
+	this->entries[i].table_id = table_id;
+	this->entries[i].page_num = pagenum;
+	this->entries[i].buf_index = buf_index;
+}
+
+void PageTable::erase(int64_t table_id, pagenum_t pagenum) {
+	size_t i, j, home;
+
+	for (i = this->slot_of(table_id, pagenum); ; i = (i + 1) & this->mask) {
+		if (this->entries[i].buf_index == -1)
+			return;
+		if (this->entries[i].page_num == pagenum &&
+				this->entries[i].table_id == table_id)
+			break;
+	}
+
+	/**
+	 * Backward-shift deletion. Move every later entry of the run whose home
+	 * slot is not in (i, j] into the hole, so probes never stop early.
+	 */
+	for (j = (i + 1) & this->mask; this->entries[j].buf_index != -1;
+			j = (j + 1) & this->mask) {
+		home = this->slot_of(this->entries[j].table_id, this->entries[j].page_num);
+		if (((j - home) & this->mask) >= ((j - i) & this->mask)) {
+			this->entries[i] = this->entries[j];
+			i = j;
+		}
+	}
+	this->entries[i].buf_index = -1;
+}
@@ -0,0 +1,596 @@
+#include "replacer.h"
+#include "buffer.h"
+#include "page_table.h"
+
+#include <algorithm>
+#include <cassert>
+
+std::unique_ptr<Replacer> make_replacer(
+		ReplacePolicy policy, ControlBlock* cb, int num_buf) {
+	switch (policy) {
+		case ReplacePolicy::LRU:
+			return std::make_unique<LRUReplacer>(cb, num_buf);
+		case ReplacePolicy::CLOCK:
+			return std::make_unique<ClockReplacer>(cb, num_buf);
+		case ReplacePolicy::CLOCK_PRO:
+			return std::make_unique<ClockProReplacer>(cb, num_buf);
+		case ReplacePolicy::TWO_Q:
+			return std::make_unique<TwoQReplacer>(cb, num_buf);
+		case ReplacePolicy::ARC:
+			return std::make_unique<ARCReplacer>(cb, num_buf);
+	}
+	return nullptr;
+}
+
+/** Replacer */
+int Replacer::pick_clean_victim() {
+	this->skip_dirty = true;
+	int victim = this->pick_victim();
+	this->skip_dirty = false;
+	return victim;
+}
+
+bool Replacer::evictable(int buf_index) const {
+	return this->cb[buf_index].is_pinned == 0 &&
+		!(this->skip_dirty && this->cb[buf_index].is_dirty);
+}
+
+/** LRUReplacer */
+LRUReplacer::LRUReplacer(ControlBlock* cb, int num_buf)
+	: Replacer(cb, num_buf), next_idx(num_buf, -1), prev_idx(num_buf, -1),
+	recent_buf_idx(-1), last_buf_idx(-1) {}
+
+void LRUReplacer::unlink(int buf_index) {
+	int next = this->next_idx[buf_index];
+	int prev = this->prev_idx[buf_index];
+
+	if (prev != -1) this->next_idx[prev] = next;
+	else this->recent_buf_idx = next;
+	if (next != -1) this->prev_idx[next] = prev;
+	else this->last_buf_idx = prev;
+
+	this->next_idx[buf_index] = this->prev_idx[buf_index] = -1;
+}
+
+void LRUReplacer::on_insert(int buf_index) {
+	this->next_idx[buf_index] = this->recent_buf_idx;
+	this->prev_idx[buf_index] = -1;
+
+	if (this->recent_buf_idx != -1)
+		this->prev_idx[this->recent_buf_idx] = buf_index;
+	else
+		this->last_buf_idx = buf_index;
+
+	this->recent_buf_idx = buf_index;
+}
+
+void LRUReplacer::on_access(int buf_index) {
+	if (this->recent_buf_idx == buf_index)
+		return;
+	this->unlink(buf_index);
+	this->on_insert(buf_index);
+}
+
+void LRUReplacer::on_remove(int buf_index) {
+	this->unlink(buf_index);
+}
+
+int LRUReplacer::pick_victim() {
+	int i;
+	for (i = this->last_buf_idx; i != -1; i = this->prev_idx[i]) {
+		if (this->evictable(i))
+			break;
+	}
+	if (i != -1)
+		this->unlink(i);
+	return i;
+}
+
+/** ClockReplacer */
+ClockReplacer::ClockReplacer(ControlBlock* cb, int num_buf)
+	: Replacer(cb, num_buf), ref_bit(num_buf, 0), in_use(num_buf, 0), hand(0) {}
+
+void ClockReplacer::on_insert(int buf_index) {
+	this->in_use[buf_index] = 1;
+	this->ref_bit[buf_index] = 1;
+}
+
+void ClockReplacer::on_access(int buf_index) {
+	this->ref_bit[buf_index] = 1;
+}
+
+void ClockReplacer::on_remove(int buf_index) {
+	this->in_use[buf_index] = 0;
+	this->ref_bit[buf_index] = 0;
+}
+
+int ClockReplacer::pick_victim() {
+	int victim;
+
+	/** Two sweeps clear every reference bit of unpinned frames. */
+	for (int step = 0; step <= 2 * this->num_buf; ++step) {
+		victim = this->hand;
+		this->hand = (this->hand + 1) % this->num_buf;
+
+		if (!this->in_use[victim] || !this->evictable(victim))
+			continue;
+		if (this->ref_bit[victim]) {
+			this->ref_bit[victim] = 0;
+			continue;
+		}
+		this->in_use[victim] = 0;
+		return victim;
+	}
+	return -1;
+}
+
+/** ClockProReplacer */
+ClockProReplacer::ClockProReplacer(ControlBlock* cb, int num_buf)
+	: Replacer(cb, num_buf), nodes(2 * num_buf),
+	non_resident(std::make_unique<PageTable>(num_buf)),
+	hand_hot(-1), hand_cold(-1), hand_test(-1),
+	num_hot(0), num_cold(0), num_non_resident(0), cold_target(1) {
+	for (auto& n : this->nodes)
+		n.linked = 0;
+	for (int id = 2 * num_buf - 1; id >= num_buf; --id)
+		this->free_non_resident.push_back(id);
+}
+
+ClockProReplacer::~ClockProReplacer() {}
+
+/** New entries go right behind HAND_hot, the head of the clock. */
+void ClockProReplacer::link_at_head(int id) {
+	Node& n = this->nodes[id];
+	assert(!n.linked);
+	n.linked = 1;
+
+	if (this->hand_hot == -1) {
+		n.next = n.prev = id;
+		this->hand_hot = this->hand_cold = this->hand_test = id;
+		return;
+	}
+
+	int next = this->hand_hot;
+	int prev = this->nodes[next].prev;
+	n.next = next;
+	n.prev = prev;
+	this->nodes[prev].next = id;
+	this->nodes[next].prev = id;
+}
+
+void ClockProReplacer::unlink(int id) {
+	Node& n = this->nodes[id];
+	assert(n.linked);
+	n.linked = 0;
+
+	if (n.next == id) {
+		this->hand_hot = this->hand_cold = this->hand_test = -1;
+		return;
+	}
+
+	if (this->hand_hot == id) this->hand_hot = n.next;
+	if (this->hand_cold == id) this->hand_cold = n.next;
+	if (this->hand_test == id) this->hand_test = n.next;
+
+	this->nodes[n.prev].next = n.next;
+	this->nodes[n.next].prev = n.prev;
+}
+
+/** Put new_id at the clock position of old_id. */
+void ClockProReplacer::replace_node(int old_id, int new_id) {
+	Node& o = this->nodes[old_id];
+	Node& n = this->nodes[new_id];
+	assert(o.linked && !n.linked);
+
+	if (o.next == old_id) {
+		n.next = n.prev = new_id;
+	} else {
+		n.next = o.next;
+		n.prev = o.prev;
+		this->nodes[o.prev].next = new_id;
+		this->nodes[o.next].prev = new_id;
+	}
+	n.linked = 1;
+	o.linked = 0;
+
+	if (this->hand_hot == old_id) this->hand_hot = new_id;
+	if (this->hand_cold == old_id) this->hand_cold = new_id;
+	if (this->hand_test == old_id) this->hand_test = new_id;
+}
+
+void ClockProReplacer::drop_non_resident(int id) {
+	Node& n = this->nodes[id];
+	this->non_resident->erase(n.table_id, n.page_num);
+	this->unlink(id);
+	this->free_non_resident.push_back(id);
+	this->num_non_resident--;
+}
+
+/** A test period ended without a re-reference: favor hot pages. */
+void ClockProReplacer::dec_cold_target() {
+	if (this->cold_target > 1)
+		this->cold_target--;
+}
+
+/** Demote one hot page, ending the test periods it passes over. */
+void ClockProReplacer::run_hand_hot() {
+	int id, next;
+	int limit = 3 * (this->num_hot + this->num_cold + this->num_non_resident);
+
+	for (int step = 0; step < limit && this->hand_hot != -1; ++step) {
+		id = this->hand_hot;
+		Node& n = this->nodes[id];
+		next = n.next;
+
+		if (id >= this->num_buf) {
+			this->hand_hot = next;
+			this->drop_non_resident(id);
+			this->dec_cold_target();
+			continue;
+		}
+
+		this->hand_hot = next;
+		if (!n.hot) {
+			if (n.test) {
+				n.test = 0;
+				this->dec_cold_target();
+			}
+			continue;
+		}
+		if (n.ref) {
+			n.ref = 0;
+			continue;
+		}
+
+		n.hot = 0;
+		n.test = 0;
+		this->num_hot--;
+		this->num_cold++;
+		return;
+	}
+}
+
+/** Remove one non-resident entry. */
+void ClockProReplacer::run_hand_test() {
+	int id, next;
+	int limit = 2 * (this->num_hot + this->num_cold + this->num_non_resident);
+
+	for (int step = 0; step < limit && this->hand_test != -1; ++step) {
+		id = this->hand_test;
+		Node& n = this->nodes[id];
+		next = n.next;
+		this->hand_test = next;
+
+		if (id >= this->num_buf) {
+			this->drop_non_resident(id);
+			this->dec_cold_target();
+			return;
+		}
+		if (!n.hot && n.test) {
+			n.test = 0;
+			this->dec_cold_target();
+		}
+	}
+}
+
+void ClockProReplacer::on_insert(int buf_index) {
+	Node& n = this->nodes[buf_index];
+	int nr = this->non_resident->find(
+			this->cb[buf_index].table_id, this->cb[buf_index].page_num);
+
+	n.ref = 0;
+	if (nr != -1) {
+		/** Faulted during its test period: a short reuse distance. */
+		this->drop_non_resident(nr);
+		if (this->cold_target < this->num_buf - 1)
+			this->cold_target++;
+
+		n.hot = 1;
+		n.test = 0;
+		this->num_hot++;
+		this->link_at_head(buf_index);
+
+		while (this->num_hot > this->num_buf - this->cold_target) {
+			int before = this->num_hot;
+			this->run_hand_hot();
+			if (this->num_hot == before)
+				break;
+		}
+	} else {
+		n.hot = 0;
+		n.test = 1;
+		this->num_cold++;
+		this->link_at_head(buf_index);
+	}
+}
+
+void ClockProReplacer::on_access(int buf_index) {
+	this->nodes[buf_index].ref = 1;
+}
+
+void ClockProReplacer::on_remove(int buf_index) {
+	Node& n = this->nodes[buf_index];
+	if (!n.linked)
+		return;
+	if (n.hot) this->num_hot--;
+	else this->num_cold--;
+	this->unlink(buf_index);
+}
+
+int ClockProReplacer::pick_victim() {
+	int id, next, nr;
+	int limit = 4 * (this->num_hot + this->num_cold + this->num_non_resident) + 4;
+
+	for (int step = 0; step < limit && this->hand_cold != -1; ++step) {
+		id = this->hand_cold;
+		Node& n = this->nodes[id];
+		next = n.next;
+
+		/** HAND_cold only stops at resident cold pages. */
+		if (id >= this->num_buf || n.hot || !this->evictable(id)) {
+			this->hand_cold = next;
+			if (this->num_cold == 0)
+				this->run_hand_hot();
+			continue;
+		}
+
+		if (n.ref) {
+			n.ref = 0;
+			this->hand_cold = next;
+			this->unlink(id);
+			if (n.test) {
+				/** Re-referenced during its test period: promote. */
+				n.test = 0;
+				n.hot = 1;
+				this->num_cold--;
+				this->num_hot++;
+				if (this->cold_target < this->num_buf - 1)
+					this->cold_target++;
+			} else {
+				n.test = 1;
+			}
+			this->link_at_head(id);
+
+			while (this->num_hot > this->num_buf - this->cold_target) {
+				int before = this->num_hot;
+				this->run_hand_hot();
+				if (this->num_hot == before)
+					break;
+			}
+			continue;
+		}
+
+		/** Victim found. */
+		this->hand_cold = next;
+		this->num_cold--;
+		if (n.test) {
+			/** Keep its metadata until the test period ends. */
+			if (this->free_non_resident.empty())
+				this->run_hand_test();
+			assert(!this->free_non_resident.empty());
+
+			nr = this->free_non_resident.back();
+			this->free_non_resident.pop_back();
+
+			Node& m = this->nodes[nr];
+			m.table_id = this->cb[id].table_id;
+			m.page_num = this->cb[id].page_num;
+			m.hot = 0;
+			m.test = 1;
+			m.ref = 0;
+			this->replace_node(id, nr);
+			this->non_resident->insert(m.table_id, m.page_num, nr);
+			this->num_non_resident++;
+
+			if (this->num_non_resident > this->num_buf)
+				this->run_hand_test();
+		} else {
+			this->unlink(id);
+		}
+		n.test = 0;
+		return id;
+	}
+
+	/*
+	 * Every cold page is pinned and the hot ones were not demoted in time.
+	 * Take any unpinned resident page rather than fail.
+	 */
+	for (id = 0; id < this->num_buf; ++id) {
+		Node& n = this->nodes[id];
+		if (!n.linked || !this->evictable(id))
+			continue;
+		if (n.hot) this->num_hot--;
+		else this->num_cold--;
+		this->unlink(id);
+		n.hot = 0;
+		n.test = 0;
+		return id;
+	}
+	return -1;
+}
+
+/** ListReplacer */
+ListReplacer::ListReplacer(ControlBlock* cb, int num_buf,
+		int num_lists, int num_ghost)
+	: Replacer(cb, num_buf),
+	next(num_buf + num_ghost, -1), prev(num_buf + num_ghost, -1),
+	owner(num_buf + num_ghost, -1),
+	head(num_lists, -1), tail(num_lists, -1), count(num_lists, 0),
+	ghost_table_id(num_ghost), ghost_page_num(num_ghost),
+	ghosts(std::make_unique<PageTable>(num_ghost)) {
+	for (int id = num_buf + num_ghost - 1; id >= num_buf; --id)
+		this->free_ghost.push_back(id);
+}
+
+ListReplacer::~ListReplacer() {}
+
+void ListReplacer::push_front(int list, int id) {
+	assert(this->owner[id] == -1);
+	this->owner[id] = list;
+	this->prev[id] = -1;
+	this->next[id] = this->head[list];
+
+	if (this->head[list] != -1)
+		this->prev[this->head[list]] = id;
+	else
+		this->tail[list] = id;
+	this->head[list] = id;
+	this->count[list]++;
+}
+
+void ListReplacer::unlink(int id) {
+	int list = this->owner[id];
+	assert(list != -1);
+
+	if (this->prev[id] != -1) this->next[this->prev[id]] = this->next[id];
+	else this->head[list] = this->next[id];
+	if (this->next[id] != -1) this->prev[this->next[id]] = this->prev[id];
+	else this->tail[list] = this->prev[id];
+
+	this->next[id] = this->prev[id] = this->owner[id] = -1;
+	this->count[list]--;
+}
+
+int ListReplacer::unpinned_back(int list) const {
+	int i;
+	for (i = this->tail[list]; i != -1; i = this->prev[i]) {
+		if (this->evictable(i))
+			break;
+	}
+	return i;
+}
+
+void ListReplacer::on_remove(int buf_index) {
+	if (this->owner[buf_index] != -1)
+		this->unlink(buf_index);
+}
+
+void ListReplacer::push_ghost(int list, int buf_index, int drop_list) {
+	int id;
+
+	if (this->free_ghost.empty()) {
+		id = this->tail[drop_list];
+		if (id == -1)
+			id = this->tail[list];
+		this->drop_ghost(id);
+	}
+	id = this->free_ghost.back();
+	this->free_ghost.pop_back();
+
+	this->ghost_table_id[id - this->num_buf] = this->cb[buf_index].table_id;
+	this->ghost_page_num[id - this->num_buf] = this->cb[buf_index].page_num;
+	this->ghosts->insert(this->cb[buf_index].table_id,
+			this->cb[buf_index].page_num, id);
+	this->push_front(list, id);
+}
+
+int ListReplacer::find_ghost(int64_t table_id, pagenum_t pagenum) const {
+	return this->ghosts->find(table_id, pagenum);
+}
+
+void ListReplacer::drop_ghost(int id) {
+	this->ghosts->erase(this->ghost_table_id[id - this->num_buf],
+			this->ghost_page_num[id - this->num_buf]);
+	this->unlink(id);
+	this->free_ghost.push_back(id);
+}
+
+/** TwoQReplacer. Kin = 25% and Kout = 50% of the frames as in the paper. */
+TwoQReplacer::TwoQReplacer(ControlBlock* cb, int num_buf)
+	: ListReplacer(cb, num_buf, 3, std::max(1, num_buf / 2)),
+	k_in(std::max(1, num_buf / 4)) {}
+
+void TwoQReplacer::on_insert(int buf_index) {
+	int ghost = this->find_ghost(
+			this->cb[buf_index].table_id, this->cb[buf_index].page_num);
+
+	if (ghost != -1) {
+		this->drop_ghost(ghost);
+		this->push_front(AM, buf_index);
+	} else {
+		this->push_front(A1IN, buf_index);
+	}
+}
+
+void TwoQReplacer::on_access(int buf_index) {
+	/** Hits in A1in are correlated references and are ignored. */
+	if (this->list_of(buf_index) != AM)
+		return;
+	this->unlink(buf_index);
+	this->push_front(AM, buf_index);
+}
+
+int TwoQReplacer::pick_victim() {
+	int victim = -1;
+
+	if (this->size_of(A1IN) > this->k_in || this->size_of(AM) == 0)
+		victim = this->unpinned_back(A1IN);
+	if (victim == -1)
+		victim = this->unpinned_back(AM);
+	if (victim == -1)
+		victim = this->unpinned_back(A1IN);
+	if (victim == -1)
+		return -1;
+
+	int list = this->list_of(victim);
+	this->unlink(victim);
+	if (list == A1IN)
+		this->push_ghost(A1OUT, victim, A1OUT);
+	return victim;
+}
+
+/** ARCReplacer */
+ARCReplacer::ARCReplacer(ControlBlock* cb, int num_buf)
+	: ListReplacer(cb, num_buf, 4, num_buf), p(0) {}
+
+void ARCReplacer::on_insert(int buf_index) {
+	int ghost = this->find_ghost(
+			this->cb[buf_index].table_id, this->cb[buf_index].page_num);
+	int b1 = this->size_of(B1);
+	int b2 = this->size_of(B2);
+
+	if (ghost == -1) {
+		this->push_front(T1, buf_index);
+		/** Keep |T1| + |B1| <= c. */
+		if (this->size_of(T1) + this->size_of(B1) > this->num_buf &&
+				this->size_of(B1) > 0)
+			this->drop_ghost(this->back(B1));
+		return;
+	}
+
+	if (this->list_of(ghost) == B1)
+		this->p = std::min(this->num_buf, this->p + std::max(b2 / b1, 1));
+	else
+		this->p = std::max(0, this->p - std::max(b1 / b2, 1));
+
+	this->drop_ghost(ghost);
+	this->push_front(T2, buf_index);
+}
+
+void ARCReplacer::on_access(int buf_index) {
+	this->unlink(buf_index);
+	this->push_front(T2, buf_index);
+}
+
+int ARCReplacer::pick_victim() {
+	int victim = -1;
+	int t1 = this->size_of(T1);
+
+	if (t1 > 0 && (t1 > this->p || this->size_of(T2) == 0))
+		victim = this->unpinned_back(T1);
+	if (victim == -1)
+		victim = this->unpinned_back(T2);
+	if (victim == -1)
+		victim = this->unpinned_back(T1);
+	if (victim == -1)
+		return -1;
+
+	int list = this->list_of(victim);
+	this->unlink(victim);
+	/** |B1| + |B2| <= c: the ghost pool drops from B2 first when full. */
+	if (list == T1)
+		this->push_ghost(B1, victim, B2);
+	else
+		this->push_ghost(B2, victim, B2);
+	return victim;
+}
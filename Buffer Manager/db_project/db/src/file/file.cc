@@ -1,27 +1,63 @@
 #include "file.h"
+#include "free_space_map.h"
+#include "io_backend.h"
 #include "msg.h"
 
 #include <fcntl.h>
+#include <algorithm>
 #include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <cstring>
 #include <unistd.h>
+#include <climits>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <vector>
 
 /** const vars */
 constexpr int DEFAULT_SIZE = 10 * 1024 * 1024; /** 10MiB */
 constexpr int DEFAULT_NUM_OF_PAGES = DEFAULT_SIZE / PG_SIZE;
 static_assert(DEFAULT_NUM_OF_PAGES == 2560);
 
+/** Free-space map of an open table and where it lives on disk. */
+struct TableSpace {
+	std::mutex latch;
+	FreeSpaceMap map;
+	std::vector<pagenum_t> map_pages;	// k-th map page
+	std::vector<uint8_t> dirty;			// map page k differs from disk
+	bool clean_on_disk;					// first map page says clean
+	pagenum_t cursor;					// next-fit search position
+};
+
 /** DiskManager */
 static std::unique_ptr<DiskManager> disk_manager {nullptr};
+static SyncMode sync_mode {SyncMode::PER_WRITE};
+static std::unique_ptr<IoBackend> io_backend {nullptr};
+static bool direct_io {false};
 
 /** static funtion decl */
 static void init_header_page(HeaderPage*);
+static bool file_needs_bounce(const void*);
+static Page* file_bounce_page();
 static void file_read_page_internal(int, off_t, void*);
+static void file_read_pages_internal(int, off_t, Page* const*, int);
 static void file_write_page_internal(int, off_t, const void*);
-static pagenum_t file_expand_file(int, HeaderPage*);
+static void file_write_pages_internal(int, off_t, const Page* const*, int);
+static void file_reserve_pages(int, pagenum_t, pagenum_t);
+static void file_sync_internal(int);
+static pagenum_t file_find_free(TableSpace*, pagenum_t);
+static void file_expand_file(int, TableSpace*);
+static void file_add_map_pages(TableSpace*);
+static void file_rebuild_free_map(int, const HeaderPage*, TableSpace*);
+static void file_load_free_map(int, HeaderPage*, TableSpace*);
+static void file_save_free_map(int, TableSpace*, bool);
 
 
 /** DiskManager Class APIs */
@@ -32,10 +68,12 @@ DiskManager::DiskManager() {
 
 DiskManager::~DiskManager() {
 	this->map_tid_to_fd.clear();
+	this->map_tid_to_space.clear();
 }
 
 /** Return new table id matching with the given file descriptor. */
 int64_t DiskManager::set_table_id(int fd) {
+	std::unique_lock<std::shared_mutex> lock(this->latch);
 	int64_t ret_table_id;
 	ret_table_id = this->max_table_id++;
 	if (this->map_tid_to_fd.find(ret_table_id) !=
@@ -56,10 +94,13 @@ int64_t DiskManager::get_table_id(int fd) {
 	int64_t ret_table_id;
 
 	// Find table id matching with a given file descriptor
-	for (auto& x: this->map_tid_to_fd) {
-		if (x.second == fd) {
-			ret_table_id = x.first;
-			goto func_exit;
+	{
+		std::shared_lock<std::shared_mutex> lock(this->latch);
+		for (auto& x: this->map_tid_to_fd) {
+			if (x.second == fd) {
+				ret_table_id = x.first;
+				goto func_exit;
+			}
 		}
 	}
 	// Set new table id
@@ -71,6 +112,7 @@ func_exit:
 
 /** Return the file descriptor matching with the given table id. */
 int DiskManager::get_fd(int64_t table_id) {
+	std::shared_lock<std::shared_mutex> lock(this->latch);
 	if (this->map_tid_to_fd.find(table_id) == this->map_tid_to_fd.end()) {
 		assert([&]()->bool {
 				std::cerr << "erro in get_id().\n Cannot find fd.";
@@ -78,95 +120,467 @@ int DiskManager::get_fd(int64_t table_id) {
 				}());
 	}
 
-	return this->map_tid_to_fd[table_id];
+	return this->map_tid_to_fd.at(table_id);
+}
+
+/** Attach the free-space map of the table. */
+void DiskManager::set_space(int64_t table_id,
+		std::unique_ptr<TableSpace> space) {
+	std::unique_lock<std::shared_mutex> lock(this->latch);
+	this->map_tid_to_space[table_id] = std::move(space);
+}
+
+/** Return the free-space map of the table. */
+TableSpace* DiskManager::get_space(int64_t table_id) {
+	std::shared_lock<std::shared_mutex> lock(this->latch);
+	return this->map_tid_to_space.at(table_id).get();
+}
+
+/** Attach the mapping of a read-only table. */
+void DiskManager::set_mapping(int64_t table_id, const Page* pages,
+		pagenum_t num_of_pages) {
+	std::unique_lock<std::shared_mutex> lock(this->latch);
+	this->map_tid_to_mapping[table_id] = {pages, num_of_pages};
+}
+
+/** Return the mapping of the table, or nullptr if it is not mapped. */
+const Page* DiskManager::get_mapping(int64_t table_id,
+		pagenum_t* num_of_pages) {
+	std::shared_lock<std::shared_mutex> lock(this->latch);
+	auto it = this->map_tid_to_mapping.find(table_id);
+	if (it == this->map_tid_to_mapping.end())
+		return nullptr;
+	*num_of_pages = it->second.second;
+	return it->second.first;
+}
+
+/** Remember the pathname the table was opened with. */
+void DiskManager::set_path(int64_t table_id, const char* pathname) {
+	std::unique_lock<std::shared_mutex> lock(this->latch);
+	this->map_tid_to_path[table_id] = pathname;
+}
+
+/** Return the pathname of the table, or "" if it is not open. */
+std::string DiskManager::get_path(int64_t table_id) {
+	std::shared_lock<std::shared_mutex> lock(this->latch);
+	auto it = this->map_tid_to_path.find(table_id);
+	return it == this->map_tid_to_path.end() ? std::string() : it->second;
 }
 
-/** Close all file descriptors. */
+/*
+ * Close all file descriptors. The buffer pool has been shut down, so the
+ * files are consistent and the free-space maps are saved as clean.
+ */
 void DiskManager::close_table_files() {
+	std::unique_lock<std::shared_mutex> lock(this->latch);
+	HeaderPage header_page;
 	for (auto &x : this->map_tid_to_fd) {
 		assert(x.second >= 0);
+		auto mapping = this->map_tid_to_mapping.find(x.first);
+		if (mapping != this->map_tid_to_mapping.end()) {
+			munmap(const_cast<Page*>(mapping->second.first),
+					mapping->second.second * PG_SIZE);
+			close(x.second);
+			continue;
+		}
+		auto it = this->map_tid_to_space.find(x.first);
+		if (it != this->map_tid_to_space.end() && !it->second->clean_on_disk) {
+			TableSpace* space = it->second.get();
+			file_read_page_internal(x.second, 0,
+					reinterpret_cast<Page*>(&header_page));
+			if (GET_HEADER_NUM_OF_PAGES(&header_page) != space->map.size()) {
+				SET_HEADER_NUM_OF_PAGES(&header_page, space->map.size());
+				file_write_page_internal(x.second, 0,
+						reinterpret_cast<Page*>(&header_page));
+			}
+			file_save_free_map(x.second, space, true);
+		} else if (sync_mode != SyncMode::PER_WRITE) {
+			file_sync_internal(x.second);
+		}
 		close(x.second);
 	}
+	this->map_tid_to_fd.clear();
+	this->map_tid_to_space.clear();
+	this->map_tid_to_mapping.clear();
+	this->map_tid_to_path.clear();
 }
 
 /** static function def */
 static void init_header_page(HeaderPage* header_page) {
-	SET_HEADER_FREE_PAGE_NO(header_page, 1);
+	SET_HEADER_FREE_PAGE_NO(header_page, 0);
 	SET_HEADER_NUM_OF_PAGES(header_page, DEFAULT_NUM_OF_PAGES);
 	SET_HEADER_ROOT_PAGE_NO(header_page, 0);
+	SET_HEADER_HIGH_WATER_MARK(header_page, DEFAULT_NUM_OF_PAGES);
+	SET_HEADER_FREE_MAP_PAGE_NO(header_page, 1);
+}
+
+/** O_DIRECT needs the memory of a transfer to be aligned as well. */
+static bool file_needs_bounce(const void* p) {
+	return direct_io && reinterpret_cast<uintptr_t>(p) % PG_SIZE != 0;
+}
+
+/** Aligned page of the calling thread for I/O of unaligned pages. */
+static Page* file_bounce_page() {
+	thread_local std::unique_ptr<Page, decltype(&std::free)> bounce(
+			static_cast<Page*>(std::aligned_alloc(PG_SIZE, PG_SIZE)), &std::free);
+	assert(bounce != nullptr);
+	return bounce.get();
 }
 
 /** Read a page from the disk physically. */
 static void file_read_page_internal(int fd, off_t off, void* dest) {
-	lseek(fd, off, SEEK_SET);
+	if (file_needs_bounce(dest)) {
+		Page* bounce = file_bounce_page();
+		file_read_page_internal(fd, off, bounce);
+		memcpy(dest, bounce, PG_SIZE);
+		return;
+	}
 #ifdef NDEBUG
-	if (read(fd, dest, PG_SIZE) != PG_SIZE) {
+	if (io_backend->read(fd, dest, PG_SIZE, off) != PG_SIZE) {
 		MSG("page read error.");
 		exit(0);
 	}
 #else
-	assert(PG_SIZE == read(fd, dest, PG_SIZE));
+	assert(PG_SIZE == io_backend->read(fd, dest, PG_SIZE, off));
+#endif
+}
+
+/** Read consecutive pages with as few preadv() calls as possible. */
+static void file_read_pages_internal(int fd, off_t off,
+		Page* const* dests, int count) {
+	struct iovec iov[IOV_MAX];
+	ssize_t ret, expected;
+	int n;
+
+	if (direct_io && std::any_of(dests, dests + count, file_needs_bounce)) {
+		for (int i = 0; i < count; ++i)
+			file_read_page_internal(fd, off + (off_t)i * PG_SIZE, dests[i]);
+		return;
+	}
+
+	while (count > 0) {
+		n = std::min(count, IOV_MAX);
+		for (int i = 0; i < n; ++i) {
+			iov[i].iov_base = dests[i];
+			iov[i].iov_len = PG_SIZE;
+		}
+		expected = (ssize_t)n * PG_SIZE;
+		ret = io_backend->readv(fd, iov, n, off);
+#ifdef NDEBUG
+		if (ret != expected) {
+			MSG("page read error.");
+			exit(0);
+		}
+#else
+		assert(ret == expected);
 #endif
+		dests += n;
+		count -= n;
+		off += expected;
+	}
 }
 
-/** Write a page from the disk physically. */
+/** Write a page from the disk physically. It is not synced. */
 static void file_write_page_internal(int fd, off_t off, const void* src) {
-	lseek(fd, off, SEEK_SET);
+	if (file_needs_bounce(src)) {
+		Page* bounce = file_bounce_page();
+		memcpy(bounce, src, PG_SIZE);
+		src = bounce;
+	}
 #ifdef NDEBUG
-	if (write(fd, src, PG_SIZE) != PG_SIZE) {
+	if (io_backend->write(fd, src, PG_SIZE, off) != PG_SIZE) {
 		MSG("page write error.");
 		exit(0);
 	}
-	if (fsync(fd) != 0) {
-		MSG("fsync error.");
+#else
+	assert(PG_SIZE == io_backend->write(fd, src, PG_SIZE, off));
+#endif
+}
+
+/** Make the written pages durable. Also a write barrier. */
+static void file_sync_internal(int fd) {
+#ifdef NDEBUG
+	if (io_backend->datasync(fd) != 0) {
+		MSG("fdatasync error.");
+		exit(0);
+	}
+#else
+	assert(io_backend->datasync(fd) == 0);
+#endif
+}
+
+/** Write consecutive pages with as few pwritev() calls as possible. */
+static void file_write_pages_internal(int fd, off_t off,
+		const Page* const* srcs, int count) {
+	struct iovec iov[IOV_MAX];
+	ssize_t ret, expected;
+	int n;
+
+	if (direct_io && std::any_of(srcs, srcs + count, file_needs_bounce)) {
+		for (int i = 0; i < count; ++i)
+			file_write_page_internal(fd, off + (off_t)i * PG_SIZE, srcs[i]);
+		return;
+	}
+
+	while (count > 0) {
+		n = std::min(count, IOV_MAX);
+		for (int i = 0; i < n; ++i) {
+			iov[i].iov_base = const_cast<Page*>(srcs[i]);
+			iov[i].iov_len = PG_SIZE;
+		}
+		expected = (ssize_t)n * PG_SIZE;
+		ret = io_backend->writev(fd, iov, n, off);
+#ifdef NDEBUG
+		if (ret != expected) {
+			MSG("page write error.");
+			exit(0);
+		}
+#else
+		assert(ret == expected);
+#endif
+		srcs += n;
+		count -= n;
+		off += expected;
+	}
+}
+
+/*
+ * Reserve the space of pages [first, last) without writing them. Falls back
+ * to growing the file sparsely if the file system lacks fallocate(2).
+ * It is not synced.
+ */
+static void file_reserve_pages(int fd, pagenum_t first, pagenum_t last) {
+	off_t off = first * PG_SIZE;
+	off_t len = (last - first) * PG_SIZE;
+	int ret = fallocate(fd, 0, off, len);
+	if (ret != 0 && errno == EOPNOTSUPP)
+		ret = ftruncate(fd, off + len);
+#ifdef NDEBUG
+	if (ret != 0) {
+		MSG("fallocate error.");
 		exit(0);
 	}
 #else
-	assert(PG_SIZE == write(fd, src, PG_SIZE));
-	assert(fsync(fd) == 0);
+	assert(ret == 0);
 #endif
 }
 
-/** Expand the database. */
-static pagenum_t file_expand_file(int fd, HeaderPage* header_page) {
+/*
+ * Expand the database. Only the space is reserved; the new pages are free
+ * in the map and never written until they are used.
+ */
+static void file_expand_file(int fd, TableSpace* space) {
 	MSG("file_expand_file().\n");
-	pagenum_t ret_page_no;
-	FreePage free_page;
 	uint64_t num_of_pages;
 
 	/** It should be guaranteed that there is no free page. */
-	num_of_pages = GET_HEADER_FREE_PAGE_NO(header_page);
-	assert(num_of_pages == 0);
+	assert(space->map.num_free() == 0);
+	num_of_pages = space->map.size();
 
-	num_of_pages = GET_HEADER_NUM_OF_PAGES(header_page);
-	memset(&free_page, 0x00, PG_SIZE);
+	/** Doubling. The space must be on disk before any page in it is used. */
+	file_reserve_pages(fd, num_of_pages, num_of_pages * 2);
+	file_sync_internal(fd);
 
-	/** Doubling */
-	for (uint64_t i = num_of_pages; i < num_of_pages * 2; ++i) {
-		if (i == num_of_pages * 2 - 1)
-			SET_FREE_NEXT_PAGE_NO(&free_page, 0);
+	space->map.resize(num_of_pages * 2);
+	file_add_map_pages(space);
+}
+
+/*
+ * Pick a free page. With a hint, the page right after it if that is free
+ * (its extent is then reserved), else the start of a newly reserved extent. Without one, or if there is no
+ * empty extent left, next-fit from the cursor outside the reserved extents,
+ * and inside them only as a last resort. 0 if the map is full.
+ */
+static pagenum_t file_find_free(TableSpace* space, pagenum_t hint) {
+	pagenum_t ret_page_no = 0;
+
+	if (hint != 0) {
+		ret_page_no = space->map.find_free_after(hint);
+		if (ret_page_no != 0)
+			space->map.reserve(ret_page_no);
 		else
-			SET_FREE_NEXT_PAGE_NO(&free_page, i + 1);
-		
-		SET_PAGE_NO(&free_page, i);
-		file_write_page_internal(
-				fd, i * PG_SIZE, reinterpret_cast<Page*>(&free_page));
+			ret_page_no = space->map.reserve_extent(hint);
+		if (ret_page_no != 0)
+			return ret_page_no;
+	}
+	ret_page_no = space->map.find_free_unreserved(space->cursor);
+	if (ret_page_no == 0)
+		ret_page_no = space->map.find_free(space->cursor);
+	return ret_page_no;
+}
+
+/** Allocate map pages until the map pages cover every page of the map. */
+static void file_add_map_pages(TableSpace* space) {
+	size_t need = (space->map.size() + FREE_MAP_BITS - 1) / FREE_MAP_BITS;
+	space->dirty.resize(need, 1);
+
+	while (space->map_pages.size() < need) {
+		pagenum_t pagenum = space->map.find_free(space->map_pages.back());
+		assert(pagenum != 0);
+		space->map.set_used(pagenum);
+		space->dirty[pagenum / FREE_MAP_BITS] = 1;
+		space->dirty[space->map_pages.size() - 1] = 1;	// its next link
+		space->map_pages.push_back(pagenum);
+	}
+}
+
+/*
+ * Rebuild the map from the tree after a crash, or for a file from before
+ * the map: the header, the first map page and every page reachable from
+ * the root are in use, and the rest is free. The remaining map pages are
+ * allocated anew, so the old list past the first page is never trusted.
+ */
+static void file_rebuild_free_map(int fd, const HeaderPage* header_page,
+		TableSpace* space) {
+	MSG("file_rebuild_free_map().\n");
+	struct stat st;
+	pagenum_t num_of_pages = GET_HEADER_NUM_OF_PAGES(header_page);
+	pagenum_t first = GET_HEADER_FREE_MAP_PAGE_NO(header_page);
+	std::vector<pagenum_t> stack;
+	Page page;
+
+	/** The file may have grown after the header was last written. */
+	if (fstat(fd, &st) == 0)
+		num_of_pages = std::max<pagenum_t>(num_of_pages, st.st_size / PG_SIZE);
+
+	space->map = FreeSpaceMap(num_of_pages);
+	space->map.set_used(0);
+	if (first != 0 && first < num_of_pages)
+		space->map.set_used(first);
+
+	if (GET_HEADER_ROOT_PAGE_NO(header_page) != 0)
+		stack.push_back(GET_HEADER_ROOT_PAGE_NO(header_page));
+	while (!stack.empty()) {
+		pagenum_t pagenum = stack.back();
+		stack.pop_back();
+		if (pagenum == 0 || pagenum >= num_of_pages ||
+				space->map.is_used(pagenum)) {
+			MSG("bad page ", pagenum, " in the tree.\n");
+			continue;
+		}
+		space->map.set_used(pagenum);
+
+		file_read_page_internal(fd, pagenum * PG_SIZE, &page);
+		if (GET_IS_LEAF(&page))
+			continue;
+		const InternalPage* internal = reinterpret_cast<InternalPage*>(&page);
+		uint32_t num_keys = std::min<uint32_t>(GET_NUM_KEYS(internal),
+				INTERNAL_ORDER - 1);
+		for (uint32_t i = 0; i <= num_keys; ++i)
+			stack.push_back(INTERNAL_VAL(internal, i));
 	}
 
-	ret_page_no = num_of_pages;
+	if (first == 0 || first >= num_of_pages || !space->map.is_used(first)) {
+		first = space->map.find_free(1);
+		assert(first != 0);
+		space->map.set_used(first);
+	}
+	space->map_pages.assign(1, first);
+	space->dirty.assign(1, 1);
+	file_add_map_pages(space);
+	std::fill(space->dirty.begin(), space->dirty.end(), 1);
+	space->clean_on_disk = false;
+}
 
-	SET_HEADER_FREE_PAGE_NO(header_page, num_of_pages + 1);
-	SET_HEADER_NUM_OF_PAGES(header_page, num_of_pages * 2);
+/*
+ * Load the free-space map of an opened file. A map that was not saved
+ * clean, or a file without one, is rebuilt and saved; the header is
+ * written if it did not point to the map yet.
+ */
+static void file_load_free_map(int fd, HeaderPage* header_page,
+		TableSpace* space) {
+	pagenum_t first = GET_HEADER_FREE_MAP_PAGE_NO(header_page);
+	FreeMapPage map_page;
+	pagenum_t num_of_pages;
+	size_t need, k;
+
+	space->cursor = 1;
+	if (first == 0) {
+		file_rebuild_free_map(fd, header_page, space);
+		file_save_free_map(fd, space, true);
+
+		SET_HEADER_FREE_PAGE_NO(header_page, 0);
+		SET_HEADER_NUM_OF_PAGES(header_page, space->map.size());
+		SET_HEADER_HIGH_WATER_MARK(header_page, space->map.size());
+		SET_HEADER_FREE_MAP_PAGE_NO(header_page, space->map_pages[0]);
+		file_write_page_internal(fd, 0, reinterpret_cast<Page*>(header_page));
+		file_sync_internal(fd);
+		return;
+	}
 
-	file_write_page_internal(fd, 0, reinterpret_cast<Page*>(header_page));
+	file_read_page_internal(fd, first * PG_SIZE,
+			reinterpret_cast<Page*>(&map_page));
+	num_of_pages = map_page.num_of_pages;
+	if (map_page.clean != 1 || num_of_pages == 0) {
+		file_rebuild_free_map(fd, header_page, space);
+		file_save_free_map(fd, space, true);
+		return;
+	}
 
-	return ret_page_no;
+	space->map = FreeSpaceMap(num_of_pages);
+	space->map_pages.clear();
+	need = (num_of_pages + FREE_MAP_BITS - 1) / FREE_MAP_BITS;
+	for (k = 0; ; ++k) {
+		size_t first_word = k * FREE_MAP_WORDS;
+		space->map_pages.push_back(first);
+		space->map.load_words(first_word, map_page.bits, std::min(
+					FREE_MAP_WORDS, space->map.num_words() - first_word));
+		first = map_page.next_map_page_no;
+		if (k + 1 == need || first == 0 || first >= num_of_pages)
+			break;
+		file_read_page_internal(fd, first * PG_SIZE,
+				reinterpret_cast<Page*>(&map_page));
+	}
+	if (k + 1 != need) {
+		MSG("free-space map is too short.\n");
+		file_rebuild_free_map(fd, header_page, space);
+		file_save_free_map(fd, space, true);
+		return;
+	}
+	space->dirty.assign(need, 0);
+	space->clean_on_disk = true;
+}
+
+/*
+ * Write the dirty map pages, the first one last. With clean, the file is
+ * synced first so that the map never gets ahead of the pages it describes.
+ */
+static void file_save_free_map(int fd, TableSpace* space, bool clean) {
+	FreeMapPage map_page;
+	size_t num_words = space->map.num_words();
+
+	for (size_t k = space->map_pages.size(); k-- > 0; ) {
+		if (k != 0 && !space->dirty[k])
+			continue;
+		if (k == 0 && clean)
+			file_sync_internal(fd);
+
+		size_t first_word = k * FREE_MAP_WORDS;
+		size_t count = std::min(FREE_MAP_WORDS, num_words - first_word);
+		memset(&map_page, 0x00, sizeof(FreeMapPage));
+		map_page.next_map_page_no = k + 1 < space->map_pages.size() ?
+			space->map_pages[k + 1] : 0;
+		if (k == 0) {
+			map_page.num_of_pages = space->map.size();
+			map_page.clean = clean ? 1 : 0;
+		}
+		memcpy(map_page.bits, space->map.words() + first_word,
+				count * sizeof(uint64_t));
+		file_write_page_internal(fd, space->map_pages[k] * PG_SIZE,
+				reinterpret_cast<Page*>(&map_page));
+		space->dirty[k] = 0;
+	}
+	file_sync_internal(fd);
+	space->clean_on_disk = clean;
 }
 
 /** Disk Manager APIs */
-int open_disk_manager(){
+int open_disk_manager(SyncMode mode, IoBackendType backend, bool direct){
 	if (disk_manager != nullptr)
 		return -1;
+	sync_mode = mode;
+	direct_io = direct;
+	io_backend = make_io_backend(backend);
 	disk_manager = std::make_unique<DiskManager>();
 	if (disk_manager == nullptr)
 		return -1;
@@ -178,74 +592,183 @@ int close_disk_manager() {
 		return -1;
 	disk_manager->close_table_files();
 	disk_manager = nullptr;
+	io_backend = nullptr;
 	return 0;
 }
 
+const char* file_io_backend_name() {
+	return io_backend->name();
+}
+
+int file_register_buffer(void* base, size_t len) {
+	if (io_backend == nullptr)
+		return -1;
+	return io_backend->register_buffer(base, len);
+}
+
+void file_unregister_buffer() {
+	if (io_backend != nullptr)
+		io_backend->unregister_buffer();
+}
+
+/**
+ * open(2) with O_DIRECT under direct_io, or without it if the file system
+ * refuses it (EINVAL). With O_CREAT, the file may already have been created
+ * by the refused call.
+ */
+static int file_open_fd(const char* pathname, int flags) {
+	int fd;
+
+	if (direct_io) {
+		fd = open(pathname, flags|O_DIRECT, S_IRUSR|S_IWUSR);
+		if (fd >= 0 || errno != EINVAL)
+			return fd;
+		/** Keep going with the page cache. */
+		MSG("O_DIRECT is not supported. Use buffered I/O.\n");
+	}
+	return open(pathname, flags, S_IRUSR|S_IWUSR);
+}
+
 /** Open the table file with the given pathname. */
 int64_t file_open_table_file(const char* pathname) {
-
-	int fd = open(pathname, O_RDWR);
+	int fd = file_open_fd(pathname, O_RDWR);
 	int64_t ret_table_id;
+	HeaderPage header_page;
+	auto space = std::make_unique<TableSpace>();
 	if (fd < 0) {
 		// Create new file with a default size
-		fd = open(pathname, O_CREAT|O_RDWR, S_IRUSR|S_IWUSR);
-		// # Pages=2560 : Header Page (1) + Free Page (2559) 
+		fd = file_open_fd(pathname, O_RDWR|O_CREAT);
+		// # Pages=2560 : Header Page (1) + Map Page (1) + Free Page (2558)
 		if (fd < 0)
 			return -1;
 
-		HeaderPage header_page;
-		FreePage free_page;
 		memset(&header_page, 0x00, sizeof(HeaderPage));
-		memset(&free_page, 0x00, sizeof(FreePage));
 
+		/** Free pages are never written; the map is saved before the header. */
+		file_reserve_pages(fd, 0, DEFAULT_NUM_OF_PAGES);
 		init_header_page(&header_page);
-		file_write_page_internal(fd, 0, reinterpret_cast<Page*>(&header_page));
 
-		for (int i = 1; i < DEFAULT_NUM_OF_PAGES; ++i) {
-			if (i == DEFAULT_NUM_OF_PAGES - 1)
-				SET_FREE_NEXT_PAGE_NO(&free_page, 0);
-			else
-				SET_FREE_NEXT_PAGE_NO(&free_page, i + 1);
-			file_write_page_internal(
-					fd, i * PG_SIZE, reinterpret_cast<Page*>(&free_page));
-		}
-	} 
+		space->map = FreeSpaceMap(DEFAULT_NUM_OF_PAGES);
+		space->map.set_used(0);
+		space->map.set_used(GET_HEADER_FREE_MAP_PAGE_NO(&header_page));
+		space->map_pages.assign(1, GET_HEADER_FREE_MAP_PAGE_NO(&header_page));
+		space->dirty.assign(1, 1);
+		space->cursor = 1;
+		file_save_free_map(fd, space.get(), true);
+
+		file_write_page_internal(fd, 0, reinterpret_cast<Page*>(&header_page));
+		file_sync_internal(fd);
+	} else {
+		file_read_page_internal(fd, 0, reinterpret_cast<Page*>(&header_page));
+		file_load_free_map(fd, &header_page, space.get());
+	}
 
 	ret_table_id = disk_manager->get_table_id(fd);
+	disk_manager->set_space(ret_table_id, std::move(space));
+	disk_manager->set_path(ret_table_id, pathname);
+	assert(ret_table_id >= 1);
+	return ret_table_id;
+}
+
+/** madvise(2) advice of the hint */
+static int file_advice(AccessHint hint) {
+	return hint == AccessHint::SEQUENTIAL ? MADV_SEQUENTIAL : MADV_RANDOM;
+}
+
+/*
+ * file_open_table_mmap()
+ * @param[in]		pathname	: table file to map
+ * @param[in]		hint			: expected access pattern
+ * @return : table id, or -1 on error
+ * Trailing bytes past the last whole page are not mapped.
+ */
+int64_t file_open_table_mmap(const char* pathname, AccessHint hint) {
+	struct stat st;
+	pagenum_t num_of_pages;
+	void* base;
+
+	int fd = open(pathname, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	if (fstat(fd, &st) != 0 || st.st_size < (off_t)PG_SIZE) {
+		close(fd);
+		return -1;
+	}
+
+	num_of_pages = st.st_size / PG_SIZE;
+	base = mmap(nullptr, num_of_pages * PG_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+	if (base == MAP_FAILED) {
+		MSG("mmap error.\n");
+		close(fd);
+		return -1;
+	}
+	madvise(base, num_of_pages * PG_SIZE, file_advice(hint));
+
+	int64_t ret_table_id = disk_manager->get_table_id(fd);
 	assert(ret_table_id >= 1);
+	disk_manager->set_mapping(ret_table_id, static_cast<const Page*>(base),
+			num_of_pages);
+	disk_manager->set_path(ret_table_id, pathname);
 	return ret_table_id;
 }
 
+std::string file_table_path(int64_t table_id) {
+	return disk_manager->get_path(table_id);
+}
+
+int file_advise_table(int64_t table_id, AccessHint hint) {
+	pagenum_t num_of_pages;
+	const Page* pages = disk_manager->get_mapping(table_id, &num_of_pages);
+	if (pages == nullptr)
+		return -1;
+	return madvise(const_cast<Page*>(pages), num_of_pages * PG_SIZE,
+			file_advice(hint));
+}
+
+const Page* file_mapped_pages(int64_t table_id, pagenum_t* num_of_pages) {
+	return disk_manager->get_mapping(table_id, num_of_pages);
+}
+
+/*
+ * file_num_pages()
+ * @param[in]		table_id : table id returned from open table
+ * @return : number of pages the file has room for
+ */
+pagenum_t file_num_pages(int64_t table_id) {
+	TableSpace* space = disk_manager->get_space(table_id);
+
+	std::lock_guard<std::mutex> lock(space->latch);
+	return space->map.size();
+}
+
 /*
  * file_alloc_page()
  * @param[in]		table_id : table id returned from open table
+ * @param[in]		hint		 : page to allocate next to, or 0
  * @return : free page number
+ * The first change after the map was saved clean marks it dirty on disk.
  */
-pagenum_t file_alloc_page(int64_t table_id) {
+pagenum_t file_alloc_page(int64_t table_id, pagenum_t hint) {
+	TableSpace* space = disk_manager->get_space(table_id);
+	int fd = disk_manager->get_fd(table_id);
 	pagenum_t ret_page_no;
-	HeaderPage header_page;
-	FreePage free_page;
-	int fd;
-	
-	fd = disk_manager->get_fd(table_id);
-	file_read_page_internal(fd, 0, reinterpret_cast<Page*>(&header_page));
-
-	if (GET_HEADER_FREE_PAGE_NO(&header_page) == 0) {
-		/** No free page. Expand current table file. */
-		ret_page_no = file_expand_file(fd, &header_page);
-	} else {
-		/** Return free page from the linked-list. */
-		ret_page_no = GET_HEADER_FREE_PAGE_NO(&header_page);
 
-		// Read Free page and modify free page no in the header page.
-		file_read_page_internal(fd, ret_page_no * PG_SIZE, 
-				reinterpret_cast<Page*>(&free_page));
-		SET_HEADER_FREE_PAGE_NO(&header_page, GET_FREE_NEXT_PAGE_NO(&free_page));
+	std::lock_guard<std::mutex> lock(space->latch);
+	if (space->clean_on_disk)
+		file_save_free_map(fd, space, false);
 
-		file_write_page_internal(fd, 0, reinterpret_cast<Page*>(&header_page));
+	ret_page_no = file_find_free(space, hint);
+	if (ret_page_no == 0) {
+		/** No free page. Expand current table file. */
+		file_expand_file(fd, space);
+		ret_page_no = file_find_free(space, hint);
 	}
 
 	assert(ret_page_no != 0);
+	space->map.set_used(ret_page_no);
+	space->dirty[ret_page_no / FREE_MAP_BITS] = 1;
+	if (hint == 0)
+		space->cursor = ret_page_no + 1;
 	return ret_page_no;
 }
 
@@ -256,54 +779,153 @@ pagenum_t file_alloc_page(int64_t table_id) {
  * return : void.
  */
 void file_free_page(int64_t table_id, pagenum_t pagenum) {
+	TableSpace* space = disk_manager->get_space(table_id);
 	int fd = disk_manager->get_fd(table_id);
 
-	HeaderPage header_page;
-	FreePage free_page;
+	std::lock_guard<std::mutex> lock(space->latch);
+	if (space->clean_on_disk)
+		file_save_free_map(fd, space, false);
 
-	file_read_page_internal(fd, 0, 
-			reinterpret_cast<Page*>(&header_page));
-	file_read_page_internal(fd, pagenum * PG_SIZE, 
-			reinterpret_cast<Page*>(&free_page));
+	space->map.set_free(pagenum);
+	space->dirty[pagenum / FREE_MAP_BITS] = 1;
+}
 
-	SET_FREE_NEXT_PAGE_NO(&free_page, GET_HEADER_FREE_PAGE_NO(&header_page));
-	SET_HEADER_FREE_PAGE_NO(&header_page, pagenum);
+/*
+ * file_read_page()
+ * @param[in]				table_id	: table id returned from open table
+ * @param[in]				pagenum		: page number to be read
+ * @param[in/out]		dest			: container for in-memory page
+ * return : 0, or -1 on a read error or a page past the end of the file
+ */
+int file_read_page(int64_t table_id, pagenum_t pagenum, Page* dest) {
+	int fd = disk_manager->get_fd(table_id);
+	off_t off = pagenum * PG_SIZE;
+	void* buf = file_needs_bounce(dest) ? file_bounce_page() : dest;
 
-	file_write_page_internal(fd, 0, 
-			reinterpret_cast<Page*>(&header_page));
-	file_write_page_internal(fd, pagenum * PG_SIZE, 
-			reinterpret_cast<Page*>(&free_page));
+	if (io_backend->read(fd, buf, PG_SIZE, off) != PG_SIZE) {
+		MSG("page read error.\n");
+		return -1;
+	}
+	if (buf != dest)
+		memcpy(dest, buf, PG_SIZE);
+	return 0;
 }
 
 /*
- * file_read_page()
+ * file_read_pages()
+ * @param[in]				table_id	: table id returned from open table
+ * @param[in]				pagenum		: page number of dests[0]
+ * @param[in/out]		dests			: in-memory pages of consecutive page numbers
+ * @param[in]				count			: number of pages
+ * return : void
+ */
+void file_read_pages(int64_t table_id, pagenum_t pagenum,
+		Page* const* dests, int count) {
+	int fd = disk_manager->get_fd(table_id);
+	file_read_pages_internal(fd, pagenum * PG_SIZE, dests, count);
+}
+
+/*
+ * file_read_page_async()
  * @param[in]				table_id	: table id returned from open table
  * @param[in]				pagenum		: page number to be read
  * @param[in/out]		dest			: container for in-memory page
+ * @param[in]				callback	: called with 0 once dest holds the page,
+ *													or with -1 on error
  * return : void
+ * The read is queued until file_submit().
  */
-void file_read_page(int64_t table_id, pagenum_t pagenum, Page* dest) {
+void file_read_page_async(int64_t table_id, pagenum_t pagenum, Page* dest,
+		std::function<void(int)> callback) {
 	int fd = disk_manager->get_fd(table_id);
-	off_t off = pagenum * PG_SIZE;
-	file_read_page_internal(fd, off, dest);
+	if (file_needs_bounce(dest)) {
+		/** The bounce page has to live until the read completes. */
+		Page* bounce = static_cast<Page*>(std::aligned_alloc(PG_SIZE, PG_SIZE));
+		assert(bounce != nullptr);
+		io_backend->read_async(fd, bounce, PG_SIZE, pagenum * PG_SIZE,
+				[=](ssize_t res) {
+					if (res == PG_SIZE)
+						memcpy(dest, bounce, PG_SIZE);
+					std::free(bounce);
+					callback(res == PG_SIZE ? 0 : -1);
+				});
+		return;
+	}
+	io_backend->read_async(fd, dest, PG_SIZE, pagenum * PG_SIZE,
+			[=](ssize_t res) {
+				callback(res == PG_SIZE ? 0 : -1);
+			});
+}
 
-	/** Set page number in in-memory structure. */
-	SET_PAGE_NO(dest, pagenum);
+// Send every queued asynchronous read to the device
+void file_submit() {
+	io_backend->submit();
 }
 
 /*
- * file_read_page()
+ * file_write_page()
  * @param[in]			table_id	: table id returned from open table
  * @param[in]			pagenum		: page number to be written
  * @param[in]			src				: in-memory page to be written
  * return : void
  */
-void file_write_page(int64_t table_id, pagenum_t pagenum, const Page* src) {
-	assert(pagenum == GET_PAGE_NO(src));
-
+void file_write_page(int64_t table_id, pagenum_t pagenum, const Page* src,
+		bool barrier) {
 	int fd = disk_manager->get_fd(table_id);
 	off_t off = pagenum * PG_SIZE;
 	file_write_page_internal(fd, off, src);
+	if (barrier || sync_mode == SyncMode::PER_WRITE)
+		file_sync_internal(fd);
+}
+
+/*
+ * file_write_batch()
+ * @param[in]			table_id	: table id returned from open table
+ * @param[in]			pagenums	: page numbers in ascending order
+ * @param[in]			srcs			: in-memory pages to be written
+ * @param[in]			count			: number of pages
+ * return : void
+ * Runs of consecutive page numbers go out in one pwritev(). Unless the mode
+ * is DEFERRED, the table is synced once at the end of the batch.
+ */
+void file_write_batch(int64_t table_id, const pagenum_t* pagenums,
+		const Page* const* srcs, int count) {
+	int fd = disk_manager->get_fd(table_id);
+	int i, j;
+
+	for (i = 0; i < count; i = j) {
+		for (j = i + 1; j < count && pagenums[j] == pagenums[i] + (j - i); ++j)
+			;
+		file_write_pages_internal(fd, pagenums[i] * PG_SIZE, srcs + i, j - i);
+	}
+	if (count > 0 && sync_mode != SyncMode::DEFERRED)
+		file_sync_internal(fd);
+}
+
+/*
+ * file_sync_table()
+ * @param[in]			table_id	: table id returned from open table
+ * return : 0 on success, -1 otherwise
+ */
+int file_sync_table(int64_t table_id) {
+	int fd = disk_manager->get_fd(table_id);
+	return io_backend->datasync(fd) == 0 ? 0 : -1;
+}
+
+/*
+ * file_checkpoint_table()
+ * @param[in]			table_id	: table id returned from open table
+ * return : 0 on success, -1 otherwise
+ */
+int file_checkpoint_table(int64_t table_id) {
+	TableSpace* space = disk_manager->get_space(table_id);
+	int fd = disk_manager->get_fd(table_id);
+
+	std::lock_guard<std::mutex> lock(space->latch);
+	if (space->clean_on_disk)
+		return file_sync_table(table_id);
+	file_save_free_map(fd, space, true);
+	return 0;
 }
 
 // Close the table files
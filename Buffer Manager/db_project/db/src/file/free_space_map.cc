@@ -0,0 +1,151 @@
+#include "free_space_map.h"
+
+#include <algorithm>
+#include <cassert>
+
+FreeSpaceMap::FreeSpaceMap(pagenum_t num_of_pages) {
+	this->num_of_pages = 0;
+	this->free_count = 0;
+	this->resize(num_of_pages);
+}
+
+void FreeSpaceMap::resize(pagenum_t num_of_pages) {
+	assert(num_of_pages >= this->num_of_pages);
+	size_t old_words = this->bits.size();
+	size_t new_words = (num_of_pages + 63) / 64;
+
+	this->bits.resize(new_words, ~0ULL);
+	this->has_free.resize((new_words + 63) / 64, 0);
+	this->has_free_unreserved.resize((new_words + 63) / 64, 0);
+	this->reserved.resize(new_words, 0);
+
+	/** Clear the bits of the new pages, including the padding of the old tail. */
+	for (pagenum_t pagenum = this->num_of_pages;
+			pagenum < std::min<pagenum_t>(num_of_pages, old_words * 64); ++pagenum)
+		this->bits[pagenum / 64] &= ~(1ULL << (pagenum % 64));
+	for (size_t w = old_words; w < new_words; ++w) {
+		pagenum_t end = std::min<pagenum_t>(num_of_pages, (w + 1) * 64);
+		this->bits[w] = (end - w * 64) == 64 ? 0 : ~0ULL << (end - w * 64);
+	}
+	for (size_t w = old_words == 0 ? 0 : old_words - 1; w < new_words; ++w)
+		this->update_summary(w);
+
+	this->free_count += num_of_pages - this->num_of_pages;
+	this->num_of_pages = num_of_pages;
+}
+
+void FreeSpaceMap::set_used(pagenum_t pagenum) {
+	assert(pagenum < this->num_of_pages && !this->is_used(pagenum));
+	this->bits[pagenum / 64] |= 1ULL << (pagenum % 64);
+	this->update_summary(pagenum / 64);
+	this->free_count--;
+}
+
+void FreeSpaceMap::set_free(pagenum_t pagenum) {
+	assert(pagenum < this->num_of_pages && this->is_used(pagenum));
+	this->bits[pagenum / 64] &= ~(1ULL << (pagenum % 64));
+	this->update_summary(pagenum / 64);
+	this->free_count++;
+}
+
+pagenum_t FreeSpaceMap::find_free(pagenum_t hint) const {
+	return this->find(this->has_free, hint);
+}
+
+pagenum_t FreeSpaceMap::find_free_unreserved(pagenum_t hint) const {
+	return this->find(this->has_free_unreserved, hint);
+}
+
+pagenum_t FreeSpaceMap::find_free_after(pagenum_t pagenum) const {
+	if (pagenum % 64 == 63 || pagenum >= this->num_of_pages)
+		return 0;
+	uint64_t word = ~this->bits[pagenum / 64] & (~0ULL << (pagenum % 64 + 1));
+	return word != 0 ? (pagenum / 64) * 64 + __builtin_ctzll(word) : 0;
+}
+
+pagenum_t FreeSpaceMap::reserve_extent(pagenum_t hint) {
+	size_t num_words = this->bits.size();
+	size_t start = hint < this->num_of_pages ? hint / 64 : 0;
+
+	for (size_t i = 0; i < num_words; ++i) {
+		size_t w = (start + i) % num_words;
+		if (this->bits[w] != 0 || this->reserved[w])
+			continue;
+		this->reserve(w * 64);
+		return w * 64;
+	}
+	return 0;
+}
+
+void FreeSpaceMap::reserve(pagenum_t pagenum) {
+	assert(pagenum < this->num_of_pages);
+	this->reserved[pagenum / EXTENT_PAGES] = 1;
+	this->update_summary(pagenum / EXTENT_PAGES);
+}
+
+/** Search the words whose bit is set in summary, from hint on. */
+pagenum_t FreeSpaceMap::find(const std::vector<uint64_t>& summary,
+		pagenum_t hint) const {
+	if (this->free_count == 0)
+		return 0;
+	if (hint >= this->num_of_pages)
+		hint = 0;
+
+	/** The rest of the hint's own word first. */
+	if ((summary[hint / 4096] >> (hint / 64 % 64)) & 1) {
+		uint64_t word = ~this->bits[hint / 64] & (~0ULL << (hint % 64));
+		if (word != 0)
+			return (hint / 64) * 64 + __builtin_ctzll(word);
+	}
+
+	pagenum_t ret = this->find_from(summary, hint / 64 + 1);
+	if (ret == 0)
+		ret = this->find_from(summary, 0);
+	return ret;
+}
+
+void FreeSpaceMap::load_words(size_t first, const uint64_t* src, size_t count) {
+	assert(first + count <= this->bits.size());
+	for (size_t i = 0; i < count; ++i) {
+		size_t w = first + i;
+		uint64_t word = src[i];
+		if (w == this->bits.size() - 1 && this->num_of_pages % 64 != 0)
+			word |= ~0ULL << (this->num_of_pages % 64);
+		this->free_count += __builtin_popcountll(this->bits[w]);
+		this->free_count -= __builtin_popcountll(word);
+		this->bits[w] = word;
+		this->update_summary(w);
+	}
+}
+
+void FreeSpaceMap::update_summary(size_t word) {
+	uint64_t bit = 1ULL << (word % 64);
+	if (this->bits[word] != ~0ULL)
+		this->has_free[word / 64] |= bit;
+	else
+		this->has_free[word / 64] &= ~bit;
+
+	if (this->bits[word] != ~0ULL && !this->reserved[word])
+		this->has_free_unreserved[word / 64] |= bit;
+	else
+		this->has_free_unreserved[word / 64] &= ~bit;
+}
+
+/** First free page in the summary's words [word, end), or 0. */
+pagenum_t FreeSpaceMap::find_from(const std::vector<uint64_t>& summary,
+		size_t word) const {
+	if (word >= this->bits.size())
+		return 0;
+
+	size_t s = word / 64;
+	uint64_t bits = summary[s] & (~0ULL << (word % 64));
+	for (;;) {
+		if (bits != 0) {
+			size_t w = s * 64 + __builtin_ctzll(bits);
+			return w * 64 + __builtin_ctzll(~this->bits[w]);
+		}
+		if (++s == summary.size())
+			return 0;
+		bits = summary[s];
+	}
+}
@@ -0,0 +1,541 @@
+#include "io_backend.h"
+#include "msg.h"
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** Ring size of the io_uring backend */
+constexpr unsigned URING_ENTRIES = 256;
+
+/*
+ * Synchronous POSIX calls. Async reads are handed at submit() to a reader
+ * thread, which runs them and their callbacks in order, so the submitter
+ * never waits for them.
+ */
+class PosixBackend : public IoBackend {
+	public:
+		PosixBackend();
+		~PosixBackend();
+
+		const char* name() const override { return "posix"; }
+
+		ssize_t read(int fd, void* buf, size_t len, off_t off) override {
+			return pread(fd, buf, len, off);
+		}
+		ssize_t write(int fd, const void* buf, size_t len, off_t off) override {
+			return pwrite(fd, buf, len, off);
+		}
+		ssize_t readv(int fd, const struct iovec* iov, int cnt, off_t off) override {
+			return preadv(fd, iov, cnt, off);
+		}
+		ssize_t writev(int fd, const struct iovec* iov, int cnt, off_t off) override {
+			return pwritev(fd, iov, cnt, off);
+		}
+		int datasync(int fd) override {
+			return fdatasync(fd);
+		}
+
+		void read_async(int fd, void* buf, size_t len, off_t off,
+				IoCallback callback) override;
+		void submit() override;
+
+	private:
+		struct Request {
+			int fd;
+			void* buf;
+			size_t len;
+			off_t off;
+			IoCallback callback;
+		};
+
+		void reader_main();
+
+		std::mutex latch;
+		std::vector<Request> queued;		// not submitted yet
+		std::deque<Request> submitted;		// for the reader
+		std::condition_variable submitted_cv;
+		bool reader_stop;
+		std::thread reader;
+};
+
+PosixBackend::PosixBackend() : reader_stop(false) {
+	this->reader = std::thread(&PosixBackend::reader_main, this);
+}
+
+/** The reader runs what was submitted before it stops. */
+PosixBackend::~PosixBackend() {
+	{
+		std::lock_guard<std::mutex> lock(this->latch);
+		this->reader_stop = true;
+	}
+	this->submitted_cv.notify_one();
+	this->reader.join();
+}
+
+void PosixBackend::read_async(int fd, void* buf, size_t len, off_t off,
+		IoCallback callback) {
+	std::lock_guard<std::mutex> lock(this->latch);
+	this->queued.push_back({ fd, buf, len, off, std::move(callback) });
+}
+
+void PosixBackend::submit() {
+	{
+		std::lock_guard<std::mutex> lock(this->latch);
+		if (this->queued.empty())
+			return;
+		for (auto& r : this->queued)
+			this->submitted.push_back(std::move(r));
+		this->queued.clear();
+	}
+	this->submitted_cv.notify_one();
+}
+
+void PosixBackend::reader_main() {
+	std::deque<Request> requests;
+	ssize_t ret;
+
+	std::unique_lock<std::mutex> lock(this->latch);
+	for (;;) {
+		this->submitted_cv.wait(lock, [this] {
+			return !this->submitted.empty() || this->reader_stop;
+		});
+		if (this->submitted.empty())
+			return;
+		requests.swap(this->submitted);
+		lock.unlock();
+
+		for (auto& r : requests) {
+			ret = pread(r.fd, r.buf, r.len, r.off);
+			r.callback(ret < 0 ? -errno : ret);
+		}
+		requests.clear();
+		lock.lock();
+	}
+}
+
+/*
+ * io_uring through the raw system calls.
+ * Submitters fill SQEs under sq_latch. A reaper thread is the only one
+ * that reads the completion ring: it wakes synchronous waiters directly
+ * and hands async callbacks to a callback thread, so a callback that
+ * blocks (e.g. on the buffer pool latch) never stalls other completions.
+ * The user_data of an SQE is its Request; 0 marks the shutdown NOP.
+ */
+class UringBackend : public IoBackend {
+	public:
+		UringBackend();
+		~UringBackend();
+
+		int init(unsigned entries);
+
+		const char* name() const override { return "io_uring"; }
+
+		ssize_t read(int fd, void* buf, size_t len, off_t off) override;
+		ssize_t write(int fd, const void* buf, size_t len, off_t off) override;
+		ssize_t readv(int fd, const struct iovec* iov, int cnt, off_t off) override;
+		ssize_t writev(int fd, const struct iovec* iov, int cnt, off_t off) override;
+		int datasync(int fd) override;
+
+		void read_async(int fd, void* buf, size_t len, off_t off,
+				IoCallback callback) override;
+		void submit() override;
+
+		int register_buffer(void* base, size_t len) override;
+		void unregister_buffer() override;
+
+	private:
+		struct Request {
+			IoCallback callback;	// async requests only
+			std::mutex latch;
+			std::condition_variable done_cv;
+			bool done;
+			ssize_t res;
+		};
+
+		using Prep = std::function<void(struct io_uring_sqe*)>;
+
+		ssize_t run_sync(const Prep& prep);
+		void push(const Prep& prep, uint64_t user_data,
+				std::unique_lock<std::mutex>& lock);
+		void flush_queued();
+		bool is_registered(const void* buf, size_t len) const;
+		void reap_main();
+		void callback_main();
+
+		int ring_fd;
+		unsigned sq_entries;
+		unsigned cq_entries;
+
+		void* sq_ptr;
+		void* cq_ptr;
+		size_t sq_ring_size;
+		size_t cq_ring_size;
+		struct io_uring_sqe* sqes;
+
+		unsigned* sq_head;
+		unsigned* sq_tail;
+		unsigned* sq_mask;
+		unsigned* sq_array;
+		unsigned* cq_head;
+		unsigned* cq_tail;
+		unsigned* cq_mask;
+		struct io_uring_cqe* cqes;
+
+		std::mutex sq_latch;
+		std::condition_variable inflight_cv;
+		unsigned queued;
+		unsigned inflight;
+
+		char* reg_base;
+		size_t reg_len;
+
+		std::thread reaper;
+		std::thread callback_thread;
+		std::mutex callback_latch;
+		std::condition_variable callback_cv;
+		std::deque<std::pair<Request*, ssize_t>> completed;
+		bool callback_stop;
+};
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params* p) {
+	return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit,
+		unsigned min_complete, unsigned flags) {
+	return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+			flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode,
+		void* arg, unsigned nr_args) {
+	return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+UringBackend::UringBackend()
+	: ring_fd(-1), sq_entries(0), cq_entries(0),
+	sq_ptr(MAP_FAILED), cq_ptr(MAP_FAILED), sq_ring_size(0), cq_ring_size(0),
+	sqes((struct io_uring_sqe*)MAP_FAILED), queued(0), inflight(0),
+	reg_base(nullptr), reg_len(0), callback_stop(false) {}
+
+UringBackend::~UringBackend() {
+	if (this->reaper.joinable()) {
+		std::unique_lock<std::mutex> lock(this->sq_latch);
+		this->push([](struct io_uring_sqe* sqe) {
+			sqe->opcode = IORING_OP_NOP;
+		}, 0, lock);
+		this->flush_queued();
+		lock.unlock();
+		this->reaper.join();
+	}
+	if (this->callback_thread.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(this->callback_latch);
+			this->callback_stop = true;
+		}
+		this->callback_cv.notify_one();
+		this->callback_thread.join();
+	}
+
+	if (this->sqes != MAP_FAILED)
+		munmap(this->sqes, this->sq_entries * sizeof(struct io_uring_sqe));
+	if (this->cq_ptr != MAP_FAILED && this->cq_ptr != this->sq_ptr)
+		munmap(this->cq_ptr, this->cq_ring_size);
+	if (this->sq_ptr != MAP_FAILED)
+		munmap(this->sq_ptr, this->sq_ring_size);
+	if (this->ring_fd >= 0)
+		close(this->ring_fd);
+}
+
+/** Set up and map the rings. Return -1 if io_uring is not available. */
+int UringBackend::init(unsigned entries) {
+	struct io_uring_params p;
+	char* sq;
+	char* cq;
+
+	memset(&p, 0x00, sizeof(p));
+	this->ring_fd = sys_io_uring_setup(entries, &p);
+	if (this->ring_fd < 0)
+		return -1;
+
+	this->sq_entries = p.sq_entries;
+	this->cq_entries = p.cq_entries;
+	this->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	this->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		this->sq_ring_size = std::max(this->sq_ring_size, this->cq_ring_size);
+		this->cq_ring_size = this->sq_ring_size;
+	}
+
+	this->sq_ptr = mmap(NULL, this->sq_ring_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, this->ring_fd, IORING_OFF_SQ_RING);
+	if (this->sq_ptr == MAP_FAILED)
+		return -1;
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		this->cq_ptr = this->sq_ptr;
+	} else {
+		this->cq_ptr = mmap(NULL, this->cq_ring_size, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE, this->ring_fd, IORING_OFF_CQ_RING);
+		if (this->cq_ptr == MAP_FAILED)
+			return -1;
+	}
+	this->sqes = (struct io_uring_sqe*)mmap(NULL,
+			p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, this->ring_fd, IORING_OFF_SQES);
+	if (this->sqes == MAP_FAILED)
+		return -1;
+
+	sq = (char*)this->sq_ptr;
+	cq = (char*)this->cq_ptr;
+	this->sq_head = (unsigned*)(sq + p.sq_off.head);
+	this->sq_tail = (unsigned*)(sq + p.sq_off.tail);
+	this->sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+	this->sq_array = (unsigned*)(sq + p.sq_off.array);
+	this->cq_head = (unsigned*)(cq + p.cq_off.head);
+	this->cq_tail = (unsigned*)(cq + p.cq_off.tail);
+	this->cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+	this->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+
+	this->reaper = std::thread(&UringBackend::reap_main, this);
+	this->callback_thread = std::thread(&UringBackend::callback_main, this);
+	return 0;
+}
+
+/*
+ * Fill one SQE. Requests in flight are bounded by the CQ size so that
+ * completions are never dropped; queued ones are flushed before waiting.
+ */
+void UringBackend::push(const Prep& prep, uint64_t user_data,
+		std::unique_lock<std::mutex>& lock) {
+	unsigned tail, head, index;
+	struct io_uring_sqe* sqe;
+
+	while (this->inflight >= this->cq_entries) {
+		this->flush_queued();
+		this->inflight_cv.wait(lock);
+	}
+
+	tail = *this->sq_tail;
+	head = __atomic_load_n(this->sq_head, __ATOMIC_ACQUIRE);
+	if (tail - head >= this->sq_entries) {
+		this->flush_queued();
+		head = __atomic_load_n(this->sq_head, __ATOMIC_ACQUIRE);
+	}
+
+	index = tail & *this->sq_mask;
+	sqe = &this->sqes[index];
+	memset(sqe, 0x00, sizeof(*sqe));
+	prep(sqe);
+	sqe->user_data = user_data;
+	this->sq_array[index] = index;
+	__atomic_store_n(this->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+	this->queued++;
+	this->inflight++;
+}
+
+/** Hand every filled SQE to the kernel. Call with sq_latch held. */
+void UringBackend::flush_queued() {
+	int ret;
+	while (this->queued > 0) {
+		ret = sys_io_uring_enter(this->ring_fd, this->queued, 0, 0);
+		if (ret < 0) {
+			if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+				continue;
+			MSG("io_uring_enter error.");
+			exit(0);
+		}
+		this->queued -= ret;
+	}
+}
+
+ssize_t UringBackend::run_sync(const Prep& prep) {
+	Request r;
+	r.done = false;
+	r.res = 0;
+	{
+		std::unique_lock<std::mutex> lock(this->sq_latch);
+		this->push(prep, (uint64_t)&r, lock);
+		this->flush_queued();
+	}
+	std::unique_lock<std::mutex> lock(r.latch);
+	r.done_cv.wait(lock, [&r]{ return r.done; });
+	return r.res;
+}
+
+bool UringBackend::is_registered(const void* buf, size_t len) const {
+	const char* p = (const char*)buf;
+	return this->reg_base != nullptr &&
+		p >= this->reg_base && p + len <= this->reg_base + this->reg_len;
+}
+
+ssize_t UringBackend::read(int fd, void* buf, size_t len, off_t off) {
+	bool fixed = this->is_registered(buf, len);
+	return this->run_sync([=](struct io_uring_sqe* sqe) {
+		sqe->opcode = fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+		sqe->fd = fd;
+		sqe->addr = (uint64_t)buf;
+		sqe->len = len;
+		sqe->off = off;
+	});
+}
+
+ssize_t UringBackend::write(int fd, const void* buf, size_t len, off_t off) {
+	bool fixed = this->is_registered(buf, len);
+	return this->run_sync([=](struct io_uring_sqe* sqe) {
+		sqe->opcode = fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+		sqe->fd = fd;
+		sqe->addr = (uint64_t)buf;
+		sqe->len = len;
+		sqe->off = off;
+	});
+}
+
+ssize_t UringBackend::readv(int fd, const struct iovec* iov, int cnt, off_t off) {
+	return this->run_sync([=](struct io_uring_sqe* sqe) {
+		sqe->opcode = IORING_OP_READV;
+		sqe->fd = fd;
+		sqe->addr = (uint64_t)iov;
+		sqe->len = cnt;
+		sqe->off = off;
+	});
+}
+
+ssize_t UringBackend::writev(int fd, const struct iovec* iov, int cnt, off_t off) {
+	return this->run_sync([=](struct io_uring_sqe* sqe) {
+		sqe->opcode = IORING_OP_WRITEV;
+		sqe->fd = fd;
+		sqe->addr = (uint64_t)iov;
+		sqe->len = cnt;
+		sqe->off = off;
+	});
+}
+
+int UringBackend::datasync(int fd) {
+	ssize_t ret = this->run_sync([=](struct io_uring_sqe* sqe) {
+		sqe->opcode = IORING_OP_FSYNC;
+		sqe->fd = fd;
+		sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+	});
+	return ret == 0 ? 0 : -1;
+}
+
+void UringBackend::read_async(int fd, void* buf, size_t len, off_t off,
+		IoCallback callback) {
+	bool fixed = this->is_registered(buf, len);
+	Request* r = new Request();
+	r->callback = std::move(callback);
+
+	std::unique_lock<std::mutex> lock(this->sq_latch);
+	this->push([=](struct io_uring_sqe* sqe) {
+		sqe->opcode = fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+		sqe->fd = fd;
+		sqe->addr = (uint64_t)buf;
+		sqe->len = len;
+		sqe->off = off;
+	}, (uint64_t)r, lock);
+}
+
+void UringBackend::submit() {
+	std::lock_guard<std::mutex> lock(this->sq_latch);
+	this->flush_queued();
+}
+
+/** Register one fixed buffer. Fails (harmlessly) under a low memlock limit. */
+int UringBackend::register_buffer(void* base, size_t len) {
+	struct iovec iov = { base, len };
+
+	this->unregister_buffer();
+	if (sys_io_uring_register(this->ring_fd, IORING_REGISTER_BUFFERS, &iov, 1) < 0)
+		return -1;
+	this->reg_base = (char*)base;
+	this->reg_len = len;
+	return 0;
+}
+
+void UringBackend::unregister_buffer() {
+	if (this->reg_base == nullptr)
+		return;
+	sys_io_uring_register(this->ring_fd, IORING_UNREGISTER_BUFFERS, NULL, 0);
+	this->reg_base = nullptr;
+	this->reg_len = 0;
+}
+
+void UringBackend::reap_main() {
+	unsigned head, tail, n;
+	bool stop = false;
+	struct io_uring_cqe* cqe;
+	Request* r;
+
+	while (!stop) {
+		if (sys_io_uring_enter(this->ring_fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 &&
+				errno != EINTR) {
+			MSG("io_uring_enter error.");
+			exit(0);
+		}
+
+		head = *this->cq_head;
+		tail = __atomic_load_n(this->cq_tail, __ATOMIC_ACQUIRE);
+		for (n = 0; head != tail; ++head, ++n) {
+			cqe = &this->cqes[head & *this->cq_mask];
+			r = (Request*)cqe->user_data;
+			if (r == nullptr) {
+				stop = true;
+			} else if (r->callback) {
+				std::lock_guard<std::mutex> lock(this->callback_latch);
+				this->completed.emplace_back(r, cqe->res);
+				this->callback_cv.notify_one();
+			} else {
+				std::lock_guard<std::mutex> lock(r->latch);
+				r->res = cqe->res;
+				r->done = true;
+				r->done_cv.notify_one();
+			}
+		}
+		__atomic_store_n(this->cq_head, head, __ATOMIC_RELEASE);
+
+		if (n > 0) {
+			std::lock_guard<std::mutex> lock(this->sq_latch);
+			this->inflight -= n;
+			this->inflight_cv.notify_all();
+		}
+	}
+}
+
+void UringBackend::callback_main() {
+	std::unique_lock<std::mutex> lock(this->callback_latch);
+	while (true) {
+		this->callback_cv.wait(lock, [this]{
+			return this->callback_stop || !this->completed.empty();
+		});
+		if (this->completed.empty())
+			break;
+
+		auto c = this->completed.front();
+		this->completed.pop_front();
+		lock.unlock();
+		c.first->callback(c.second);
+		delete c.first;
+		lock.lock();
+	}
+}
+
+std::unique_ptr<IoBackend> make_io_backend(IoBackendType type) {
+	if (type == IoBackendType::IO_URING) {
+		auto uring = std::make_unique<UringBackend>();
+		if (uring->init(URING_ENTRIES) == 0)
+			return uring;
+		MSG("io_uring is not available, using posix I/O.\n");
+	}
+	return std::make_unique<PosixBackend>();
+}
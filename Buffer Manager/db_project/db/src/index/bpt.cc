@@ -3,8 +3,11 @@
 #include "bpt.h"
 #include "msg.h"
 #include "buffer.h"
+#include "page_search.h"
 
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <iostream>
 #include <cstring>
 #include <string>
@@ -25,104 +28,184 @@ static constexpr int I_MAX_KEYS = 64;
 static_assert(I_THRES == (PG_SIZE - PG_HEADER_SIZE) / 2);
 static_assert(INIT_FREESPACE == (PG_SIZE - PG_HEADER_SIZE));
 
+/*
+ * Concurrency.
+ * Readers go down the tree without latching the internal pages: each page
+ * is pinned OPTIMISTIC, and what was read from it is only used once its
+ * version is validated. The leaf is then latched SHARED (find) or
+ * EXCLUSIVE (insert, delete); a changed page restarts the descent from
+ * the header.
+ * An insert or delete that stays within its leaf changes nothing else and
+ * needs no more. Anything that splits, merges or redistributes pages runs
+ * under the table's SMO latch, one at a time per table, and latches every
+ * page it changes EXCLUSIVE.
+ * Pages are B-link nodes (see page.h): a split is whole once the new page
+ * is linked right of the old one, and the parent is updated after both are
+ * let go; a reader that was sent to the old page moves right. Merges and
+ * redistributions, which move keys left, latch the parent before they let
+ * go of the children, so a reader that went past the parent before the
+ * change fails the parent's validation.
+ */
+static constexpr int NUM_SMO_LATCHES = 64;
+static std::mutex smo_latches[NUM_SMO_LATCHES];
+
+static size_t table_stripe(int64_t tid) {
+	return (uint64_t)tid % NUM_SMO_LATCHES;
+}
+
+static std::mutex& smo_latch(int64_t tid) {
+	return smo_latches[table_stripe(tid)];
+}
+
+/*
+ * Rightmost leaf, per stripe of tables. Keys that only go up (auto
+ * increments) all land in the last leaf, so an insert of a key above its
+ * last one goes there without a descent.
+ * A remembered leaf is good as long as no page of the stripe's tables has
+ * been freed since: page_frees goes up, while the page is still latched,
+ * before every free. A live leaf without a sibling is the last one.
+ * last_key only filters keys that cannot go there before the leaf is pinned.
+ */
+struct RightmostLeaf {
+	std::mutex latch;
+	int64_t table_id;
+	pagenum_t page_no;	// 0 if none
+	uint64_t page_frees;	// page_frees of the stripe when remembered
+	int64_t last_key;	// last key of the leaf when last latched
+};
+static RightmostLeaf rightmost_leaves[NUM_SMO_LATCHES];
+static std::atomic<uint64_t> page_frees[NUM_SMO_LATCHES];
+
+/*
+ * Internal pages on the way from the root to a leaf, root first, pinned
+ * OPTIMISTIC by the descent. Under the SMO latch nothing else changes
+ * internal pages, so a path that validates is exact: the last page is the
+ * leaf's parent, and splits and merges go up along it without pinning the
+ * parents or the header again.
+ */
+using PagePath = vector<PageGuard>;
+
 /** static function decl */
-static void print_page(
-		const std::shared_ptr<Page>& page);
-static void print_leaf_page(
-		const std::shared_ptr<LeafPage>& p);
-static void print_internal_page(
-		const std::shared_ptr<InternalPage>& p);
+static void print_page(pagenum_t page_no, const Page* page);
+static void print_leaf_page(pagenum_t page_no, const LeafPage* p);
+static void print_internal_page(pagenum_t page_no, const InternalPage* p);
 
-static bool find_leaf(int64_t tid, int64_t key, 
-		const std::shared_ptr<LeafPage>& leaf_page);
+static int child_index(const InternalPage* internal_page, int64_t key);
+static int slot_index(const LeafPage* leaf_page, int64_t key);
+static pagenum_t move_right(const Page* page, int64_t key);
+static int find_leaf(int64_t tid, int64_t key, PageGuard& leaf,
+		LatchMode mode, PagePath* path = nullptr);
 
-static bool find_key(int64_t tid, int64_t key, 
+static int find_key(int64_t tid, int64_t key, 
 		char* ret_val, uint16_t* size,
-		const std::shared_ptr<LeafPage>& leaf_page);
+		PageGuard& leaf, LatchMode mode, PagePath* path = nullptr);
+
+static bool validate_path(const PagePath& path);
 
-static void start_new_tree(int64_t tid, int64_t key,
+static void latch_parent(PageGuard& parent);
+
+static int start_new_tree(int64_t tid, int64_t key,
 		char* val, uint16_t size,
-		const std::shared_ptr<HeaderPage>& head_page,
-		const std::shared_ptr<LeafPage>& leaf_page);
+		PageGuard& head);
+
+static void remember_rightmost(int64_t tid, const PageGuard& leaf);
+
+static void free_tree_page(int64_t tid, const PageGuard& page);
 
-static void insert_into_leaf(int64_t tid, int64_t key,
+static int insert_rightmost(int64_t tid, int64_t key,
+		char* val, uint16_t size);
+
+static void insert_into_leaf(int64_t key,
 		char* val, uint16_t size,
-		const std::shared_ptr<LeafPage>& leaf_page);
+		PageGuard& leaf);
 
-static void insert_into_leaf_after_splitting(
+static int insert_into_leaf_after_splitting(
 		int64_t tid, int64_t key,
 		char* val, uint16_t size,
-		const std::shared_ptr<LeafPage>& leaf_page);
+		PageGuard& leaf, PagePath& path);
 
 static int cut_internal(int length);
 
-static int cut_leaf(const std::shared_ptr<LeafPage>& leaf_page);
+static int cut_leaf(const LeafPage* leaf_page);
 
 static void leaf_page_splitting_internal(
-		const std::shared_ptr<LeafPage>& leaf_page,
-		const std::shared_ptr<LeafPage>& new_leaf_page,
+		LeafPage* leaf_page, LeafPage* new_leaf_page,
+		pagenum_t new_leaf_page_no,
 		int split, int insertion_index,
 		int64_t i_key, char* i_val, uint16_t i_size);
 
-static void insert_into_parent(
-		const std::shared_ptr<Page>& left,
-		const std::shared_ptr<Page>& right,
-		int64_t key, int64_t tid);
+static int insert_into_parent(
+		PageGuard& left, PageGuard& right,
+		int64_t key, int64_t tid, PagePath& path);
 
-static void insert_into_new_root(
-		const std::shared_ptr<Page>& left,
-		const std::shared_ptr<Page>& right,
+static int insert_into_new_root(
+		PageGuard& left, PageGuard& right,
 		int64_t key, int64_t tid);
 
-static int get_left_index(
-		const std::shared_ptr<InternalPage>& parent,
-		pagenum_t left_page_no);
-
 static void insert_into_internal(
-		const std::shared_ptr<InternalPage>& page,
+		InternalPage* page,
 		int left_index, int64_t key, pagenum_t right_page_no);
 
-static void insert_into_internal_after_splitting(
-		const std::shared_ptr<InternalPage>& page,
+static int insert_into_internal_after_splitting(
+		PageGuard& old,
 		int left_index, int64_t key, pagenum_t right_page_no,
-		int64_t tid);
+		int64_t tid, PagePath& path);
 
-static void delete_entry(
-		const std::shared_ptr<Page>& page,
-		int64_t tid, int64_t key);
+static int delete_entry(
+		PageGuard& page,
+		int64_t tid, int64_t key, PagePath& path);
 
 static void remove_entry_from_page(
-		const std::shared_ptr<Page>& page,
-		int64_t tid, int64_t key);
+		PageGuard& page, int64_t key);
 
-static void adjust_root(
-		const std::shared_ptr<HeaderPage>& head_page,
-		const std::shared_ptr<Page>& page,
+static int adjust_root(
+		PageGuard& page,
 		int64_t tid);
 
-static bool delete_done(
-		const std::shared_ptr<Page>& page);
+static bool delete_done(const Page* page);
+
+static bool delete_stays_in_leaf(const LeafPage* leaf_page, uint16_t size);
 
 static int get_neighbor_index(
-		const std::shared_ptr<Page>& page,
-		const std::shared_ptr<InternalPage>& parent_page,
-		int64_t tid);
+		const PageGuard& page,
+		const PageGuard& parent);
+
+static int merge_pages(
+		PageGuard& page,
+		PageGuard& neighbor,
+		PageGuard& parent,
+		int neighbor_index, int64_t k_prime, int64_t tid, PagePath& path);
+
+static int redistribute_pages(
+		PageGuard& page,
+		PageGuard& neighbor,
+		PageGuard& parent,
+		int neighbor_index, int k_prime_index, int64_t k_prime, int64_t tid);
+
+struct BulkLevel;
+
+static int bulk_new_page(int64_t tid, pagenum_t hint, bool is_leaf,
+		PageGuard& page);
+
+static int bulk_add_child(int64_t tid, vector<BulkLevel>& levels,
+		size_t level, int64_t key, PageGuard& child);
 
-static void merge_pages(
-		const std::shared_ptr<Page>& page,
-		const std::shared_ptr<Page>& neighbor_page,
-		int neighbor_index, int64_t k_prime, int64_t tid);
+static int bulk_finish(int64_t tid, vector<BulkLevel>& levels,
+		pagenum_t* root_page_no);
 
-static void redistribute_pages(
-		const std::shared_ptr<Page>& page,
-		const std::shared_ptr<Page>& neighbor_page,
-		int neighbor_index, int k_prime_index, int64_t k_prime, int64_t tid); 
+static void bulk_abort(int64_t tid, vector<BulkLevel>& levels);
+
+static int bulk_build(int64_t tid,
+		int (*next)(int64_t* key, char* val, uint16_t* size, void* arg),
+		void* arg, double fill_factor,
+		int64_t* key, char* val, uint16_t* size,
+		vector<int64_t>& added);
 
 
 /** static function def */
 static void leaf_page_splitting_internal(
-		const std::shared_ptr<LeafPage>& leaf_page,
-		const std::shared_ptr<LeafPage>& new_leaf_page,
+		LeafPage* leaf_page, LeafPage* new_leaf_page,
+		pagenum_t new_leaf_page_no,
 		int split, int insertion_index,
 		int64_t i_key, char* i_val, uint16_t i_size) {
 
@@ -133,7 +216,6 @@ static void leaf_page_splitting_internal(
 	SlotRecord* slot;
 	SlotRecord* new_slot;
 	char* val;
-	char* new_val;
 	uint16_t off, old_off;
 	uint64_t num_of_keys;
 	__Page tmp_page;
@@ -171,7 +253,7 @@ static void leaf_page_splitting_internal(
 		}
 
 		// Copy old leaf page to tmp page.
-		memcpy(&tmp_page, leaf_page.get(), PG_SIZE);
+		memcpy(&tmp_page, leaf_page, PG_SIZE);
 		val = reinterpret_cast<char*>(&tmp_page);
 
 		// Shift slots
@@ -259,7 +341,7 @@ static void leaf_page_splitting_internal(
 		}
 
 		// Copy old leaf page to tmp page.
-		memcpy(&tmp_page, leaf_page.get(), PG_SIZE);
+		memcpy(&tmp_page, leaf_page, PG_SIZE);
 		val = reinterpret_cast<char*>(&tmp_page);
 
 		SET_LEAF_FREE_SPACE(leaf_page,
@@ -280,9 +362,11 @@ static void leaf_page_splitting_internal(
 		}
 	}
 
-	// linked-list of leaf pages
+	// linked-list of leaf pages, split at the new leaf's first key
 	SET_LEAF_SIBLING(new_leaf_page, GET_LEAF_SIBLING(leaf_page));
-	SET_LEAF_SIBLING(leaf_page, GET_PAGE_NO(new_leaf_page));
+	SET_LEAF_SIBLING(leaf_page, new_leaf_page_no);
+	COPY_HIGH_KEY(new_leaf_page, leaf_page);
+	SET_HIGH_KEY(leaf_page, LEAF_KEY(new_leaf_page, 0));
 
 	// Clean-up
 	i = GET_NUM_KEYS(leaf_page) * SLOT_SIZE;
@@ -304,9 +388,9 @@ static int cut_internal(int length) {
 		return length / 2 + 1;
 }
 
-static int cut_leaf(const std::shared_ptr<LeafPage>& leaf_page) {
+static int cut_leaf(const LeafPage* leaf_page) {
 	uint16_t used_space;
-	SlotRecord* slot;
+	const SlotRecord* slot;
 	int i;
 	used_space = 0;
 
@@ -321,100 +405,236 @@ static int cut_leaf(const std::shared_ptr<LeafPage>& leaf_page) {
 	return i;
 }
 
-static bool find_leaf(int64_t tid, int64_t key, 
-		const std::shared_ptr<LeafPage>& leaf_page) {
+/** Index of the child of the internal page which may contain the key. */
+static int child_index(const InternalPage* internal_page, int64_t key) {
+	// Bounded, as an optimistic reader may see a page in the middle of a change.
+	int num_keys = std::min<int>(GET_NUM_KEYS(internal_page), INTERNAL_ORDER - 1);
+	return internal_upper_bound(internal_page, num_keys, key);
+}
+
+/** Slot index of the key in the leaf page, or -1 if it is not there. */
+static int slot_index(const LeafPage* leaf_page, int64_t key) {
+	int num_keys = GET_NUM_KEYS(leaf_page);
+	int i = leaf_lower_bound(leaf_page, num_keys, key);
+	return i < num_keys && LEAF_KEY(leaf_page, i) == key ? i : -1;
+}
+
+/** Right sibling of the page if the key is at or above its high key, or 0. */
+static pagenum_t move_right(const Page* page, int64_t key) {
+	if (GET_IS_LEAF(page) == 1) {
+		auto leaf_page = reinterpret_cast<const LeafPage*>(page);
+		if (HAS_HIGH_KEY(leaf_page) && key >= GET_HIGH_KEY(leaf_page))
+			return GET_LEAF_SIBLING(leaf_page);
+	} else {
+		auto internal_page = reinterpret_cast<const InternalPage*>(page);
+		if (HAS_HIGH_KEY(internal_page) && key >= GET_HIGH_KEY(internal_page))
+			return GET_RIGHT_LINK(internal_page);
+	}
+	return 0;
+}
+
+/*
+ * Pin the leaf page which may contain the key and latch it with mode.
+ * With a path, the internal pages it went down through are kept in it.
+ * Return 0 on success, 1 if the tree is empty and -1 if the buffer pool
+ * cannot pin a page.
+ */
+static int find_leaf(int64_t tid, int64_t key, PageGuard& leaf,
+		LatchMode mode, PagePath* path) {
 	MSG("find_leaf(). ", key, '\n');
 
-	int i;
-	
+	pagenum_t root_page_no;
+	bool go_down;
+
+restart:
+	if (path != nullptr)
+		path->clear();
+
 	// Read the header page.
-	auto head_page = std::make_shared<HeaderPage>();
-	buffer_read_page(tid, 0, std::reinterpret_pointer_cast<Page>(head_page));
+	{
+		PageGuard head(tid, 0, LatchMode::OPTIMISTIC);
+		if (!head)
+			return -1;
+		root_page_no = GET_HEADER_ROOT_PAGE_NO(head.as<HeaderPage>());
+		if (!head.validate())
+			goto restart;
+
+		// Empty tree.
+		if (root_page_no == 0) {
+			MSG("Empty tree.\n");
+			return 1;
+		}
 
-	// Empty tree.
-	if (GET_HEADER_ROOT_PAGE_NO(head_page) == 0) {
-		MSG("Empty tree.\n");
-		return false;
+		// Read the root page. The header must not have changed until the
+		// root's version is known.
+		leaf = PageGuard(tid, root_page_no, LatchMode::OPTIMISTIC);
+		if (!leaf)
+			return -1;
+		if (!head.validate())
+			goto restart;
 	}
 
-	// Read the root page.
-	auto page = std::make_shared<Page>();
-    buffer_read_page(tid, GET_HEADER_ROOT_PAGE_NO(head_page), page);
-
-	while (GET_IS_LEAF(page) != 1) {
-		// Find the leaf page.
-		auto internal_page = 
-			std::reinterpret_pointer_cast<InternalPage>(page);
+	for (;;) {
+		bool is_leaf = GET_IS_LEAF(leaf) == 1;
+		pagenum_t next_page_no = move_right(leaf.get(), key);
+		if (!leaf.validate())
+			goto restart;
+		if (next_page_no == 0 && is_leaf)
+			break;
 
-		i = 0;
-		while (i < GET_NUM_KEYS(internal_page)) {
-			// Search records in the internal page.
-			if (key >= INTERNAL_KEY(internal_page, i)) i++;
-			else break;
+		// Find the leaf page, unless the page split after its parent was read.
+		go_down = next_page_no == 0;
+		if (go_down) {
+			auto internal_page = leaf.as<InternalPage>();
+			next_page_no = INTERNAL_VAL(internal_page,
+					child_index(internal_page, key));
+			if (!leaf.validate())
+				goto restart;
 		}
-		
-		// Read the child page.
-        buffer_read_page(tid, INTERNAL_VAL(internal_page, i), page);
+
+		// Read the child (or right sibling) page. The page is unpinned after
+		// the next one is pinned and it is validated once more.
+		PageGuard next(tid, next_page_no, LatchMode::OPTIMISTIC);
+		if (!next)
+			return -1;
+		if (!leaf.validate())
+			goto restart;
+		if (go_down && path != nullptr)
+			path->push_back(std::move(leaf));
+		leaf = std::move(next);
 	}
 
-	// Copy
-	memcpy(leaf_page.get(), page.get(), sizeof(LeafPage));
-	return true;
+	if (!leaf.latch(mode)) {
+		leaf.release();
+		goto restart;
+	}
+	return 0;
 }
 
-/** Find the record with the given key. */
-static bool find_key(int64_t tid, int64_t key, 
+/*
+ * Find the record with the given key.
+ * Return 0 if found and 1 if not (the leaf stays pinned unless the tree is
+ * empty). Return -1 on a buffer error.
+ */
+static int find_key(int64_t tid, int64_t key, 
 		char* ret_val, uint16_t* size, 
-		const std::shared_ptr<LeafPage>& leaf_page) {
+		PageGuard& leaf, LatchMode mode, PagePath* path) {
 	MSG("find_key(). ", key, '\n');
 
-	int i;
+	int i, ret;
 	SlotRecord* slot;
 
 	// Find the leaf page.
-	if (!find_leaf(tid, key, leaf_page)) {
-		return false;
+	if ((ret = find_leaf(tid, key, leaf, mode, path)) != 0) {
+		return ret;
 	}
+	auto leaf_page = leaf.as<LeafPage>();
+
+	/** Find a given key from the leaf page. */
+	if ((i = slot_index(leaf_page, key)) < 0)
+		return 1;
+
+	// ret_val should be nullptr in insertion and deletion.
+	slot = LEAF_SLOT(leaf_page, i);
+	if (ret_val != nullptr)
+		memcpy(ret_val, LEAF_VAL(leaf_page, i), (size_t)slot->size);
+	if (size != nullptr)
+		*size = slot->size;
+	return 0;
+}
 
-	/** Find a given key from the leaf page.
-	 * It could be done by binary-search.
-	 */
-	for (i = 0; i < GET_NUM_KEYS(leaf_page); ++i) {
-		if (LEAF_KEY(leaf_page, i) == key) {
-			// ret_val should be nullptr in insertion and deletion.
-			if (ret_val != nullptr) {
-				slot = LEAF_SLOT(leaf_page, i);
-				memcpy(ret_val, LEAF_VAL(leaf_page, i), (size_t)slot->size);
-				*size = slot->size;
-			}
-			return true;
-		}
+/** Whether no page of the path changed since the descent. */
+static bool validate_path(const PagePath& path) {
+	for (const auto& page : path) {
+		if (!page.validate())
+			return false;
 	}
-	return false;
+	return true;
+}
+
+/** Latch the parent from the path. Under the SMO latch it is unchanged. */
+static void latch_parent(PageGuard& parent) {
+	bool unchanged = parent.latch(LatchMode::EXCLUSIVE);
+	assert(unchanged);
+	(void)unchanged;
+}
+
+/** Remember the leaf, latched EXCLUSIVE and without a sibling. */
+static void remember_rightmost(int64_t tid, const PageGuard& leaf) {
+	RightmostLeaf& rightmost = rightmost_leaves[table_stripe(tid)];
+	auto leaf_page = leaf.as<LeafPage>();
+	std::lock_guard<std::mutex> lock(rightmost.latch);
+	rightmost.table_id = tid;
+	rightmost.page_no = leaf.page_no();
+	rightmost.page_frees = page_frees[table_stripe(tid)];
+	rightmost.last_key = LEAF_KEY(leaf_page, GET_NUM_KEYS(leaf_page) - 1);
 }
 
+/** Free a page of the tree, latched EXCLUSIVE. */
+static void free_tree_page(int64_t tid, const PageGuard& page) {
+	page_frees[table_stripe(tid)]++;
+	buffer_free_page(tid, page.page_no());
+}
+
+/*
+ * Insert a key above every key of the table into the remembered rightmost
+ * leaf. Return 0 if it was inserted there, 1 if the leaf is not known, is
+ * not the last one any more, or is full.
+ */
+static int insert_rightmost(int64_t tid, int64_t key,
+		char* val, uint16_t size) {
+	RightmostLeaf& rightmost = rightmost_leaves[table_stripe(tid)];
+	pagenum_t page_no;
+	uint64_t frees;
+
+	{
+		std::lock_guard<std::mutex> lock(rightmost.latch);
+		if (rightmost.table_id != tid || rightmost.page_no == 0 ||
+				key <= rightmost.last_key)
+			return 1;
+		page_no = rightmost.page_no;
+		frees = rightmost.page_frees;
+	}
+
+	PageGuard leaf(tid, page_no, LatchMode::EXCLUSIVE);
+	if (!leaf || page_frees[table_stripe(tid)] != frees)
+		return 1;
+
+	auto leaf_page = leaf.as<LeafPage>();
+	int num_keys = GET_NUM_KEYS(leaf_page);
+	if (GET_IS_LEAF(leaf_page) != 1 || GET_LEAF_SIBLING(leaf_page) != 0 ||
+			num_keys == 0 || key <= LEAF_KEY(leaf_page, num_keys - 1) ||
+			GET_LEAF_FREE_SPACE(leaf_page) < SLOT_SIZE + size)
+		return 1;
+
+	insert_into_leaf(key, val, size, leaf);
+	{
+		std::lock_guard<std::mutex> lock(rightmost.latch);
+		if (rightmost.table_id == tid && rightmost.page_no == page_no)
+			rightmost.last_key = key;
+	}
+	return 0;
+}
 
-static void start_new_tree(int64_t tid, int64_t key,
+static int start_new_tree(int64_t tid, int64_t key,
 		char* val, uint16_t size, 
-		const std::shared_ptr<HeaderPage>& head_page,
-		const std::shared_ptr<LeafPage>& leaf_page) {
+		PageGuard& head) {
 	MSG("start new tree().\n");
 
 	SlotRecord* slot;
-	char* rec_val;
 	// internally, header page will be changed.
 	pagenum_t root_page_no = buffer_alloc_page(tid);
 	
-	// Read the header page again. see buffer_alloc_page().
-    buffer_read_page(tid, 0, std::reinterpret_pointer_cast<Page>(head_page));
 	// Read the new root page by root_page_no..
-    buffer_read_page(tid, root_page_no,
-			std::reinterpret_pointer_cast<Page>(leaf_page));
+	PageGuard leaf(tid, root_page_no, LatchMode::EXCLUSIVE);
+	if (!leaf)
+		return -1;
+	auto leaf_page = leaf.as<LeafPage>();
+	auto head_page = head.as<HeaderPage>();
 
-	memset(leaf_page.get(), 0x00, sizeof(LeafPage));
+	memset(&leaf_page->p, 0x00, PG_SIZE);
 	
 	// Initialize values.
-	SET_PAGE_NO(leaf_page, root_page_no);
 	SET_PPAGE_NO(leaf_page, 0);
 	SET_IS_LEAF(leaf_page, 1);
 	SET_NUM_KEYS(leaf_page, 1);
@@ -431,16 +651,14 @@ static void start_new_tree(int64_t tid, int64_t key,
 
 	// Set the root page number in the header page
 	SET_HEADER_ROOT_PAGE_NO(head_page, root_page_no);
-    MSG("ROOT NO : ",head_page->root_page_no,' ',root_page_no,'\n');
-    buffer_write_page(tid, 0, std::reinterpret_pointer_cast<Page>(head_page).get());
-    buffer_write_page(tid, root_page_no,
-                      std::reinterpret_pointer_cast<Page>(leaf_page).get());
+	head.mark_dirty();
+	leaf.mark_dirty();
+	return 0;
 }
 
 static void insert_into_leaf(
-		int64_t tid, int64_t key, 
-		char* val, uint16_t size,
-		const std::shared_ptr<LeafPage>& leaf_page) {
+		int64_t key, char* val, uint16_t size,
+		PageGuard& leaf) {
 
 	MSG("insert_into_leaf(). ", key, ' ', size, '\n');
 
@@ -450,6 +668,7 @@ static void insert_into_leaf(
 	SlotRecord* slot;
 	uint32_t num_of_keys;
 	uint64_t free_space;
+	auto leaf_page = leaf.as<LeafPage>();
 
 	num_of_keys = GET_NUM_KEYS(leaf_page);
 	assert(num_of_keys <= I_MAX_KEYS);
@@ -463,11 +682,8 @@ static void insert_into_leaf(
 	assert(off <= PG_SIZE && off >= PG_HEADER_SIZE);
 	assert(size >= MIN_VAL_SIZE && size <= MAX_VAL_SIZE);
 
-	insertion_point = 0;
 	// Find insertion point.
-	while (insertion_point < num_of_keys &&
-			LEAF_KEY(leaf_page, insertion_point) < key)
-		insertion_point++;
+	insertion_point = leaf_lower_bound(leaf_page, num_of_keys, key);
 
 	// Shift slots.
 	for (i = num_of_keys - 1; i >= insertion_point; --i) {
@@ -485,151 +701,151 @@ static void insert_into_leaf(
 	DEC_LEAF_FREE_SPACE(leaf_page, SLOT_SIZE + size);
 	INC_NUM_KEYS(leaf_page, 1);	
 
-    buffer_write_page(tid, GET_PAGE_NO(leaf_page),
-                      std::reinterpret_pointer_cast<Page>(leaf_page).get());
+	leaf.mark_dirty();
 }
 
-static void insert_into_leaf_after_splitting(
+static int insert_into_leaf_after_splitting(
 		int64_t tid, int64_t key,
 		char* val, uint16_t size,
-		const std::shared_ptr<LeafPage>& leaf_page) {
+		PageGuard& leaf, PagePath& path) {
 
 	MSG("insert_into_leaf_after_splitting(). ", key, ' ', size, '\n');
 
 	int insertion_index, split;
 	int64_t new_key;
+	auto leaf_page = leaf.as<LeafPage>();
 
-	// Make the new leaf page.
-	auto new_leaf_page = std::make_shared<LeafPage>();
-	memset(new_leaf_page.get(), 0x00, sizeof(LeafPage));
+	// Make the new leaf page. It goes right after its left sibling on disk
+	// when possible, so a scan along the sibling links reads sequentially.
+	PageGuard new_leaf(tid, buffer_alloc_page(tid, leaf.page_no()),
+			LatchMode::EXCLUSIVE);
+	if (!new_leaf)
+		return -1;
+	auto new_leaf_page = new_leaf.as<LeafPage>();
+	memset(&new_leaf_page->p, 0x00, PG_SIZE);
 	
 	// Initialize values
-	SET_PAGE_NO(new_leaf_page, buffer_alloc_page(tid));
 	SET_LEAF_FREE_SPACE(new_leaf_page, INIT_FREESPACE);
 	SET_IS_LEAF(new_leaf_page, 1);
 	SET_NUM_KEYS(new_leaf_page, 0);
 
-	insertion_index = 0;
 	// Find insertion index.
-	while (insertion_index < GET_NUM_KEYS(leaf_page) && 
-			LEAF_KEY(leaf_page, insertion_index) < key)
-		insertion_index++;
-
-	// Find the split index based on its free space.
-	split = cut_leaf(leaf_page);
+	insertion_index = leaf_lower_bound(leaf_page, GET_NUM_KEYS(leaf_page), key);
+
+	// Find the split index based on its free space. A key past the end of
+	// the last leaf starts the next leaf alone, so keys that go up leave
+	// full leaves behind.
+	if (GET_LEAF_SIBLING(leaf_page) == 0 &&
+			insertion_index == (int)GET_NUM_KEYS(leaf_page))
+		split = insertion_index;
+	else
+		split = cut_leaf(leaf_page);
 
 	// Move slots and their values to new leaf page.
 	leaf_page_splitting_internal(
-			leaf_page, new_leaf_page, split, insertion_index,
-			key, val, size);
+			leaf_page, new_leaf_page, new_leaf.page_no(),
+			split, insertion_index, key, val, size);
 
-    buffer_write_page(tid, GET_PAGE_NO(leaf_page),
-                      std::reinterpret_pointer_cast<Page>(leaf_page).get());
-    buffer_write_page(tid, GET_PAGE_NO(new_leaf_page),
-                      std::reinterpret_pointer_cast<Page>(new_leaf_page).get());
+	leaf.mark_dirty();
+	new_leaf.mark_dirty();
+	if (GET_LEAF_SIBLING(new_leaf_page) == 0)
+		remember_rightmost(tid, new_leaf);
 
 	new_key = LEAF_KEY(new_leaf_page, 0);
 
 	// Insert new key and new leaf to the parent
-	insert_into_parent(
-			std::reinterpret_pointer_cast<Page>(leaf_page),
-			std::reinterpret_pointer_cast<Page>(new_leaf_page),
-			new_key, tid);
+	return insert_into_parent(leaf, new_leaf, new_key, tid, path);
 }
 
-static void insert_into_parent(
-		const std::shared_ptr<Page>& left,
-		const std::shared_ptr<Page>& right,
-		int64_t key, int64_t tid) {
+static int insert_into_parent(
+		PageGuard& left, PageGuard& right,
+		int64_t key, int64_t tid, PagePath& path) {
 
 	MSG("insert_into_parent(). ", key, '\n');
 
-	pagenum_t parent_page_no;
-	auto parent_page = std::make_shared<InternalPage>();
-
-	parent_page_no = GET_PPAGE_NO(
-			std::reinterpret_pointer_cast<LeafPage>(left));
+	pagenum_t left_page_no, right_page_no;
 
 	// Make new root.
-	if (parent_page_no == 0) {
-		insert_into_new_root(left, right, key, tid);
-		return;
+	if (path.empty()) {
+		assert(GET_PPAGE_NO(left) == 0);
+		return insert_into_new_root(left, right, key, tid);
 	}
 
-    buffer_read_page(tid, parent_page_no,
-			std::reinterpret_pointer_cast<Page>(parent_page));
-
-	// Find the parent's pointer to the left page.
-	int left_index = 
-		get_left_index(parent_page, GET_PAGE_NO(left));
+	/* The split is whole at this level: a reader that gets to the left
+	 * page from the parent moves right to the keys that left it.
+	 * So both pages go before the parent is latched.
+	 */
+	left_page_no = left.page_no();
+	right_page_no = right.page_no();
+	assert(GET_PPAGE_NO(left) == path.back().page_no());
+	left.release();
+	right.release();
+
+	PageGuard parent = std::move(path.back());
+	path.pop_back();
+	latch_parent(parent);
+	auto parent_page = parent.as<InternalPage>();
+
+	// Find the parent's pointer to the left page: the child the key was in.
+	int left_index = child_index(parent_page, key);
+	assert(INTERNAL_VAL(parent_page, left_index) == left_page_no);
+	(void)left_page_no;
 
 	/* Simple case: the new key fits into the node. 
 	*/
 	if (GET_NUM_KEYS(parent_page) < INTERNAL_ORDER - 1) {
-		insert_into_internal(parent_page, left_index, key, GET_PAGE_NO(right));
-        buffer_write_page(tid, parent_page_no,
-                          std::reinterpret_pointer_cast<Page>(parent_page).get());
-		return;
+		insert_into_internal(parent_page, left_index, key, right_page_no);
+		parent.mark_dirty();
+		return 0;
 	}
 
 	/* Harder case:  split a node in order 
 	 * to preserve the B+ tree properties.
 	 */
 	return insert_into_internal_after_splitting(
-			parent_page, left_index, key, GET_PAGE_NO(right), tid);
+			parent, left_index, key, right_page_no, tid, path);
 }
 
-static void insert_into_new_root(
-		const std::shared_ptr<Page>& left,
-		const std::shared_ptr<Page>& right,
+static int insert_into_new_root(
+		PageGuard& left, PageGuard& right,
 		int64_t key, int64_t tid) {
 
 	MSG("insert_into_new_root(). ", key, '\n');
 
 	// Get the new root page.
-	auto new_root_page = std::make_shared<InternalPage>();
-	memset(new_root_page.get(), 0x00, sizeof(InternalPage));
+	PageGuard new_root(tid, buffer_alloc_page(tid), LatchMode::EXCLUSIVE);
+	if (!new_root)
+		return -1;
+	auto new_root_page = new_root.as<InternalPage>();
+	memset(&new_root_page->p, 0x00, PG_SIZE);
+	SET_INTERNAL_FORMAT(new_root_page, INTERNAL_SEPARATED);
 
-	SET_PAGE_NO(new_root_page, buffer_alloc_page(tid));
-    
 	INTERNAL_KEY(new_root_page, 0) = key;
-	INTERNAL_VAL(new_root_page, 0) = GET_PAGE_NO(left);
-	INTERNAL_VAL(new_root_page, 1) = GET_PAGE_NO(right);
+	INTERNAL_VAL(new_root_page, 0) = left.page_no();
+	INTERNAL_VAL(new_root_page, 1) = right.page_no();
 
 	SET_NUM_KEYS(new_root_page, 1);
 	SET_PPAGE_NO(new_root_page, 0);
 	SET_IS_LEAF(new_root_page, 0);
 
-	SET_PPAGE_NO(left, GET_PAGE_NO(new_root_page));
-	SET_PPAGE_NO(right, GET_PAGE_NO(new_root_page));
-
-    buffer_write_page(tid, GET_PAGE_NO(new_root_page),
-                      std::reinterpret_pointer_cast<Page>(new_root_page).get());
+	SET_PPAGE_NO(left, new_root.page_no());
+	SET_PPAGE_NO(right, new_root.page_no());
 
-    buffer_write_page(tid, GET_PAGE_NO(left), left.get());
-    buffer_write_page(tid, GET_PAGE_NO(right), right.get());
+	new_root.mark_dirty();
+	left.mark_dirty();
+	right.mark_dirty();
 
 	// Set root page number in the header page.
-	auto head_page = std::make_shared<HeaderPage>();
-    buffer_read_page(tid, 0, std::reinterpret_pointer_cast<Page>(head_page));
-	SET_HEADER_ROOT_PAGE_NO(head_page, GET_PAGE_NO(new_root_page));
-
-    buffer_write_page(tid, 0, std::reinterpret_pointer_cast<Page>(head_page).get());
-	
-}
-
-static int get_left_index(
-		const std::shared_ptr<InternalPage>& parent, pagenum_t left_page_no) {
-
-	int left_index = 0;
-	while (left_index <= GET_NUM_KEYS(parent) && 
-			INTERNAL_VAL(parent, left_index) != left_page_no)
-		left_index++;
-	return left_index;
+	PageGuard head(tid, 0, LatchMode::EXCLUSIVE);
+	if (!head)
+		return -1;
+	SET_HEADER_ROOT_PAGE_NO(head.as<HeaderPage>(), new_root.page_no());
+	head.mark_dirty();
+	return 0;
 }
 
 static void insert_into_internal(
-		const std::shared_ptr<InternalPage>& page, 
+		InternalPage* page, 
 		int left_index, int64_t key, pagenum_t right_page_no) {
 	MSG("insert_into_internal(). ", key, ' ', right_page_no, '\n');
 
@@ -645,13 +861,15 @@ static void insert_into_internal(
 	INC_NUM_KEYS(page, 1);
 }
 
-static void insert_into_internal_after_splitting(
-		const std::shared_ptr<InternalPage>& old_page,
+static int insert_into_internal_after_splitting(
+		PageGuard& old,
 		int left_index, int64_t key, pagenum_t right_page_no,
-		int64_t tid) {
+		int64_t tid, PagePath& path) {
 	MSG("insert_into_internal_after_splitting(). ", key, ' ', right_page_no, '\n');
 
-	int i, j, split, k_prime;
+	int i, j, split;
+	int64_t k_prime;
+	auto old_page = old.as<InternalPage>();
 
 	/* First create a temporary set of keys and pointers
 	 * to hold everything in order, including
@@ -681,15 +899,28 @@ static void insert_into_internal_after_splitting(
 	 * half the keys and pointers to the
 	 * old and half to the new.
 	 */  
-	auto new_page = std::make_shared<InternalPage>();
-	split = cut_internal(INTERNAL_ORDER);
+	PageGuard new_guard(tid, buffer_alloc_page(tid), LatchMode::EXCLUSIVE);
+	if (!new_guard)
+		return -1;
+	auto new_page = new_guard.as<InternalPage>();
+	memset(&new_page->p, 0x00, PG_SIZE);
+	SET_INTERNAL_FORMAT(new_page, INTERNAL_SEPARATED);
+	// As with leaves, the last page of a level keeps all but the new key
+	// when the key is past its end.
+	if (GET_RIGHT_LINK(old_page) == 0 && left_index == INTERNAL_ORDER - 1)
+		split = INTERNAL_ORDER - 1;
+	else
+		split = cut_internal(INTERNAL_ORDER);
 
-	SET_PAGE_NO(new_page, buffer_alloc_page(tid));
 	SET_NUM_KEYS(new_page, 0);
 	SET_IS_LEAF(new_page, 0);
 	SET_PPAGE_NO(new_page, GET_PPAGE_NO(old_page));
 
+	// The old page is written again from the temporary arrays, in the
+	// current format.
 	SET_NUM_KEYS(old_page, 0);
+	memset(old_page->records, 0x00, sizeof(old_page->records));
+	SET_INTERNAL_FORMAT(old_page, INTERNAL_SEPARATED);
 
 	for (i = 0; i < split - 1; i++) {
 		INTERNAL_VAL(old_page, i) = temp_pointers.get()[i];
@@ -708,13 +939,20 @@ static void insert_into_internal_after_splitting(
 
 	INTERNAL_VAL(new_page, j) = temp_pointers.get()[i];
 
-	// Leaf or Internal.
-	auto child_page = std::make_shared<Page>();
+	// The new page goes right of the old one, which ends at k_prime.
+	SET_RIGHT_LINK(new_page, GET_RIGHT_LINK(old_page));
+	SET_RIGHT_LINK(old_page, new_guard.page_no());
+	COPY_HIGH_KEY(new_page, old_page);
+	SET_HIGH_KEY(old_page, k_prime);
 
+	// Leaf or Internal.
 	for (i = 0; i <= GET_NUM_KEYS(new_page); i++) {
-        buffer_read_page(tid, INTERNAL_VAL(new_page, i), child_page);
-		SET_PPAGE_NO(child_page, GET_PAGE_NO(new_page));
-        buffer_write_page(tid, INTERNAL_VAL(new_page, i), child_page.get());
+		PageGuard child(tid, INTERNAL_VAL(new_page, i),
+				LatchMode::EXCLUSIVE);
+		if (!child)
+			return -1;
+		SET_PPAGE_NO(child, new_guard.page_no());
+		child.mark_dirty();
 	}
 
 	// clear garbage record
@@ -723,29 +961,18 @@ static void insert_into_internal_after_splitting(
 		INTERNAL_KEY(old_page, i) = 0;
 	}
 
-	for (i = GET_NUM_KEYS(new_page); i < INTERNAL_ORDER - 1; i++) {
-		INTERNAL_VAL(new_page, i + 1) = 0;
-		INTERNAL_KEY(new_page, i) = 0;
-	}
-
-    buffer_write_page(tid, GET_PAGE_NO(new_page),
-                      std::reinterpret_pointer_cast<Page>(new_page).get());
-    buffer_write_page(tid, GET_PAGE_NO(old_page),
-                      std::reinterpret_pointer_cast<Page>(old_page).get());
+	new_guard.mark_dirty();
+	old.mark_dirty();
 
 	/* Insert a new key into the parent of the two
 	 * nodes resulting from the split, with
 	 * the old node to the left and the new to the right.
 	 */
-	insert_into_parent(
-			std::reinterpret_pointer_cast<Page>(old_page),
-			std::reinterpret_pointer_cast<Page>(new_page),
-			k_prime, tid);
+	return insert_into_parent(old, new_guard, k_prime, tid, path);
 }
 
 static void remove_entry_from_page(
-		const std::shared_ptr<Page>& page,
-		int64_t tid, int64_t key) {
+		PageGuard& page, int64_t key) {
 
 	int i;
 	int key_idx = 0;
@@ -756,7 +983,7 @@ static void remove_entry_from_page(
 		char* val;
 		char* new_val;
 		uint16_t d_size, d_off;
-		auto leaf_page = std::reinterpret_pointer_cast<LeafPage>(page);
+		auto leaf_page = page.as<LeafPage>();
 		vector<pair<int, uint16_t>> tmp_list{};
 
 		/**
@@ -811,7 +1038,7 @@ static void remove_entry_from_page(
 
 	} else {
 		// Internal page.
-		auto internal_page = std::reinterpret_pointer_cast<InternalPage>(page);
+		auto internal_page = page.as<InternalPage>();
 
 		// find a slot of deleting key
 		for (i = 0; i < GET_NUM_KEYS(internal_page); i++) {
@@ -835,70 +1062,67 @@ static void remove_entry_from_page(
 		DEC_NUM_KEYS(internal_page, 1);
 	}
 
-    buffer_write_page(tid, GET_PAGE_NO(page), page.get());
+	page.mark_dirty();
 }
 
-static void adjust_root(
-		const std::shared_ptr<HeaderPage>& head_page,
-		const std::shared_ptr<Page>& page,
+static int adjust_root(
+		PageGuard& page,
 		int64_t tid) {
 	MSG("adjust_root().\n");
 
 	/** Non-empty root. */
 	if (GET_NUM_KEYS(page) > 0)
-		return;
+		return 0;
+
+	PageGuard head(tid, 0, LatchMode::EXCLUSIVE);
+	if (!head)
+		return -1;
+	auto head_page = head.as<HeaderPage>();
 
 	if (GET_IS_LEAF(page) == 0) {
 		/** Make the first child as the root. */
-		auto internal_page = std::reinterpret_pointer_cast<InternalPage>(page);
+		auto internal_page = page.as<InternalPage>();
 		SET_HEADER_ROOT_PAGE_NO(head_page, INTERNAL_VAL(internal_page, 0));
 
-		auto new_root_page = std::make_shared<Page>();
-        buffer_read_page(
-				tid, GET_HEADER_ROOT_PAGE_NO(head_page), new_root_page);
-
-		SET_PPAGE_NO(new_root_page, 0);
-		
-        buffer_write_page(
-				tid, GET_PAGE_NO(new_root_page), new_root_page.get());
-
-        buffer_write_page(tid, 0,
-                          std::reinterpret_pointer_cast<Page>(head_page).get());
+		PageGuard new_root(tid, GET_HEADER_ROOT_PAGE_NO(head_page),
+				LatchMode::EXCLUSIVE);
+		if (!new_root)
+			return -1;
+		SET_PPAGE_NO(new_root, 0);
+		if (GET_IS_LEAF(new_root))
+			CLEAR_HIGH_KEY(new_root.as<LeafPage>());
+		else
+			CLEAR_HIGH_KEY(new_root.as<InternalPage>());
+		new_root.mark_dirty();
 	} else {
 		/** Whole tree is empty. */
 		SET_HEADER_ROOT_PAGE_NO(head_page, 0);
-        buffer_write_page(tid, 0,
-                          std::reinterpret_pointer_cast<Page>(head_page).get());
 	}
+	head.mark_dirty();
 
-    buffer_free_page(tid, GET_PAGE_NO(page));
+	free_tree_page(tid, page);
+	return 0;
 }
 
-static void delete_entry(
-		const std::shared_ptr<Page>& page,
-		int64_t tid, int64_t key) {
+static int delete_entry(
+		PageGuard& page,
+		int64_t tid, int64_t key, PagePath& path) {
 	MSG("delete_entry(). key : ", key, '\n');
 	pagenum_t neighbor_page_no;
 	int neighbor_index;
 	int k_prime_index;
 	int64_t k_prime;
-	int capacity;
-
-	auto head_page = std::make_shared<HeaderPage>();
-    buffer_read_page(tid, 0, std::reinterpret_pointer_cast<Page>(head_page));
 
 	// Remove key and value from page.
-	remove_entry_from_page(page, tid, key);
+	remove_entry_from_page(page, key);
 
 	/** Delete in the root page. */
-	if (GET_HEADER_ROOT_PAGE_NO(head_page) == GET_PAGE_NO(page)) {
-		adjust_root(head_page, page, tid);
-		return;
-	}
+	if (path.empty())
+		return adjust_root(page, tid);
 
 	/** If true, return immediately. */
-	if (delete_done(page))
-		return;
+	if (delete_done(page.get()))
+		return 0;
 
 	/** Page should be merged or redistributed. */
 
@@ -908,8 +1132,11 @@ static void delete_entry(
 	 * between the pointer to page n and the pointer
 	 * to the neighbor.
 	 */
-	auto parent_page = std::make_shared<InternalPage>();
-	neighbor_index = get_neighbor_index(page, parent_page, tid);
+	PageGuard parent = std::move(path.back());
+	path.pop_back();
+	latch_parent(parent);
+	neighbor_index = get_neighbor_index(page, parent);
+	auto parent_page = parent.as<InternalPage>();
 	k_prime_index = neighbor_index == -1 ? 0 : neighbor_index;
 
 	k_prime = INTERNAL_KEY(parent_page, k_prime_index);
@@ -917,36 +1144,38 @@ static void delete_entry(
 	neighbor_page_no = neighbor_index == -1 ? INTERNAL_VAL(parent_page, 1) : 
 		INTERNAL_VAL(parent_page, neighbor_index);
 
-	auto neighbor_page = std::make_shared<Page>();
-    buffer_read_page(tid, neighbor_page_no, neighbor_page);
+	PageGuard neighbor(tid, neighbor_page_no, LatchMode::EXCLUSIVE);
+	if (!neighbor)
+		return -1;
 
 	if (GET_IS_LEAF(page) == 1) {
 		// Leaf page.
-		if (GET_LEAF_FREE_SPACE(
-					std::reinterpret_pointer_cast<LeafPage>(page)) +
-				GET_LEAF_FREE_SPACE(
-					std::reinterpret_pointer_cast<LeafPage>(neighbor_page)) >=
+		if (GET_LEAF_FREE_SPACE(page.as<LeafPage>()) +
+				GET_LEAF_FREE_SPACE(neighbor.as<LeafPage>()) >=
 				INIT_FREESPACE) {
-			merge_pages(page, neighbor_page, neighbor_index, k_prime, tid);
+			return merge_pages(page, neighbor, parent, neighbor_index,
+					k_prime, tid, path);
 		} else {
-			redistribute_pages(page, neighbor_page, neighbor_index, 
+			return redistribute_pages(page, neighbor, parent, neighbor_index, 
 					k_prime_index, k_prime, tid);
 		}
 	} else {
 		// Internal page.
-		if (GET_NUM_KEYS(page) + GET_NUM_KEYS(neighbor_page) < INTERNAL_ORDER - 1) {
-			merge_pages(page, neighbor_page, neighbor_index, k_prime, tid);
+		if (GET_NUM_KEYS(page) + GET_NUM_KEYS(neighbor) < INTERNAL_ORDER - 1) {
+			return merge_pages(page, neighbor, parent, neighbor_index,
+					k_prime, tid, path);
 		} else {
-			redistribute_pages(page, neighbor_page, neighbor_index, 
+			return redistribute_pages(page, neighbor, parent, neighbor_index, 
 					k_prime_index, k_prime, tid);
 		}
 	}
 }
 
-static void merge_pages(
-		const std::shared_ptr<Page>& page,
-		const std::shared_ptr<Page>& neighbor_page,
-		int neighbor_index, int64_t k_prime, int64_t tid) {
+static int merge_pages(
+		PageGuard& page,
+		PageGuard& neighbor,
+		PageGuard& parent,
+		int neighbor_index, int64_t k_prime, int64_t tid, PagePath& path) {
 
 	MSG("merge_pages(). k_prime : ", k_prime, '\n');
 
@@ -957,21 +1186,19 @@ static void merge_pages(
 	 * Recall that n and neighbor have swapped places
 	 * in the special case of n being a leftmost child.
 	 */
+	/* Swap neighbor with node if node is on the
+	 * extreme left and neighbor is to its right.
+	 */
+	PageGuard& n_guard = neighbor_index == -1 ? neighbor : page;
+	PageGuard& neighbor_guard = neighbor_index == -1 ? page : neighbor;
 
 	/* Case:  nonleaf node.
 	 * Append k_prime and the following pointer.
 	 * Append all pointers and keys from the neighbor.
 	 */
 	if (GET_IS_LEAF(page) != 1) {
-		auto i_page = std::reinterpret_pointer_cast<InternalPage>(page);
-		auto i_neighbor_page = 
-			std::reinterpret_pointer_cast<InternalPage>(neighbor_page);
-		/* Swap neighbor with node if node is on the
-		 * extreme left and neighbor is to its right.
-		 */
-		if (neighbor_index == -1) {
-			i_page.swap(i_neighbor_page);
-		}
+		auto i_page = n_guard.as<InternalPage>();
+		auto i_neighbor_page = neighbor_guard.as<InternalPage>();
 
 		neighbor_insertion_index = GET_NUM_KEYS(i_neighbor_page);
 
@@ -993,18 +1220,20 @@ static void merge_pages(
 		 */
 		INTERNAL_VAL(i_neighbor_page, i) = INTERNAL_VAL(i_page, j);
 
+		/* The neighbor now ends where n did. */
+		SET_RIGHT_LINK(i_neighbor_page, GET_RIGHT_LINK(i_page));
+		COPY_HIGH_KEY(i_neighbor_page, i_page);
+
 		/* All children must now point up to the same parent.
 		*/
-		auto child_page = std::make_shared<Page>();
 		for (i = 0; i < GET_NUM_KEYS(i_neighbor_page) + 1; i++) {
-            buffer_read_page(tid, INTERNAL_VAL(i_neighbor_page, i), child_page);
-			SET_PPAGE_NO(child_page, GET_PAGE_NO(i_neighbor_page));
-            buffer_write_page(tid, INTERNAL_VAL(i_neighbor_page, i), child_page.get());
+			PageGuard child(tid, INTERNAL_VAL(i_neighbor_page, i),
+					LatchMode::EXCLUSIVE);
+			if (!child)
+				return -1;
+			SET_PPAGE_NO(child, neighbor_guard.page_no());
+			child.mark_dirty();
 		}
-
-        buffer_write_page(tid, GET_PAGE_NO(i_neighbor_page),
-                          std::reinterpret_pointer_cast<Page>(i_neighbor_page).get());
-        buffer_free_page(tid, GET_PAGE_NO(i_page));
 	} else {
 		/* In a leaf, append the keys and pointers of
 		 * n to the neighbor.
@@ -1014,16 +1243,8 @@ static void merge_pages(
 		SlotRecord* slot;
 		uint64_t current_off;
 
-		auto l_page = std::reinterpret_pointer_cast<LeafPage>(page);
-		auto l_neighbor_page = 
-			std::reinterpret_pointer_cast<LeafPage>(neighbor_page);
-
-		/* Swap neighbor with the page if page is on the
-		 * extreme left and neighbor is to its right.
-		 */
-		if (neighbor_index == -1) {
-			l_page.swap(l_neighbor_page);
-		}
+		auto l_page = n_guard.as<LeafPage>();
+		auto l_neighbor_page = neighbor_guard.as<LeafPage>();
 
 		neighbor_insertion_index = GET_NUM_KEYS(l_neighbor_page);
 
@@ -1047,20 +1268,23 @@ static void merge_pages(
 		}
 
 		SET_LEAF_SIBLING(l_neighbor_page, GET_LEAF_SIBLING(l_page));
-
-        buffer_write_page(tid, GET_PAGE_NO(l_neighbor_page),
-                          std::reinterpret_pointer_cast<Page>(l_neighbor_page).get());
-		buffer_free_page(tid, GET_PAGE_NO(l_page));
+		COPY_HIGH_KEY(l_neighbor_page, l_page);
 	}
 
-	auto parent_page = std::make_shared<Page>();
-    buffer_read_page(tid, GET_PPAGE_NO(neighbor_page), parent_page);
-	delete_entry(parent_page, tid, k_prime);
+	neighbor_guard.mark_dirty();
+	free_tree_page(tid, n_guard);
+
+	// The parent is latched before the pages go, so that no reader gets
+	// from the parent to the freed page.
+	page.release();
+	neighbor.release();
+	return delete_entry(parent, tid, k_prime, path);
 }
 
-static void redistribute_pages(
-		const std::shared_ptr<Page>& page,
-		const std::shared_ptr<Page>& neighbor_page,
+static int redistribute_pages(
+		PageGuard& page,
+		PageGuard& neighbor,
+		PageGuard& parent,
 		int neighbor_index, int k_prime_index, int64_t k_prime, int64_t tid) {
 
 	MSG("redistribute_pages(). k_prime : ", k_prime, '\n');
@@ -1078,6 +1302,8 @@ static void redistribute_pages(
 
 	int i;
 
+	auto parent_page = parent.as<InternalPage>();
+
 	/* Case: n has a neighbor to the left. 
 	 * Pull the neighbor's last key-pointer pair over
 	 * from the neighbor's right end to n's left end.
@@ -1085,9 +1311,14 @@ static void redistribute_pages(
 	if (neighbor_index != -1) {
 		if (GET_IS_LEAF(page) != 1) {
 			// Internal page.
-			auto i_page = std::reinterpret_pointer_cast<InternalPage>(page);
-			auto i_neighbor_page = 
-				std::reinterpret_pointer_cast<InternalPage>(neighbor_page);
+			auto i_page = page.as<InternalPage>();
+			auto i_neighbor_page = neighbor.as<InternalPage>();
+
+			PageGuard child(tid, 
+					INTERNAL_VAL(i_neighbor_page, GET_NUM_KEYS(i_neighbor_page)),
+					LatchMode::EXCLUSIVE);
+			if (!child)
+				return -1;
 
 			INTERNAL_VAL(i_page, GET_NUM_KEYS(i_page) + 1) = 
 				INTERNAL_VAL(i_page, GET_NUM_KEYS(i_page));
@@ -1101,23 +1332,17 @@ static void redistribute_pages(
 				INTERNAL_VAL(i_neighbor_page, GET_NUM_KEYS(i_neighbor_page));
 			
 			// Set child-page's parent page no.
-			auto child_page = std::make_shared<Page>();
-            buffer_read_page(tid, INTERNAL_VAL(i_page, 0), child_page);
-			SET_PPAGE_NO(child_page, GET_PAGE_NO(i_page));
-            buffer_write_page(tid, INTERNAL_VAL(i_page, 0), child_page.get());
+			SET_PPAGE_NO(child, page.page_no());
+			child.mark_dirty();
 
 			INTERNAL_VAL(i_neighbor_page, GET_NUM_KEYS(i_neighbor_page)) = 0;
 			INTERNAL_KEY(i_page, 0) = k_prime;
 
-			auto parent_page = std::make_shared<InternalPage>();
-            buffer_read_page(tid, GET_PPAGE_NO(i_page),
-					std::reinterpret_pointer_cast<Page>(parent_page));
-
 			INTERNAL_KEY(parent_page, k_prime_index) = 
 				INTERNAL_KEY(i_neighbor_page, GET_NUM_KEYS(i_neighbor_page) - 1);
+			SET_HIGH_KEY(i_neighbor_page, INTERNAL_KEY(parent_page, k_prime_index));
 
-            buffer_write_page(tid, GET_PAGE_NO(parent_page),
-                              std::reinterpret_pointer_cast<Page>(parent_page).get());
+			parent.mark_dirty();
 
 			/* n now has one more key and one more pointer;
 			 * the neighbor has one fewer of each.
@@ -1125,14 +1350,13 @@ static void redistribute_pages(
 			INC_NUM_KEYS(i_page, 1);
 			DEC_NUM_KEYS(i_neighbor_page, 1);
 
-            buffer_write_page(tid, GET_PAGE_NO(page), page.get());
-            buffer_write_page(tid, GET_PAGE_NO(neighbor_page), neighbor_page.get());
+			page.mark_dirty();
+			neighbor.mark_dirty();
 		} else {
 			// Leaf page.
 			int move_cnt = 0;
 			uint64_t l_page_free_space, l_neighbor_page_free_space;
 			SlotRecord* slot;
-			SlotRecord* new_slot;
 
 			char* val;
 			char* new_val;
@@ -1140,9 +1364,8 @@ static void redistribute_pages(
 			vector<pair<int, uint16_t>> tmp_list{};
 			vector<pair<uint16_t, uint16_t>> moved_list{};
 
-			auto l_page = std::reinterpret_pointer_cast<LeafPage>(page);
-			auto l_neighbor_page = 
-				std::reinterpret_pointer_cast<LeafPage>(neighbor_page);
+			auto l_page = page.as<LeafPage>();
+			auto l_neighbor_page = neighbor.as<LeafPage>();
 
 			// neighbor(left) -> page (right)
 			l_page_free_space = GET_LEAF_FREE_SPACE(l_page);
@@ -1247,15 +1470,12 @@ static void redistribute_pages(
 					GET_LEAF_FREE_SPACE(l_neighbor_page));
 
 			/** Modify the value in the parent page. */
-			auto parent_page = std::make_shared<InternalPage>();
-            buffer_read_page(tid, GET_PPAGE_NO(l_page),
-					std::reinterpret_pointer_cast<Page>(parent_page));
 			INTERNAL_KEY(parent_page, k_prime_index) = LEAF_KEY(l_page, 0);
-            buffer_write_page(tid, GET_PPAGE_NO(l_page),
-                              std::reinterpret_pointer_cast<Page>(parent_page).get());
+			SET_HIGH_KEY(l_neighbor_page, LEAF_KEY(l_page, 0));
+			parent.mark_dirty();
 
-            buffer_write_page(tid, GET_PAGE_NO(page), page.get());
-            buffer_write_page(tid, GET_PAGE_NO(neighbor_page), neighbor_page.get());
+			page.mark_dirty();
+			neighbor.mark_dirty();
 		}
 	} else {  
 		/* Case: n is the leftmost child.
@@ -1268,7 +1488,6 @@ static void redistribute_pages(
 			int move_cnt = 0;
 			uint64_t l_page_free_space, l_neighbor_page_free_space;
 			SlotRecord* slot;
-			SlotRecord* new_slot;
 
 			char* val;
 			char* new_val;
@@ -1276,9 +1495,8 @@ static void redistribute_pages(
 			vector<pair<int, uint16_t>> tmp_list{};
 			vector<pair<uint16_t, uint16_t>> moved_list{};
 
-			auto l_page = std::reinterpret_pointer_cast<LeafPage>(page);
-			auto l_neighbor_page = 
-				std::reinterpret_pointer_cast<LeafPage>(neighbor_page);
+			auto l_page = page.as<LeafPage>();
+			auto l_neighbor_page = neighbor.as<LeafPage>();
 
 			// neighbor(right) -> page (left)
 			l_page_free_space = GET_LEAF_FREE_SPACE(l_page);
@@ -1383,43 +1601,35 @@ static void redistribute_pages(
 					GET_LEAF_FREE_SPACE(l_neighbor_page));
 
 			/** Modify the value in the parent page. */
-			auto parent_page = std::make_shared<InternalPage>();
-            buffer_read_page(tid, GET_PPAGE_NO(l_page),
-					std::reinterpret_pointer_cast<Page>(parent_page));
 			INTERNAL_KEY(parent_page, k_prime_index) = LEAF_KEY(l_neighbor_page, 0);
-            buffer_write_page(tid, GET_PPAGE_NO(l_page),
-                              std::reinterpret_pointer_cast<Page>(parent_page).get());
+			SET_HIGH_KEY(l_page, LEAF_KEY(l_neighbor_page, 0));
+			parent.mark_dirty();
 
-            buffer_write_page(tid, GET_PAGE_NO(page), page.get());
-            buffer_write_page(tid, GET_PAGE_NO(neighbor_page), neighbor_page.get());
+			page.mark_dirty();
+			neighbor.mark_dirty();
 
 		} else {
 			// Internal Page
-			auto i_page = std::reinterpret_pointer_cast<InternalPage>(page);
-			auto i_neighbor_page = 
-				std::reinterpret_pointer_cast<InternalPage>(neighbor_page);
+			auto i_page = page.as<InternalPage>();
+			auto i_neighbor_page = neighbor.as<InternalPage>();
+
+			PageGuard child(tid, INTERNAL_VAL(i_neighbor_page, 0),
+					LatchMode::EXCLUSIVE);
+			if (!child)
+				return -1;
 
 			INTERNAL_KEY(i_page, GET_NUM_KEYS(i_page)) = k_prime;
 			INTERNAL_VAL(i_page, GET_NUM_KEYS(i_page) + 1) = 
 				INTERNAL_VAL(i_neighbor_page, 0);
 
-			auto child_page = std::make_shared<Page>();
-            buffer_read_page(tid,
-					INTERNAL_VAL(i_page, GET_NUM_KEYS(i_page) + 1), child_page);
-
-			SET_PPAGE_NO(child_page, GET_PAGE_NO(i_page));
-            buffer_write_page(tid,
-					INTERNAL_VAL(i_page, GET_NUM_KEYS(i_page) + 1), child_page.get());
-
-			auto parent_page = std::make_shared<InternalPage>();
-            buffer_read_page(tid, GET_PPAGE_NO(i_page),
-					std::reinterpret_pointer_cast<Page>(parent_page));
+			SET_PPAGE_NO(child, page.page_no());
+			child.mark_dirty();
 
 			INTERNAL_KEY(parent_page, k_prime_index) = 
 				INTERNAL_KEY(i_neighbor_page, 0);
+			SET_HIGH_KEY(i_page, INTERNAL_KEY(i_neighbor_page, 0));
 
-            buffer_write_page(tid, GET_PPAGE_NO(i_page),
-                              std::reinterpret_pointer_cast<Page>(parent_page).get());
+			parent.mark_dirty();
 
 			for (i = 0; i < GET_NUM_KEYS(i_neighbor_page) - 1; i++) {
 				INTERNAL_KEY(i_neighbor_page, i) = INTERNAL_KEY(i_neighbor_page, i + 1);
@@ -1435,19 +1645,19 @@ static void redistribute_pages(
 			INC_NUM_KEYS(i_page, 1);
 			DEC_NUM_KEYS(i_neighbor_page, 1);
 
-            buffer_write_page(tid, GET_PAGE_NO(page), page.get());
-            buffer_write_page(tid, GET_PAGE_NO(neighbor_page), neighbor_page.get());
+			page.mark_dirty();
+			neighbor.mark_dirty();
 		}
 	}
+	return 0;
 }
 
 /** Check whether additional work(merge, redistribute) is needed or not. */
-static bool delete_done(
-		const std::shared_ptr<Page>& page) {
+static bool delete_done(const Page* page) {
 	
 	if (GET_IS_LEAF(page) == 1) {
 		// Leaf Page
-		auto leaf_page = std::reinterpret_pointer_cast<LeafPage>(page);
+		auto leaf_page = reinterpret_cast<const LeafPage*>(page);
 
 		if (GET_LEAF_FREE_SPACE(leaf_page) >= D_THRES) {
 			return false;
@@ -1456,8 +1666,7 @@ static bool delete_done(
 		}
 	} else {
 		// Internal Page
-		auto internal_page =
-			std::reinterpret_pointer_cast<InternalPage>(page);
+		auto internal_page = reinterpret_cast<const InternalPage*>(page);
 
 		if (GET_NUM_KEYS(internal_page) >= cut_internal(INTERNAL_ORDER) - 1) {
 			return true;
@@ -1467,10 +1676,20 @@ static bool delete_done(
 	}
 }
 
+/*
+ * Whether deleting a record of the size leaves enough records in the leaf
+ * (or a root with more than one), so delete_entry() would stop right after
+ * removing it.
+ */
+static bool delete_stays_in_leaf(const LeafPage* leaf_page, uint16_t size) {
+	return GET_PPAGE_NO(leaf_page) != 0 ?
+		GET_LEAF_FREE_SPACE(leaf_page) + SLOT_SIZE + size < D_THRES :
+		GET_NUM_KEYS(leaf_page) > 1;
+}
+
 static int get_neighbor_index(
-		const std::shared_ptr<Page>& page,
-		const std::shared_ptr<InternalPage>& parent_page,
-		int64_t tid) {
+		const PageGuard& page,
+		const PageGuard& parent) {
 
 	int i;
 
@@ -1480,11 +1699,11 @@ static int get_neighbor_index(
 	 * If n is the leftmost child, this means
 	 * return -1.
 	 */
-    buffer_read_page(tid, GET_PPAGE_NO(page),
-			std::reinterpret_pointer_cast<Page>(parent_page));
+	assert(GET_PPAGE_NO(page) == parent.page_no());
+	auto parent_page = parent.as<InternalPage>();
 
 	for (i = 0; i <= GET_NUM_KEYS(parent_page); i++)
-		if (INTERNAL_VAL(parent_page, i) == GET_PAGE_NO(page))
+		if (INTERNAL_VAL(parent_page, i) == page.page_no())
 			return i - 1;
 
 	// Error state.
@@ -1507,10 +1726,10 @@ int find_record(int64_t tid,
 		char* ret_val,
 		uint16_t* size) {
 	MSG("[BEGIN] find_record(). ", key, '\n');
-	auto leaf_page = std::make_shared<LeafPage>();
+	PageGuard leaf;
 
 	/** Find key. */
-	if (!find_key(tid, key, ret_val, size, leaf_page)) {
+	if (find_key(tid, key, ret_val, size, leaf, LatchMode::SHARED) != 0) {
 		MSG("[END] fail\n");
 		return -1;
 	}
@@ -1532,31 +1751,67 @@ int insert_record(int64_t tid,
 		uint16_t size) {
 	
 	MSG("[BEGIN] insert_record(). ", key, ' ', size, '\n');
-	auto leaf_page = std::make_shared<LeafPage>();
-	auto head_page = std::make_shared<HeaderPage>();
+	PageGuard leaf;
+	PagePath path;
+	int ret;
+
+	if (insert_rightmost(tid, key, val, size) == 0) {
+		MSG("[END] success (rightmost)\n");
+		return 0;
+	}
 
-	if (find_key(tid, key, nullptr, nullptr, leaf_page)) {
-		// Duplicated key.
-		MSG("[END] dup key\n");
+	if ((ret = find_key(tid, key, nullptr, nullptr, leaf,
+					LatchMode::EXCLUSIVE, &path)) <= 0) {
+		// Duplicated key or buffer error.
+		MSG("[END] dup key or error\n");
 		return -1;
 	}
 
-	// Read the header page.
-    buffer_read_page(tid, 0, std::reinterpret_pointer_cast<Page>(head_page));
-    MSG("ROOT NO : ",head_page->root_page_no,'\n');
+	if (leaf && GET_LEAF_FREE_SPACE(leaf.as<LeafPage>()) >= SLOT_SIZE + size) {
+		// Enough space for insertion.
+		insert_into_leaf(key, val, size, leaf);
+		if (GET_LEAF_SIBLING(leaf.as<LeafPage>()) == 0)
+			remember_rightmost(tid, leaf);
+		MSG("[END] success\n");
+		return 0;
+	}
+	if (leaf)
+		leaf.unlatch();
+
+	/**
+	 * Start a tree or split, one at a time. The descent holds unless a page
+	 * on it changed while the SMO latch was taken; then look again.
+	 */
+	std::lock_guard<std::mutex> smo(smo_latch(tid));
+
+	if (!leaf || !leaf.latch(LatchMode::EXCLUSIVE) || !validate_path(path)) {
+		leaf.release();
+		if ((ret = find_key(tid, key, nullptr, nullptr, leaf,
+						LatchMode::EXCLUSIVE, &path)) <= 0) {
+			MSG("[END] dup key or error\n");
+			return -1;
+		}
+	}
+
 	// Empty tree.
-	if (GET_HEADER_ROOT_PAGE_NO(head_page) == 0) {
-		start_new_tree(tid, key, val, size, head_page, leaf_page);
+	if (!leaf) {
+		PageGuard head(tid, 0, LatchMode::EXCLUSIVE);
+		if (!head || start_new_tree(tid, key, val, size, head) != 0) {
+			MSG("[END] error\n");
+			return -1;
+		}
 		MSG("[END] success\n");
 		return 0;
 	}
 
-	if (GET_LEAF_FREE_SPACE(leaf_page) >= SLOT_SIZE + size) {
-		// Enough space for insertion.
-		insert_into_leaf(tid, key, val, size, leaf_page);
-	} else {
+	if (GET_LEAF_FREE_SPACE(leaf.as<LeafPage>()) >= SLOT_SIZE + size) {
+		// Room was made in the meantime.
+		insert_into_leaf(key, val, size, leaf);
+	} else if (insert_into_leaf_after_splitting(tid, key, val, size,
+				leaf, path) != 0) {
 		// No room for insertion. Do split.
-		insert_into_leaf_after_splitting(tid, key, val, size, leaf_page);
+		MSG("[END] error\n");
+		return -1;
 	}
 
 	MSG("[END] success\n");
@@ -1572,34 +1827,765 @@ int insert_record(int64_t tid,
 int delete_record(int64_t tid, int64_t key) {
 	MSG("[BEGIN] delete_record(). ", key, '\n');
 
-	auto leaf_page = std::make_shared<LeafPage>();
+	PageGuard leaf;
+	PagePath path;
+	uint16_t size;
 
 	// Find key
-	if (!find_key(tid, key, nullptr, nullptr, leaf_page)) {
+	if (find_key(tid, key, nullptr, &size, leaf, LatchMode::EXCLUSIVE,
+				&path) != 0) {
 		MSG("[END] No key.\n");
 		return -1;
 	}
 
-	delete_entry(std::reinterpret_pointer_cast<Page>(leaf_page), tid, key);
+	if (delete_stays_in_leaf(leaf.as<LeafPage>(), size)) {
+		remove_entry_from_page(leaf, key);
+		MSG("[END] success\n");
+		return 0;
+	}
+	leaf.unlatch();
+
+	/**
+	 * Merge or redistribute, one at a time, along the descent unless a page
+	 * on it changed in the meantime.
+	 */
+	std::lock_guard<std::mutex> smo(smo_latch(tid));
+
+	if (!leaf.latch(LatchMode::EXCLUSIVE) || !validate_path(path)) {
+		leaf.release();
+		if (find_key(tid, key, nullptr, nullptr, leaf, LatchMode::EXCLUSIVE,
+					&path) != 0) {
+			MSG("[END] No key.\n");
+			return -1;
+		}
+	}
+
+	if (delete_entry(leaf, tid, key, path) != 0) {
+		MSG("[END] error\n");
+		return -1;
+	}
+	MSG("[END] success\n");
+	return 0;
+}
+
+void forget_rightmost_leaf(int64_t tid) {
+	RightmostLeaf& rightmost = rightmost_leaves[table_stripe(tid)];
+	std::lock_guard<std::mutex> lock(rightmost.latch);
+	if (rightmost.table_id == tid)
+		rightmost.page_no = 0;
+}
+
+/*
+ * Batches.
+ * The keys are taken in key order, and the run of keys that falls into one
+ * leaf is handled after one descent, under one latch of the leaf. A key
+ * that would split or merge the leaf ends the run and goes through
+ * insert_record() or delete_record() on its own; the next run starts with
+ * a new descent. Equal keys keep their order in the batch, so the first of
+ * them is inserted.
+ */
+static vector<int> batch_order(int num_keys, const int64_t* keys) {
+	vector<int> order(num_keys);
+	for (int i = 0; i < num_keys; ++i)
+		order[i] = i;
+	std::stable_sort(order.begin(), order.end(),
+			[keys](int x, int y) { return keys[x] < keys[y]; });
+	return order;
+}
+
+/** Whether a key above the first one of the run is still in the leaf. */
+static bool in_leaf(const LeafPage* leaf_page, int64_t key) {
+	return !HAS_HIGH_KEY(leaf_page) || key < GET_HIGH_KEY(leaf_page);
+}
+
+/*
+ * int find_records()
+ * @param[in]		tid : table id returned from open table
+ * @param[in]		num_keys : number of keys
+ * @param[in]		keys : keys to find, in any order
+ * @param[in/out]	ret_vals : buffer of each key, or nullptr
+ * @param[in/out]	sizes : size of each value, or nullptr
+ * @param[out]		status : 0 if the key was found, -1 if not
+ * @return: the number of keys found, or -1 on a buffer error.
+ */
+int find_records(int64_t tid, int num_keys, const int64_t* keys,
+		char** ret_vals, uint16_t* sizes, int* status) {
+	MSG("[BEGIN] find_records(). ", num_keys, '\n');
+
+	vector<int> order = batch_order(num_keys, keys);
+	PageGuard leaf;
+	int num_found = 0;
+	int i = 0;
+	int ret = 0;
+
+	while (i < num_keys) {
+		if ((ret = find_leaf(tid, keys[order[i]], leaf,
+						LatchMode::SHARED)) != 0) {
+			for (; i < num_keys; ++i)
+				status[order[i]] = -1;
+			break;
+		}
+
+		auto leaf_page = leaf.as<LeafPage>();
+		do {
+			int k = order[i];
+			int slot = slot_index(leaf_page, keys[k]);
+			status[k] = slot < 0 ? -1 : 0;
+			if (slot >= 0) {
+				uint16_t size = LEAF_SLOT(leaf_page, slot)->size;
+				if (ret_vals != nullptr)
+					memcpy(ret_vals[k], LEAF_VAL(leaf_page, slot), (size_t)size);
+				if (sizes != nullptr)
+					sizes[k] = size;
+				num_found++;
+			}
+		} while (++i < num_keys && in_leaf(leaf_page, keys[order[i]]));
+		leaf.release();
+	}
+
+	MSG("[END] found ", num_found, '\n');
+	return ret < 0 ? -1 : num_found;
+}
+
+/*
+ * int insert_records()
+ * @param[in]		tid : table id returned from open table
+ * @param[in]		num_keys : number of records
+ * @param[in]		keys, vals, sizes : the records, in any order
+ * @param[out]		status : 0 if the record was inserted, -1 if not
+ * @return: the number of records inserted, or -1 on a buffer error.
+ */
+int insert_records(int64_t tid, int num_keys, const int64_t* keys,
+		char** vals, const uint16_t* sizes, int* status) {
+	MSG("[BEGIN] insert_records(). ", num_keys, '\n');
+
+	vector<int> order = batch_order(num_keys, keys);
+	PageGuard leaf;
+	int num_inserted = 0;
+	int i = 0;
+	int ret = 0;
+
+	while (i < num_keys) {
+		int k = order[i];
+		bool full = false;
+
+		if ((ret = find_leaf(tid, keys[k], leaf, LatchMode::EXCLUSIVE)) < 0) {
+			for (; i < num_keys; ++i)
+				status[order[i]] = -1;
+			break;
+		}
+
+		if (ret == 0) {
+			auto leaf_page = leaf.as<LeafPage>();
+			for (;;) {
+				k = order[i];
+				if (slot_index(leaf_page, keys[k]) >= 0) {
+					status[k] = -1;
+				} else if (GET_LEAF_FREE_SPACE(leaf_page) >= SLOT_SIZE + sizes[k]) {
+					insert_into_leaf(keys[k], vals[k], sizes[k], leaf);
+					status[k] = 0;
+					num_inserted++;
+				} else {
+					full = true;
+					break;
+				}
+				if (++i == num_keys || !in_leaf(leaf_page, keys[order[i]]))
+					break;
+			}
+			leaf.release();
+		}
+
+		/** An empty tree, or a leaf to split. */
+		if (ret == 1 || full) {
+			status[k] = insert_record(tid, keys[k], vals[k], sizes[k]);
+			if (status[k] == 0)
+				num_inserted++;
+			i++;
+		}
+	}
+
+	MSG("[END] inserted ", num_inserted, '\n');
+	return ret < 0 ? -1 : num_inserted;
+}
+
+/*
+ * int delete_records()
+ * @param[in]		tid : table id returned from open table
+ * @param[in]		num_keys : number of keys
+ * @param[in]		keys : keys to delete, in any order
+ * @param[out]		status : 0 if the record was deleted, -1 if not
+ * @return: the number of records deleted, or -1 on a buffer error.
+ */
+int delete_records(int64_t tid, int num_keys, const int64_t* keys,
+		int* status) {
+	MSG("[BEGIN] delete_records(). ", num_keys, '\n');
+
+	vector<int> order = batch_order(num_keys, keys);
+	PageGuard leaf;
+	int num_deleted = 0;
+	int i = 0;
+	int ret = 0;
+
+	while (i < num_keys) {
+		int k = order[i];
+		bool merge = false;
+
+		if ((ret = find_leaf(tid, keys[k], leaf, LatchMode::EXCLUSIVE)) != 0) {
+			for (; i < num_keys; ++i)
+				status[order[i]] = -1;
+			break;
+		}
+
+		auto leaf_page = leaf.as<LeafPage>();
+		for (;;) {
+			k = order[i];
+			int slot = slot_index(leaf_page, keys[k]);
+			if (slot < 0) {
+				status[k] = -1;
+			} else if (delete_stays_in_leaf(leaf_page,
+						LEAF_SLOT(leaf_page, slot)->size)) {
+				remove_entry_from_page(leaf, keys[k]);
+				status[k] = 0;
+				num_deleted++;
+			} else {
+				merge = true;
+				break;
+			}
+			if (++i == num_keys || !in_leaf(leaf_page, keys[order[i]]))
+				break;
+		}
+		leaf.release();
+
+		/** A leaf to merge or redistribute. */
+		if (merge) {
+			status[k] = delete_record(tid, keys[k]);
+			if (status[k] == 0)
+				num_deleted++;
+			i++;
+		}
+	}
+
+	MSG("[END] deleted ", num_deleted, '\n');
+	return ret < 0 ? -1 : num_deleted;
+}
+
+/*
+ * void open_record_cursor()
+ * @param[out]	cursor : cursor to start
+ * @param[in]		tid : table id returned from open table
+ * @param[in]		begin_key, end_key : key range, both included
+ * The leaf is found by the first next_record().
+ */
+void open_record_cursor(Cursor* cursor, int64_t tid,
+		int64_t begin_key, int64_t end_key) {
+	cursor->table_id = tid;
+	cursor->next_key = begin_key;
+	cursor->end_key = end_key;
+	cursor->done = begin_key > end_key;
+	cursor->slot = 0;
+	cursor->leaf.release();
+}
+
+/*
+ * int next_record()
+ * @param[in/out]	cursor : cursor from open_record_cursor()
+ * @param[out]		key : key of the record
+ * @param[in/out]	ret_val : value of the record
+ * @param[in/out]	size : size of ret_val. (variable-length)
+ * @return: 0 with a record, 1 at the end of the range, -1 on an error.
+ */
+int next_record(Cursor* cursor, int64_t* key,
+		char* ret_val, uint16_t* size) {
+	MSG("[BEGIN] next_record(). ", cursor->next_key, '\n');
+	PageGuard& leaf = cursor->leaf;
+	int ret;
+
+	while (!cursor->done) {
+		/** Find the place again if the leaf changed since the last call. */
+		if (!leaf || !leaf.latch(LatchMode::SHARED)) {
+			leaf.release();
+			if ((ret = find_leaf(cursor->table_id, cursor->next_key, leaf,
+							LatchMode::SHARED)) != 0) {
+				cursor->done = true;
+				MSG("[END] empty or error\n");
+				return ret;
+			}
+			auto leaf_page = leaf.as<LeafPage>();
+			cursor->slot = leaf_lower_bound(leaf_page, GET_NUM_KEYS(leaf_page),
+					cursor->next_key);
+		}
+		auto leaf_page = leaf.as<LeafPage>();
+
+		if (cursor->slot < (int)GET_NUM_KEYS(leaf_page)) {
+			SlotRecord* slot = LEAF_SLOT(leaf_page, cursor->slot);
+			if (slot->key > cursor->end_key)
+				break;
+
+			*key = slot->key;
+			memcpy(ret_val, LEAF_VAL(leaf_page, cursor->slot), (size_t)slot->size);
+			*size = slot->size;
+
+			cursor->slot++;
+			if (slot->key == cursor->end_key)
+				cursor->done = true;
+			else
+				cursor->next_key = slot->key + 1;
+			leaf.unlatch();
+			MSG("[END] success\n");
+			return 0;
+		}
+
+		/**
+		 * Go on to the next leaf. Its pin is only good if this leaf did not
+		 * change until then; otherwise look for next_key from the root.
+		 */
+		pagenum_t sibling = GET_LEAF_SIBLING(leaf_page);
+		if (sibling == 0)
+			break;
+		leaf.unlatch();
+
+		PageGuard next(cursor->table_id, sibling, LatchMode::OPTIMISTIC);
+		if (!next)
+			return -1;
+		if (!leaf.validate()) {
+			leaf.release();
+			continue;
+		}
+		leaf = std::move(next);
+		cursor->slot = 0;
+	}
+
+	cursor->done = true;
+	leaf.release();
+	MSG("[END] end of range\n");
+	return 1;
+}
+
+void close_record_cursor(Cursor* cursor) {
+	cursor->done = true;
+	cursor->leaf.release();
+}
+
+/*
+ * int scan_records()
+ * @param[in]		tid : table id returned from open table
+ * @param[in]		begin_key, end_key : key range, both included
+ * @param[in]		callback : called with each record; non-zero stops the scan
+ * @param[in]		arg : passed to callback
+ * @return: the number of records passed to callback, or -1 on an error.
+ * The record is copied out first, so the callback may change the table.
+ */
+int scan_records(int64_t tid, int64_t begin_key, int64_t end_key,
+		int (*callback)(int64_t key, const char* val, uint16_t size,
+			void* arg),
+		void* arg) {
+	Cursor cursor;
+	char val[MAX_VAL_SIZE];
+	uint16_t size;
+	int64_t key;
+	int num_records = 0;
+	int ret;
+
+	open_record_cursor(&cursor, tid, begin_key, end_key);
+	while ((ret = next_record(&cursor, &key, val, &size)) == 0) {
+		num_records++;
+		if (callback(key, val, size, arg) != 0)
+			break;
+	}
+	close_record_cursor(&cursor);
+	return ret < 0 ? -1 : num_records;
+}
+
+/*
+ * Bulk load.
+ * Records come in key order, so the tree is built from the bottom up
+ * without a single search or split: leaves are filled left to right, and
+ * each page that is full is handed to its parent on the level above, which
+ * is filled the same way. Only the last page of each level stays pinned
+ * (and the one before it, see bulk_finish()); the pages are new, so they
+ * are allocated next to each other and flushed in sorted batches.
+ * Nobody reaches the pages until the root is set in the header at the end,
+ * so a build that fails before only has to free them.
+ * Pages are filled to fill_factor, but never below what a delete leaves
+ * alone: one record or key off a full page must not make it underfull.
+ * Only the last page of a level may be below that.
+ */
+static constexpr int BULK_FLUSH_PAGES = 512;
+static constexpr size_t BULK_MAX_LEVELS = 16;
+
+struct BulkLevel {
+	PageGuard page;		// the page being filled
+	PageGuard prev;		// the page before it, already full
+	int64_t first_key;	// smallest key under page
+	vector<pagenum_t> pages;	// every page of the level
+	int capacity;		// children of an internal page
+};
+
+static int bulk_new_page(int64_t tid, pagenum_t hint, bool is_leaf,
+		PageGuard& page) {
+	page = PageGuard(tid, buffer_alloc_page(tid, hint));
+	if (!page)
+		return -1;
+
+	memset(page.get(), 0x00, PG_SIZE);
+	SET_IS_LEAF(page.get(), is_leaf);
+	if (is_leaf)
+		SET_LEAF_FREE_SPACE(page.as<LeafPage>(), INIT_FREESPACE);
+	else
+		SET_INTERNAL_FORMAT(page.as<InternalPage>(), INTERNAL_SEPARATED);
+	// It stays pinned while it is filled, so it is written once, when full.
+	page.mark_dirty();
+	return 0;
+}
+
+/*
+ * Add the full page child, whose smallest key is key, to the level above
+ * it, and set its parent. A full page on that level goes up in turn.
+ */
+static int bulk_add_child(int64_t tid, vector<BulkLevel>& levels,
+		size_t level, int64_t key, PageGuard& child) {
+	if (levels.size() == level) {
+		if (level == BULK_MAX_LEVELS)
+			return -1;
+		levels.push_back({ PageGuard(), PageGuard(), key, {},
+				levels[level - 1].capacity });
+		if (bulk_new_page(tid, 0, false, levels[level].page) != 0)
+			return -1;
+		levels[level].pages.push_back(levels[level].page.page_no());
+		INTERNAL_VAL(levels[level].page.as<InternalPage>(), 0) = child.page_no();
+		SET_PPAGE_NO(child.get(), levels[level].page.page_no());
+		child.mark_dirty();
+		return 0;
+	}
+
+	auto page = levels[level].page.as<InternalPage>();
+	int num_keys = GET_NUM_KEYS(page);
+
+	if (num_keys + 1 == levels[level].capacity) {
+		/** Full: the next page starts with the child. */
+		PageGuard next;
+		if (bulk_new_page(tid, levels[level].page.page_no(), false, next) != 0)
+			return -1;
+		SET_RIGHT_LINK(page, next.page_no());
+		SET_HIGH_KEY(page, key);
+		if (bulk_add_child(tid, levels, level + 1,
+					levels[level].first_key, levels[level].page) != 0)
+			return -1;
+
+		BulkLevel& cur = levels[level];
+		cur.prev = std::move(cur.page);
+		cur.page = std::move(next);
+		cur.first_key = key;
+		cur.pages.push_back(cur.page.page_no());
+		INTERNAL_VAL(cur.page.as<InternalPage>(), 0) = child.page_no();
+	} else {
+		INTERNAL_KEY(page, num_keys) = key;
+		INTERNAL_VAL(page, num_keys + 1) = child.page_no();
+		INC_NUM_KEYS(page, 1);
+	}
+
+	SET_PPAGE_NO(child.get(), levels[level].page.page_no());
+	child.mark_dirty();
+	return 0;
+}
+
+/*
+ * Hand the last page of each level up, from the leaves, until a level has
+ * a single page: the root. The last internal page of a level may have one
+ * child only; it then takes the last child of the page before it, as a
+ * page needs two children to have a key at all.
+ */
+static int bulk_finish(int64_t tid, vector<BulkLevel>& levels,
+		pagenum_t* root_page_no) {
+	size_t level;
+
+	for (level = 0; levels[level].pages.size() > 1; ++level) {
+		BulkLevel& cur = levels[level];
+		if (level > 0 && GET_NUM_KEYS(cur.page.get()) == 0) {
+			auto page = cur.page.as<InternalPage>();
+			auto prev_page = cur.prev.as<InternalPage>();
+			int last = GET_NUM_KEYS(prev_page);
+			int64_t key = INTERNAL_KEY(prev_page, last - 1);
+
+			INTERNAL_VAL(page, 1) = INTERNAL_VAL(page, 0);
+			INTERNAL_KEY(page, 0) = cur.first_key;
+			INTERNAL_VAL(page, 0) = INTERNAL_VAL(prev_page, last);
+			SET_NUM_KEYS(page, 1);
+			cur.first_key = key;
+
+			INTERNAL_VAL(prev_page, last) = 0;
+			INTERNAL_KEY(prev_page, last - 1) = 0;
+			DEC_NUM_KEYS(prev_page, 1);
+			SET_HIGH_KEY(prev_page, key);
+			cur.prev.mark_dirty();
+
+			PageGuard child(tid, INTERNAL_VAL(page, 0));
+			if (!child)
+				return -1;
+			SET_PPAGE_NO(child.get(), cur.page.page_no());
+			child.mark_dirty();
+		}
+		if (bulk_add_child(tid, levels, level + 1,
+					levels[level].first_key, levels[level].page) != 0)
+			return -1;
+	}
+
+	*root_page_no = levels[level].page.page_no();
+	return 0;
+}
+
+/** Free every page of a build that was not installed. */
+static void bulk_abort(int64_t tid, vector<BulkLevel>& levels) {
+	for (auto& level : levels) {
+		level.page.release();
+		level.prev.release();
+		for (pagenum_t page_no : level.pages)
+			buffer_free_page(tid, page_no);
+	}
+	levels.clear();
+}
+
+/*
+ * Build the tree of an empty table from next() while the keys go up, and
+ * append the key of every record loaded to added.
+ * Stop at the first record out of order, which is left in key, val and
+ * size, and return 1 then; 0 at the end of the input. On a record of a bad
+ * size or an error, return -1 with the table as it was.
+ */
+static int bulk_build(int64_t tid,
+		int (*next)(int64_t* key, char* val, uint16_t* size, void* arg),
+		void* arg, double fill_factor,
+		int64_t* key, char* val, uint16_t* size,
+		vector<int64_t>& added) {
+	vector<BulkLevel> levels;
+	pagenum_t root_page_no;
+	/** A leaf keeps less than D_THRES free after giving up two records. */
+	uint64_t fill_space = std::max<uint64_t>(fill_factor * INIT_FREESPACE,
+			INIT_FREESPACE - D_THRES + 2 * (SLOT_SIZE + MAX_VAL_SIZE));
+	/** An internal page keeps the minimum number of keys after losing one. */
+	int capacity = std::max(cut_internal(INTERNAL_ORDER) + 1,
+			(int)(fill_factor * INTERNAL_ORDER));
+	int64_t last_key = 0;
+	int ret = 0;
+
+	levels.reserve(BULK_MAX_LEVELS);
+	levels.push_back({ PageGuard(), PageGuard(), 0, {}, capacity });
+
+	while (ret == 0 && next(key, val, size, arg) == 0) {
+		if (*size < MIN_VAL_SIZE || *size > MAX_VAL_SIZE) {
+			ret = -1;
+			break;
+		}
+		if (!levels[0].pages.empty() && *key <= last_key) {
+			ret = 1;
+			break;
+		}
+
+		BulkLevel& leaves = levels[0];
+		if (leaves.pages.empty()) {
+			if (bulk_new_page(tid, 0, true, leaves.page) != 0) {
+				ret = -1;
+				break;
+			}
+			leaves.first_key = *key;
+			leaves.pages.push_back(leaves.page.page_no());
+		} else {
+			auto leaf_page = leaves.page.as<LeafPage>();
+			uint64_t used = INIT_FREESPACE - GET_LEAF_FREE_SPACE(leaf_page);
+			if (used + SLOT_SIZE + *size > fill_space ||
+					GET_LEAF_FREE_SPACE(leaf_page) < SLOT_SIZE + *size) {
+				/** Full: link the next leaf and hand this one up. */
+				PageGuard next_leaf;
+				if (bulk_new_page(tid, leaves.page.page_no(), true,
+							next_leaf) != 0) {
+					ret = -1;
+					break;
+				}
+				leaves.pages.push_back(next_leaf.page_no());
+				SET_LEAF_SIBLING(leaf_page, next_leaf.page_no());
+				SET_HIGH_KEY(leaf_page, *key);
+				if (bulk_add_child(tid, levels, 1,
+							leaves.first_key, leaves.page) != 0) {
+					ret = -1;
+					break;
+				}
+
+				BulkLevel& cur = levels[0];
+				cur.page = std::move(next_leaf);
+				cur.first_key = *key;
+
+				if (cur.pages.size() % BULK_FLUSH_PAGES == 0)
+					buffer_flush_table(tid);
+			}
+		}
+
+		insert_into_leaf(*key, val, *size, levels[0].page);
+		last_key = *key;
+		added.push_back(*key);
+	}
+
+	if (ret < 0) {
+		bulk_abort(tid, levels);
+		added.clear();
+		return -1;
+	}
+	if (levels[0].pages.empty())
+		return ret;
+
+	if (bulk_finish(tid, levels, &root_page_no) != 0) {
+		bulk_abort(tid, levels);
+		added.clear();
+		return -1;
+	}
+	levels.clear();
+
+	PageGuard head(tid, 0, LatchMode::EXCLUSIVE);
+	if (!head)
+		return -1;
+	SET_HEADER_ROOT_PAGE_NO(head.as<HeaderPage>(), root_page_no);
+	head.mark_dirty();
+	head.release();
+
+	buffer_flush_table(tid);
+	return ret;
+}
+
+/*
+ * int64_t bulk_load_records()
+ * @param[in]		tid : table id returned from open table
+ * @param[in]		next : gives the next record in key order; returns 0 with
+ *								a record, non-zero at the end of the input
+ * @param[in]		arg : passed to next
+ * @param[in]		fill_factor : part of each page filled, from 0.5 to 1
+ * @return: the number of records loaded, or -1 on an error.
+ * An empty tree is built from the bottom up. Records that come after the
+ * tree is there (the table was not empty, or a key was out of order) are
+ * inserted one by one; duplicate keys are skipped.
+ * On an error the records loaded so far are deleted again, so the table
+ * has the records it had before.
+ */
+int64_t bulk_load_records(int64_t tid,
+		int (*next)(int64_t* key, char* val, uint16_t* size, void* arg),
+		void* arg, double fill_factor) {
+	MSG("[BEGIN] bulk_load_records(). ", fill_factor, '\n');
+
+	char val[MAX_VAL_SIZE];
+	uint16_t size;
+	int64_t key;
+	vector<int64_t> added;
+	bool pending = false;
+
+	fill_factor = std::min(1.0, std::max(0.5, fill_factor));
+	{
+		/** No split or merge of the table while the tree is built. */
+		std::lock_guard<std::mutex> smo(smo_latch(tid));
+		PageGuard head(tid, 0, LatchMode::SHARED);
+		if (!head)
+			return -1;
+		bool empty = GET_HEADER_ROOT_PAGE_NO(head.as<HeaderPage>()) == 0;
+		head.release();
+
+		if (empty) {
+			int ret = bulk_build(tid, next, arg, fill_factor,
+					&key, val, &size, added);
+			if (ret < 0) {
+				MSG("[END] error\n");
+				return -1;
+			}
+			if (ret == 0) {
+				MSG("[END] success\n");
+				return added.size();
+			}
+			pending = true;
+		}
+	}
+
+	/** The rest, or all of a table that had records. */
+	while (pending || next(&key, val, &size, arg) == 0) {
+		pending = false;
+		if (size < MIN_VAL_SIZE || size > MAX_VAL_SIZE) {
+			for (int64_t k : added)
+				delete_record(tid, k);
+			MSG("[END] bad record\n");
+			return -1;
+		}
+		if (insert_record(tid, key, val, size) == 0)
+			added.push_back(key);
+	}
+	MSG("[END] success\n");
+	return added.size();
+}
+
+/*
+ * int find_record_mapped()
+ * @param[in]				tid : table id of a mapped table
+ * @param[in]				key : key value
+ * @param[in/out]		ret_val : return value
+ * @param[in/out]		size : size of ret_val. (variable-length)
+ * @return: if success, return 0. Else return non-zero.
+ * The pages are read in place in the mapping, so nothing is pinned or
+ * copied but the value. No other layer checked the file, so page numbers
+ * and sizes are checked against it here.
+ */
+int find_record_mapped(int64_t tid,
+		int64_t key,
+		char* ret_val,
+		uint16_t* size) {
+	MSG("[BEGIN] find_record_mapped(). ", key, '\n');
+	pagenum_t num_of_pages, page_no;
+	const Page* pages;
+	int i;
+
+	if ((pages = file_mapped_pages(tid, &num_of_pages)) == nullptr)
+		return -1;
+	page_no = GET_HEADER_ROOT_PAGE_NO(
+			reinterpret_cast<const HeaderPage*>(&pages[0]));
+
+	// Walk down. The depth bound stops a cycle in a corrupted file.
+	for (int depth = 0; ; ++depth) {
+		if (page_no == 0 || page_no >= num_of_pages || depth == 64) {
+			MSG("[END] fail\n");
+			return -1;
+		}
+		if (GET_IS_LEAF(&pages[page_no]) == 1)
+			break;
+
+		auto internal_page = reinterpret_cast<const InternalPage*>(&pages[page_no]);
+		if (GET_NUM_KEYS(internal_page) >= INTERNAL_ORDER)
+			return -1;
+		page_no = INTERNAL_VAL(internal_page, child_index(internal_page, key));
+	}
+
+	auto leaf_page = reinterpret_cast<const LeafPage*>(&pages[page_no]);
+	if (GET_NUM_KEYS(leaf_page) > INIT_FREESPACE / SLOT_SIZE)
+		return -1;
+	if ((i = slot_index(leaf_page, key)) < 0) {
+		MSG("[END] fail\n");
+		return -1;
+	}
+
+	const SlotRecord* slot = LEAF_SLOT(leaf_page, i);
+	if (slot->off < PG_HEADER_SIZE || slot->off + slot->size > PG_SIZE)
+		return -1;
+	if (ret_val != nullptr)
+		memcpy(ret_val, LEAF_VAL(leaf_page, i), (size_t)slot->size);
+	if (size != nullptr)
+		*size = slot->size;
 	MSG("[END] success\n");
 	return 0;
 }
 
 #ifdef DBG_PRINT
 /** Print page for debug */
-static void print_page(
-		const std::shared_ptr<Page>& page) {
+static void print_page(pagenum_t page_no, const Page* page) {
 	if (GET_IS_LEAF(page) == 1)
-		print_leaf_page(
-				std::reinterpret_pointer_cast<LeafPage>(page));
+		print_leaf_page(page_no, reinterpret_cast<const LeafPage*>(page));
 	else
-		print_internal_page(
-				std::reinterpret_pointer_cast<InternalPage>(page));
+		print_internal_page(page_no, reinterpret_cast<const InternalPage*>(page));
 }
 
-static void print_leaf_page(
-		const std::shared_ptr<LeafPage>& p) {
-	std::cerr << "[PRINT] page no : " << GET_PAGE_NO(p) << '\n';
+static void print_leaf_page(pagenum_t page_no, const LeafPage* p) {
+	std::cerr << "[PRINT] page no : " << page_no << '\n';
 	std::cerr << "[HEADER]\n";
 	std::cerr << "PPage no 	: " << GET_PPAGE_NO(p) << ", ";
 	std::cerr << "Is Leaf  	: " << GET_IS_LEAF(p) << ", ";
@@ -1607,7 +2593,7 @@ static void print_leaf_page(
 	std::cerr << "Freespace	: " << GET_LEAF_FREE_SPACE(p) << ", ";
 	std::cerr << "Sibling  	: " << GET_LEAF_SIBLING(p) << '\n';
 	std::cerr << "[SLOTS]\n";
-	SlotRecord* slot = nullptr;
+	const SlotRecord* slot = nullptr;
 
 	for (int i = 0; i < GET_NUM_KEYS(p); ++i) {
 		slot = LEAF_SLOT(p, i);
@@ -1624,9 +2610,8 @@ static void print_leaf_page(
 	std::cerr << "[PRINT DONE]\n";
 }
 
-static void print_internal_page(
-		const std::shared_ptr<InternalPage>& p) {
-	std::cerr << "[PRINT] page no : " << GET_PAGE_NO(p) << '\n';
+static void print_internal_page(pagenum_t page_no, const InternalPage* p) {
+	std::cerr << "[PRINT] page no : " << page_no << '\n';
 	std::cerr << "[HEADER]\n";
 	std::cerr << "PPage no 	: " << GET_PPAGE_NO(p) << ", ";
 	std::cerr << "Is Leaf  	: " << GET_IS_LEAF(p) << ", ";
@@ -1643,17 +2628,15 @@ static void print_internal_page(
 
 
 #else
-static void print_page(
-		const std::shared_ptr<Page>& page) {
+static void print_page(pagenum_t page_no, const Page* page) {
 	return;
 }
 
-static void print_leaf_page(
-		const std::shared_ptr<LeafPage>& leaf_page) {
+static void print_leaf_page(pagenum_t page_no, const LeafPage* leaf_page) {
 	return;
 }
-static void print_internal_page(
-		const std::shared_ptr<InternalPage>& internal_page) {
+static void print_internal_page(pagenum_t page_no,
+		const InternalPage* internal_page) {
 	return;
 }
 
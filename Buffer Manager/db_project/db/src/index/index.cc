@@ -17,15 +17,28 @@ IndexManager::~IndexManager() {
 	this->map_tid_to_tab.clear();
 }
 
-void IndexManager::upd_tab_info(int64_t table_id, const char* table_name) {
+void IndexManager::upd_tab_info(int64_t table_id, const char* table_name,
+		bool read_only) {
 	if (this->map_tid_to_tab.find(table_id) == this->map_tid_to_tab.end()) {
 		this->map_tid_to_tab[table_id] = 
-			std::make_unique<Table>(table_name, table_id);
+			std::make_unique<Table>(table_name, table_id, read_only);
+		forget_rightmost_leaf(table_id);
 	}
 }
 
-/** Return the table id matching with the given pathname. */
-int64_t IndexManager::open_table(const char* pathname) {
+/** Whether the table was opened with TableMode::READ_ONLY_MMAP. */
+bool IndexManager::is_read_only(int64_t table_id) const {
+	auto it = this->map_tid_to_tab.find(table_id);
+	return it != this->map_tid_to_tab.end() && it->second->read_only;
+}
+
+/*
+ * Return the table id matching with the given pathname. A table that is
+ * already open keeps the mode it was opened with.
+ */
+int64_t IndexManager::open_table(const char* pathname, TableMode mode,
+		AccessHint hint) {
+	bool read_only = mode == TableMode::READ_ONLY_MMAP;
 	int64_t ret;
 	std::string given_table_name(pathname);
 
@@ -38,8 +51,10 @@ int64_t IndexManager::open_table(const char* pathname) {
 	}
 
 	/** Open table internally. */
-	if ((ret = file_open_table_file(pathname)) > 0) {
-		index_manager->upd_tab_info(ret, pathname);
+	ret = read_only ? file_open_table_mmap(pathname, hint) :
+		file_open_table_file(pathname);
+	if (ret > 0) {
+		index_manager->upd_tab_info(ret, pathname, read_only);
 	}
 
 func_exit:
@@ -50,7 +65,12 @@ int IndexManager::find_rec(int64_t tid, int64_t key,
 		char* ret_val, uint16_t* size) {
 	int ret;
 
-	if(!(ret = find_record(tid, key, ret_val, size))) {
+	if (this->is_read_only(tid))
+		ret = find_record_mapped(tid, key, ret_val, size);
+	else
+		ret = find_record(tid, key, ret_val, size);
+
+	if(!ret) {
 		this->map_tid_to_tab[tid]->inc_num_finds();
 	}
 
@@ -61,6 +81,9 @@ int IndexManager::insert_rec(int64_t tid, int64_t key,
 		char* val, uint16_t size) {
 	int ret;
 
+	if (this->is_read_only(tid))
+		return -1;
+
 	if(!(ret = insert_record(tid, key, val, size))) {
 		this->map_tid_to_tab[tid]->inc_num_recs();
 	}
@@ -71,6 +94,9 @@ int IndexManager::insert_rec(int64_t tid, int64_t key,
 int IndexManager::delete_rec(int64_t tid, int64_t key) {
 	int ret;
 
+	if (this->is_read_only(tid))
+		return -1;
+
 	if(!(ret = delete_record(tid, key))) {
 		this->map_tid_to_tab[tid]->inc_num_dels();
 	}
@@ -78,6 +104,105 @@ int IndexManager::delete_rec(int64_t tid, int64_t key) {
 	return ret;
 }
 
+/** A mapped table has no leaves to share, so its keys are found one by one. */
+int IndexManager::find_recs(int64_t tid, int num_keys, const int64_t* keys,
+		char** vals, uint16_t* sizes, int* status) {
+	int ret = 0;
+
+	if (this->is_read_only(tid)) {
+		for (int i = 0; i < num_keys; ++i) {
+			status[i] = find_record_mapped(tid, keys[i],
+					vals != nullptr ? vals[i] : nullptr,
+					sizes != nullptr ? &sizes[i] : nullptr);
+			ret += status[i] == 0;
+		}
+	} else {
+		ret = find_records(tid, num_keys, keys, vals, sizes, status);
+	}
+
+	if (ret > 0) {
+		this->map_tid_to_tab[tid]->num_finds += ret;
+	}
+
+	return ret;
+}
+
+int IndexManager::insert_recs(int64_t tid, int num_keys, const int64_t* keys,
+		char** vals, const uint16_t* sizes, int* status) {
+	int ret;
+
+	if (this->is_read_only(tid))
+		return -1;
+
+	if ((ret = insert_records(tid, num_keys, keys, vals, sizes, status)) > 0) {
+		this->map_tid_to_tab[tid]->num_recs += ret;
+	}
+
+	return ret;
+}
+
+int IndexManager::delete_recs(int64_t tid, int num_keys, const int64_t* keys,
+		int* status) {
+	int ret;
+
+	if (this->is_read_only(tid))
+		return -1;
+
+	if ((ret = delete_records(tid, num_keys, keys, status)) > 0) {
+		this->map_tid_to_tab[tid]->num_dels += ret;
+	}
+
+	return ret;
+}
+
+/*
+ * Cursors walk the leaf chain of the buffer pool, which a mapped table does
+ * not use, so they are only for READ_WRITE tables.
+ */
+Cursor* IndexManager::open_cursor(int64_t tid, int64_t begin_key,
+		int64_t end_key) {
+	if (this->map_tid_to_tab.find(tid) == this->map_tid_to_tab.end() ||
+			this->is_read_only(tid))
+		return nullptr;
+
+	Cursor* cursor = new Cursor;
+	open_record_cursor(cursor, tid, begin_key, end_key);
+	return cursor;
+}
+
+int IndexManager::scan_recs(int64_t tid, int64_t begin_key, int64_t end_key,
+		int (*callback)(int64_t, const char*, uint16_t, void*), void* arg) {
+	int ret;
+
+	if (this->map_tid_to_tab.find(tid) == this->map_tid_to_tab.end() ||
+			this->is_read_only(tid))
+		return -1;
+
+	ret = scan_records(tid, begin_key, end_key, callback, arg);
+	if (ret > 0) {
+		this->map_tid_to_tab[tid]->num_finds += ret;
+	}
+
+	return ret;
+}
+
+int64_t IndexManager::bulk_load(int64_t tid,
+		int (*next)(int64_t*, char*, uint16_t*, void*),
+		void* arg, double fill_factor) {
+	int64_t ret;
+
+	if (this->map_tid_to_tab.find(tid) == this->map_tid_to_tab.end() ||
+			this->is_read_only(tid))
+		return -1;
+
+	ret = bulk_load_records(tid, next, arg, fill_factor);
+	if (ret > 0) {
+		this->map_tid_to_tab[tid]->num_recs += ret;
+	}
+
+	return ret;
+}
+
 
 /** Index Manager APIs */
 int open_index_manager() {
@@ -96,8 +221,9 @@ int close_index_manager() {
 	return 0;
 }
 
-int64_t open_table_file(const char* pathname) {
-	return index_manager->open_table(pathname);
+int64_t open_table_file(const char* pathname, TableMode mode,
+		AccessHint hint) {
+	return index_manager->open_table(pathname, mode, hint);
 }
 
 int db_insert_record(int64_t table_id, int64_t key,
@@ -114,3 +240,49 @@ int db_find_record(int64_t table_id, int64_t key,
 int db_delete_record(int64_t table_id, int64_t key) {
 	return index_manager->delete_rec(table_id, key);
 }
+
+int db_find_records(int64_t table_id, int num_keys, const int64_t* keys,
+		char** ret_vals, uint16_t* val_sizes, int* status) {
+	return index_manager->find_recs(table_id, num_keys, keys,
+			ret_vals, val_sizes, status);
+}
+
+int db_insert_records(int64_t table_id, int num_keys, const int64_t* keys,
+		char** values, const uint16_t* val_sizes, int* status) {
+	return index_manager->insert_recs(table_id, num_keys, keys,
+			values, val_sizes, status);
+}
+
+int db_delete_records(int64_t table_id, int num_keys, const int64_t* keys,
+		int* status) {
+	return index_manager->delete_recs(table_id, num_keys, keys, status);
+}
+
+Cursor* db_open_cursor(int64_t table_id, int64_t begin_key,
+		int64_t end_key) {
+	return index_manager->open_cursor(table_id, begin_key, end_key);
+}
+
+int db_cursor_next(Cursor* cursor, int64_t* key,
+		char* ret_val, uint16_t* val_size) {
+	return next_record(cursor, key, ret_val, val_size);
+}
+
+void db_close_cursor(Cursor* cursor) {
+	if (cursor == nullptr)
+		return;
+	close_record_cursor(cursor);
+	delete cursor;
+}
+
+int db_scan_records(int64_t table_id, int64_t begin_key, int64_t end_key,
+		int (*callback)(int64_t, const char*, uint16_t, void*), void* arg) {
+	return index_manager->scan_recs(table_id, begin_key, end_key,
+			callback, arg);
+}
+
+int64_t db_bulk_load_records(int64_t table_id,
+		int (*next)(int64_t*, char*, uint16_t*, void*),
+		void* arg, double fill_factor) {
+	return index_manager->bulk_load(table_id, next, arg, fill_factor);
+}
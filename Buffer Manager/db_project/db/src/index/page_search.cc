@@ -0,0 +1,165 @@
+#include "page_search.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define PAGE_SEARCH_AVX2
+#endif
+
+/*
+ * The keys of an internal page: key i is at keys[i * stride]. They start at
+ * records[1] in an INTERLEAVED page (see INTERNAL_KEY()).
+ */
+static const int64_t* internal_keys(const InternalPage* page, int* stride) {
+	if (GET_INTERNAL_FORMAT(page) == INTERNAL_SEPARATED) {
+		*stride = 1;
+		return page->keys;
+	}
+	*stride = 2;
+	return &page->records[1].key;
+}
+
+static int internal_upper_bound_linear(const InternalPage* page,
+		int num_keys, int64_t key) {
+	int stride;
+	const int64_t* keys = internal_keys(page, &stride);
+	int i = 0;
+	while (i < num_keys && keys[i * stride] <= key)
+		i++;
+	return i;
+}
+
+/*
+ * Branch-free: the window [base, base + n) holds the first key > key, and
+ * each step halves it with a conditional move instead of a branch.
+ */
+template <int STRIDE>
+static int upper_bound_binary(const int64_t* keys, int num_keys, int64_t key) {
+	const int64_t* base = keys;
+	int n = num_keys;
+
+	if (n == 0)
+		return 0;
+	while (n > 1) {
+		int half = n / 2;
+		base = base[half * STRIDE] <= key ? base + half * STRIDE : base;
+		n -= half;
+	}
+	return (int)(base - keys) / STRIDE + (*base <= key);
+}
+
+static int internal_upper_bound_binary(const InternalPage* page,
+		int num_keys, int64_t key) {
+	int stride;
+	const int64_t* keys = internal_keys(page, &stride);
+	if (stride == 1)
+		return upper_bound_binary<1>(keys, num_keys, key);
+	return upper_bound_binary<2>(keys, num_keys, key);
+}
+
+static int leaf_lower_bound_linear(const LeafPage* page,
+		int num_keys, int64_t key) {
+	int i = 0;
+	while (i < num_keys && LEAF_KEY(page, i) < key)
+		i++;
+	return i;
+}
+
+static int leaf_lower_bound_binary(const LeafPage* page,
+		int num_keys, int64_t key) {
+	const SlotRecord* slots = page->slots;
+	const SlotRecord* base = slots;
+	int n = num_keys;
+
+	if (n == 0)
+		return 0;
+	while (n > 1) {
+		int half = n / 2;
+		base = base[half].key < key ? base + half : base;
+		n -= half;
+	}
+	return (int)(base - slots) + (base->key < key);
+}
+
+#ifdef PAGE_SEARCH_AVX2
+/*
+ * Binary search down to a window of 4 loads, then count the keys <= key
+ * there with 256-bit compares. A load holds four keys of a SEPARATED page,
+ * or two records of an INTERLEAVED page, whose keys are lanes 0 and 2 and
+ * whose child pointers in lanes 1 and 3 are masked out.
+ */
+template <int STRIDE>
+__attribute__((target("avx2")))
+static int upper_bound_avx2(const int64_t* keys, int num_keys, int64_t key) {
+	constexpr int PER_LOAD = 4 / STRIDE;
+	constexpr int LANES = STRIDE == 1 ? 0xf : 0x5;
+	const int64_t* base = keys;
+	int n = num_keys;
+
+	while (n > 4 * PER_LOAD) {
+		int half = n / 2;
+		base = base[half * STRIDE] <= key ? base + half * STRIDE : base;
+		n -= half;
+	}
+
+	__m256i target = _mm256_set1_epi64x(key);
+	int count = 0;
+	int i = 0;
+	for (; i + PER_LOAD <= n; i += PER_LOAD) {
+		__m256i loaded = _mm256_loadu_si256(
+				reinterpret_cast<const __m256i*>(&base[i * STRIDE]));
+		int greater = _mm256_movemask_pd(
+				_mm256_castsi256_pd(_mm256_cmpgt_epi64(loaded, target)));
+		count += __builtin_popcount(~greater & LANES);
+	}
+	// The last keys; a full load may run past the page.
+	for (; i < n; ++i)
+		count += base[i * STRIDE] <= key;
+	return (int)(base - keys) / STRIDE + count;
+}
+
+static int internal_upper_bound_avx2(const InternalPage* page,
+		int num_keys, int64_t key) {
+	int stride;
+	const int64_t* keys = internal_keys(page, &stride);
+	if (stride == 1)
+		return upper_bound_avx2<1>(keys, num_keys, key);
+	return upper_bound_avx2<2>(keys, num_keys, key);
+}
+
+static bool cpu_has_avx2() {
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+}
+static const bool has_avx2 = cpu_has_avx2();
+#endif
+
+int internal_upper_bound(const InternalPage* page, int num_keys, int64_t key,
+		PageSearch how) {
+	switch (how) {
+		case PageSearch::LINEAR:
+			return internal_upper_bound_linear(page, num_keys, key);
+		case PageSearch::BINARY:
+			return internal_upper_bound_binary(page, num_keys, key);
+		default:
+#ifdef PAGE_SEARCH_AVX2
+			if (has_avx2)
+				return internal_upper_bound_avx2(page, num_keys, key);
+#endif
+			return internal_upper_bound_binary(page, num_keys, key);
+	}
+}
+
+int leaf_lower_bound(const LeafPage* page, int num_keys, int64_t key,
+		PageSearch how) {
+	if (how == PageSearch::LINEAR)
+		return leaf_lower_bound_linear(page, num_keys, key);
+	return leaf_lower_bound_binary(page, num_keys, key);
+}
+
+bool page_search_simd() {
+#ifdef PAGE_SEARCH_AVX2
+	return has_avx2;
+#else
+	return false;
+#endif
+}
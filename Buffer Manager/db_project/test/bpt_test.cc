@@ -0,0 +1,861 @@
+#include "api.h"
+#include "buffer.h"
+#include "page.h"
+#include "page_search.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * TestFixture for the index through the API.
+ * Each test starts from a fresh table file.
+ */
+class BptTest : public ::testing::Test {
+ protected:
+  BptTest() { remove(pathname); }
+  ~BptTest() { remove(pathname); }
+
+  // Value of the key: its decimal digits repeated to a key-dependent size.
+  static uint16_t make_value(int64_t key, char* val) {
+    std::string digits = std::to_string(key);
+    uint16_t size = 50 + key % 60;
+    for (uint16_t i = 0; i < size; ++i) val[i] = digits[i % digits.size()];
+    return size;
+  }
+
+  void fill(int64_t table_id, int num_keys) {
+    char val[112];
+    for (int64_t key = 0; key < num_keys; ++key) {
+      uint16_t size = make_value(key * 7 % num_keys, val);
+      ASSERT_EQ(db_insert(table_id, key * 7 % num_keys, val, size), 0);
+    }
+  }
+
+  char pathname[32] = "bpt_test.db";
+};
+
+/*
+ * A read-only mapped table finds every record of the file in place and
+ * refuses changes.
+ */
+TEST_F(BptTest, MappedTableFinds) {
+  constexpr int num_keys = 3001;  // prime, so key * 7 % num_keys is a permutation
+  ASSERT_EQ(init_db(32), 0);
+  int64_t table_id = open_table(pathname);
+  ASSERT_GT(table_id, 0);
+  fill(table_id, num_keys);
+  ASSERT_EQ(shutdown_db(), 0);
+
+  ASSERT_EQ(init_db(32), 0);
+  table_id = open_table(pathname, TableMode::READ_ONLY_MMAP,
+                        AccessHint::SEQUENTIAL);
+  ASSERT_GT(table_id, 0);
+
+  char expected[112], val[112];
+  uint16_t size;
+  for (int64_t key = 0; key < num_keys; ++key) {
+    uint16_t expected_size = make_value(key, expected);
+    ASSERT_EQ(db_find(table_id, key, val, &size), 0) << "key " << key;
+    ASSERT_EQ(size, expected_size);
+    ASSERT_EQ(memcmp(val, expected, size), 0);
+  }
+  EXPECT_NE(db_find(table_id, num_keys, val, &size), 0);
+  EXPECT_EQ(db_advise_table(table_id, AccessHint::RANDOM), 0);
+
+  EXPECT_NE(db_insert(table_id, num_keys, val, 50), 0);
+  EXPECT_NE(db_delete(table_id, 0), 0);
+  EXPECT_EQ(db_find(table_id, 0, val, &size), 0);
+  ASSERT_EQ(shutdown_db(), 0);
+}
+
+/*
+ * Opening a missing file read-only fails instead of creating it.
+ */
+TEST_F(BptTest, MappedTableMissing) {
+  ASSERT_EQ(init_db(32), 0);
+  EXPECT_LT(open_table(pathname, TableMode::READ_ONLY_MMAP), 0);
+  ASSERT_EQ(shutdown_db(), 0);
+  FILE* file = fopen(pathname, "r");
+  EXPECT_EQ(file, nullptr);
+}
+
+/*
+ * A scan returns the records left in the range in key order, and stops
+ * when the callback asks it to.
+ */
+TEST_F(BptTest, ScanRange) {
+  constexpr int num_keys = 3001;
+  ASSERT_EQ(init_db(32), 0);
+  int64_t table_id = open_table(pathname);
+  ASSERT_GT(table_id, 0);
+  fill(table_id, num_keys);
+  for (int64_t key = 0; key < num_keys; key += 3)
+    ASSERT_EQ(db_delete(table_id, key), 0);
+
+  struct Scan {
+    std::vector<int64_t> keys;
+    int bad_values;
+    size_t limit;
+  } scan{{}, 0, 0};
+  auto callback = [](int64_t key, const char* val, uint16_t size,
+                     void* arg) -> int {
+    Scan* scan = static_cast<Scan*>(arg);
+    char expected[112];
+    if (make_value(key, expected) != size || memcmp(val, expected, size) != 0)
+      scan->bad_values++;
+    scan->keys.push_back(key);
+    return scan->limit != 0 && scan->keys.size() == scan->limit;
+  };
+
+  EXPECT_EQ(db_scan(table_id, 100, 2000, callback, &scan), 1268);
+  EXPECT_EQ(scan.bad_values, 0);
+  std::vector<int64_t> expected;
+  for (int64_t key = 100; key <= 2000; ++key)
+    if (key % 3 != 0) expected.push_back(key);
+  EXPECT_EQ(scan.keys, expected);
+
+  scan = Scan{{}, 0, 10};
+  EXPECT_EQ(db_scan(table_id, -5, num_keys + 5, callback, &scan), 10);
+  EXPECT_EQ(scan.keys.front(), 1);
+  scan = Scan{{}, 0, 0};
+  EXPECT_EQ(db_scan(table_id, num_keys, num_keys + 100, callback, &scan), 0);
+  EXPECT_EQ(db_scan(table_id, 10, 9, callback, &scan), 0);
+  ASSERT_EQ(shutdown_db(), 0);
+}
+
+/*
+ * Records inserted between two cursor_next() calls split the leaf the
+ * cursor is on; the cursor still returns every old record once, in order.
+ */
+TEST_F(BptTest, CursorAcrossSplits) {
+  constexpr int num_keys = 2000;
+  ASSERT_EQ(init_db(64), 0);
+  int64_t table_id = open_table(pathname);
+  ASSERT_GT(table_id, 0);
+  char val[112];
+  for (int64_t key = 0; key < num_keys; ++key) {
+    uint16_t size = make_value(2 * key, val);
+    ASSERT_EQ(db_insert(table_id, 2 * key, val, size), 0);
+  }
+
+  Cursor* cursor = open_cursor(table_id, 0, 2 * num_keys);
+  ASSERT_NE(cursor, nullptr);
+  int64_t key, last = -1;
+  uint16_t size;
+  int num_old = 0;
+  while (cursor_next(cursor, &key, val, &size) == 0) {
+    ASSERT_GT(key, last);
+    last = key;
+    if (key % 2 == 0) num_old++;
+    // Fill the gaps ahead of the cursor.
+    for (int64_t odd = key + 1; odd < key + 20 && odd < 2 * num_keys;
+         odd += 2) {
+      char new_val[112];
+      uint16_t new_size = make_value(odd, new_val);
+      db_insert(table_id, odd, new_val, new_size);
+    }
+  }
+  cursor_close(cursor);
+  EXPECT_EQ(num_old, num_keys);
+  EXPECT_EQ(last, 2 * num_keys - 1);
+  ASSERT_EQ(shutdown_db(), 0);
+}
+
+// Records of db_bulk_load() from a list of keys, valued by make_value().
+struct BulkInput {
+  std::vector<int64_t> keys;
+  size_t next;
+  uint16_t size;  // of every value if not 0
+};
+
+// A negative key gets a value too short to load.
+static int next_bulk_record(int64_t* key, char* val, uint16_t* size,
+                            void* arg) {
+  BulkInput* input = static_cast<BulkInput*>(arg);
+  if (input->next == input->keys.size()) return 1;
+  *key = input->keys[input->next++];
+  *size = input->size != 0 ? input->size : 50 + *key % 60;
+  if (*key < 0) *size = 10;
+  memset(val, 0, *size);
+  snprintf(val, *size, "%" PRId64, *key);
+  return 0;
+}
+
+/*
+ * Pages of each level of the tree in the file, from the leaves up, and how
+ * many of them but the last one a delete would find underfull: a leaf with
+ * 2500 bytes free or an internal page with less than 124 keys.
+ */
+static std::vector<std::pair<int, int>> tree_levels(const char* pathname) {
+  std::vector<Page> pages;
+  Page page;
+  FILE* file = fopen(pathname, "rb");
+  if (file == nullptr) return {};
+  while (fread(&page, PG_SIZE, 1, file) == 1) pages.push_back(page);
+  fclose(file);
+
+  std::vector<std::pair<int, int>> levels;
+  pagenum_t page_no = GET_HEADER_ROOT_PAGE_NO(
+      reinterpret_cast<const HeaderPage*>(&pages[0]));
+  while (page_no != 0) {
+    bool is_leaf = GET_IS_LEAF(&pages[page_no]) == 1;
+    auto first = reinterpret_cast<const InternalPage*>(&pages[page_no]);
+    pagenum_t down = is_leaf ? 0 : INTERNAL_VAL(first, 0);
+    int count = 0, underfull = 0;
+    for (pagenum_t p = page_no; p != 0; ++count) {
+      auto leaf = reinterpret_cast<const LeafPage*>(&pages[p]);
+      auto internal = reinterpret_cast<const InternalPage*>(&pages[p]);
+      pagenum_t next =
+          is_leaf ? GET_LEAF_SIBLING(leaf) : GET_RIGHT_LINK(internal);
+      bool under = is_leaf ? GET_LEAF_FREE_SPACE(leaf) >= 2500
+                           : GET_NUM_KEYS(internal) < 124;
+      if (under && next != 0) underfull++;
+      p = next;
+    }
+    levels.insert(levels.begin(), {count, underfull});
+    page_no = down;
+  }
+  return levels;
+}
+
+/*
+ * A bulk loaded tree finds every record and takes inserts and deletes
+ * that split and merge its pages. Half filled leaves of 17 records make
+ * 253 leaves under internal pages of at least 126 children, so the last
+ * internal page above them starts with a single child and has to take one
+ * from its left neighbour.
+ */
+TEST_F(BptTest, BulkLoad) {
+  constexpr int num_keys = 252 * 17 + 1;
+  ASSERT_EQ(init_db(32), 0);
+  int64_t table_id = open_table(pathname);
+  ASSERT_GT(table_id, 0);
+
+  BulkInput input{{}, 0, 100};
+  for (int64_t key = 0; key < num_keys; ++key) input.keys.push_back(2 * key);
+  ASSERT_EQ(db_bulk_load(table_id, next_bulk_record, &input, 0.5), num_keys);
+
+  char val[112];
+  uint16_t size;
+  for (int64_t key = 0; key < 2 * num_keys; ++key) {
+    if (key % 2 == 1) {
+      EXPECT_NE(db_find(table_id, key, val, &size), 0) << "key " << key;
+      continue;
+    }
+    ASSERT_EQ(db_find(table_id, key, val, &size), 0) << "key " << key;
+    ASSERT_EQ(size, 100);
+    ASSERT_EQ(atoll(val), key);
+  }
+  auto count = [](int64_t, const char*, uint16_t, void*) { return 0; };
+  EXPECT_EQ(db_scan(table_id, 0, 2 * num_keys, count, nullptr), num_keys);
+
+  // Fill the gaps of the upper half (num_keys is odd) and empty the lower.
+  for (int64_t key = num_keys; key < 2 * num_keys; key += 2) {
+    uint16_t new_size = make_value(key, val);
+    ASSERT_EQ(db_insert(table_id, key, val, new_size), 0);
+  }
+  for (int64_t key = 0; key < num_keys; key += 2)
+    ASSERT_EQ(db_delete(table_id, key), 0) << "key " << key;
+  for (int64_t key = 0; key < 2 * num_keys; ++key) {
+    EXPECT_EQ(db_find(table_id, key, val, &size) == 0, key >= num_keys)
+        << "key " << key;
+  }
+  ASSERT_EQ(shutdown_db(), 0);
+}
+
+/*
+ * Even half filled, the pages of a bulk loaded tree take a delete each
+ * without a merge: only the last page of a level may be underfull.
+ */
+TEST_F(BptTest, BulkLoadHalfFullTakesDeletes) {
+  constexpr int per_leaf = 17;
+  constexpr int num_keys = 300 * per_leaf;
+  ASSERT_EQ(init_db(64), 0);
+  int64_t table_id = open_table(pathname);
+  ASSERT_GT(table_id, 0);
+  BulkInput input{{}, 0, 100};
+  for (int64_t key = 0; key < num_keys; ++key) input.keys.push_back(key);
+  ASSERT_EQ(db_bulk_load(table_id, next_bulk_record, &input, 0.5), num_keys);
+  ASSERT_EQ(shutdown_db(), 0);
+
+  auto loaded = tree_levels(pathname);
+  ASSERT_EQ(loaded.size(), 3u);
+  EXPECT_EQ(loaded[0].first, num_keys / per_leaf);
+  for (auto& level : loaded) EXPECT_EQ(level.second, 0);
+
+  ASSERT_EQ(init_db(64), 0);
+  table_id = open_table(pathname);
+  ASSERT_GT(table_id, 0);
+  for (int64_t key = per_leaf / 2; key < num_keys; key += per_leaf)
+    ASSERT_EQ(db_delete(table_id, key), 0) << "key " << key;
+  ASSERT_EQ(shutdown_db(), 0);
+
+  auto deleted = tree_levels(pathname);
+  ASSERT_EQ(deleted.size(), loaded.size());
+  for (size_t level = 0; level < loaded.size(); ++level) {
+    EXPECT_EQ(deleted[level].first, loaded[level].first) << "level " << level;
+    EXPECT_EQ(deleted[level].second, 0) << "level " << level;
+  }
+}
+
+/*
+ * A load that fails on a bad record leaves the table as it was, whether it
+ * was building the tree or inserting into it.
+ */
+TEST_F(BptTest, BulkLoadBadRecord) {
+  ASSERT_EQ(init_db(32), 0);
+  int64_t table_id = open_table(pathname);
+  ASSERT_GT(table_id, 0);
+
+  BulkInput input{{}, 0, 0};
+  for (int64_t key = 0; key < 3000; ++key) input.keys.push_back(key);
+  input.keys.push_back(-1);
+  EXPECT_EQ(db_bulk_load(table_id, next_bulk_record, &input), -1);
+  char val[112];
+  uint16_t size;
+  EXPECT_NE(db_find(table_id, 0, val, &size), 0);
+  EXPECT_NE(db_find(table_id, 2999, val, &size), 0);
+
+  // the pages it had taken are free again
+  input = BulkInput{{}, 0, 0};
+  for (int64_t key = 0; key < 1000; ++key) input.keys.push_back(2 * key);
+  ASSERT_EQ(db_bulk_load(table_id, next_bulk_record, &input), 1000);
+
+  // out of order into inserts, then the bad record
+  input = BulkInput{{}, 0, 0};
+  for (int64_t key = 0; key < 1000; ++key) input.keys.push_back(2 * key + 1);
+  input.keys.push_back(0);
+  input.keys.push_back(-1);
+  EXPECT_EQ(db_bulk_load(table_id, next_bulk_record, &input), -1);
+  auto count = [](int64_t, const char*, uint16_t, void*) { return 0; };
+  EXPECT_EQ(db_scan(table_id, 0, 2000, count, nullptr), 1000);
+  for (int64_t key = 0; key < 2000; ++key)
+    EXPECT_EQ(db_find(table_id, key, val, &size) == 0, key % 2 == 0)
+        << "key " << key;
+  ASSERT_EQ(shutdown_db(), 0);
+}
+
+/*
+ * Records after a key out of order, and a load into a table that has
+ * records, go through inserts; duplicate keys are skipped.
+ */
+TEST_F(BptTest, BulkLoadFallsBack) {
+  ASSERT_EQ(init_db(32), 0);
+  int64_t table_id = open_table(pathname);
+  ASSERT_GT(table_id, 0);
+
+  BulkInput input{{}, 0, 0};
+  for (int64_t key = 0; key < 1000; ++key) input.keys.push_back(key);
+  for (int64_t key = 500; key < 1500; ++key) input.keys.push_back(key);
+  EXPECT_EQ(db_bulk_load(table_id, next_bulk_record, &input), 1500);
+
+  input = BulkInput{{}, 0, 0};
+  for (int64_t key = 1400; key < 2000; ++key) input.keys.push_back(key);
+  EXPECT_EQ(db_bulk_load(table_id, next_bulk_record, &input), 500);
+
+  char val[112];
+  uint16_t size;
+  for (int64_t key = 0; key < 2000; ++key) {
+    ASSERT_EQ(db_find(table_id, key, val, &size), 0) << "key " << key;
+    ASSERT_EQ(atoll(val), key);
+  }
+  EXPECT_NE(db_find(table_id, 2000, val, &size), 0);
+  ASSERT_EQ(shutdown_db(), 0);
+}
+
+/*
+ * Batches in random order with equal keys, keys already there and keys
+ * missing get the status of each key, and split and merge leaves as the
+ * single-key calls do.
+ */
+TEST_F(BptTest, BatchOps) {
+  constexpr int num_keys = 3000;
+  constexpr int batch = 500;
+  ASSERT_EQ(init_db(32), 0);
+  int64_t table_id = open_table(pathname);
+  ASSERT_GT(table_id, 0);
+
+  std::vector<int64_t> keys(num_keys);
+  for (int i = 0; i < num_keys; ++i) keys[i] = i;
+  std::shuffle(keys.begin(), keys.end(), std::mt19937(7));
+
+  std::vector<char> buf(batch * 112);
+  std::vector<char*> vals(batch);
+  std::vector<uint16_t> sizes(batch);
+  std::vector<int> status(batch);
+  for (int i = 0; i < batch; ++i) vals[i] = &buf[i * 112];
+
+  // Nothing is found in an empty table.
+  EXPECT_EQ(db_find_batch(table_id, batch, keys.data(), vals.data(),
+                          sizes.data(), status.data()),
+            0);
+  EXPECT_EQ(std::count(status.begin(), status.end(), -1), batch);
+
+  for (int base = 0; base < num_keys; base += batch) {
+    // The last key of the batch repeats its first one.
+    std::vector<int64_t> chunk(keys.begin() + base, keys.begin() + base + batch);
+    chunk.back() = chunk.front();
+    for (int i = 0; i < batch; ++i) sizes[i] = make_value(chunk[i], vals[i]);
+    EXPECT_EQ(db_insert_batch(table_id, batch, chunk.data(), vals.data(),
+                              sizes.data(), status.data()),
+              batch - 1);
+    for (int i = 0; i < batch - 1; ++i) EXPECT_EQ(status[i], 0);
+    EXPECT_EQ(status[batch - 1], -1);
+    // Insert the key left out on its own.
+    int64_t left_out = keys[base + batch - 1];
+    uint16_t size = make_value(left_out, vals[0]);
+    ASSERT_EQ(db_insert(table_id, left_out, vals[0], size), 0);
+  }
+
+  // Every other key and some beyond the table.
+  std::vector<int64_t> wanted;
+  for (int i = 0; i < batch; ++i) wanted.push_back(keys[i] * 2);
+  EXPECT_EQ(db_find_batch(table_id, batch, wanted.data(), vals.data(),
+                          sizes.data(), status.data()),
+            std::count_if(wanted.begin(), wanted.end(),
+                          [](int64_t key) { return key < num_keys; }));
+  for (int i = 0; i < batch; ++i) {
+    ASSERT_EQ(status[i], wanted[i] < num_keys ? 0 : -1) << "key " << wanted[i];
+    if (status[i] != 0) continue;
+    char expected[112];
+    ASSERT_EQ(sizes[i], make_value(wanted[i], expected));
+    ASSERT_EQ(memcmp(vals[i], expected, sizes[i]), 0);
+  }
+
+  // Delete all but the last few hundred keys, twice the first batch.
+  for (int base = 0; base + batch < num_keys; base += batch) {
+    std::vector<int64_t> chunk(keys.begin() + base, keys.begin() + base + batch);
+    EXPECT_EQ(db_delete_batch(table_id, batch, chunk.data(), status.data()),
+              batch);
+  }
+  std::vector<int64_t> again(keys.begin(), keys.begin() + batch);
+  EXPECT_EQ(db_delete_batch(table_id, batch, again.data(), status.data()), 0);
+  EXPECT_EQ(std::count(status.begin(), status.end(), -1), batch);
+
+  char val[112];
+  uint16_t size;
+  for (int i = 0; i < num_keys; ++i) {
+    bool kept = i >= num_keys - batch;
+    EXPECT_EQ(db_find(table_id, keys[i], val, &size) == 0, kept)
+        << "key " << keys[i];
+  }
+  ASSERT_EQ(shutdown_db(), 0);
+}
+
+/*
+ * Threads insert, find and delete disjoint keys at once, so leaves split
+ * and merge under readers that go down the tree at the same time.
+ */
+TEST_F(BptTest, ConcurrentInsertFindDelete) {
+  constexpr int num_threads = 4;
+  constexpr int num_keys = 20000;
+  ASSERT_EQ(init_db(256), 0);
+  int64_t table_id = open_table(pathname);
+  ASSERT_GT(table_id, 0);
+
+  std::atomic<int> failures{0};
+  auto worker = [&](int t) {
+    char expected[112], val[112];
+    uint16_t size;
+    // Thread t owns the keys equal to t modulo num_threads.
+    for (int64_t key = t; key < num_keys; key += num_threads) {
+      uint16_t expected_size = make_value(key, expected);
+      if (db_insert(table_id, key, expected, expected_size) != 0) failures++;
+      int64_t back = key - num_threads * 8;
+      if (back >= 0) {
+        uint16_t back_size = make_value(back, expected);
+        if (db_find(table_id, back, val, &size) != 0 || size != back_size ||
+            memcmp(val, expected, size) != 0)
+          failures++;
+      }
+    }
+    // Then delete every other key of its own.
+    for (int64_t key = t; key < num_keys; key += 2 * num_threads) {
+      if (db_delete(table_id, key) != 0) failures++;
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; ++t) threads.emplace_back(worker, t);
+  for (auto& thread : threads) thread.join();
+  EXPECT_EQ(failures, 0);
+
+  char expected[112], val[112];
+  uint16_t size;
+  for (int64_t key = 0; key < num_keys; ++key) {
+    bool deleted = key % (2 * num_threads) < num_threads;
+    if (deleted) {
+      EXPECT_NE(db_find(table_id, key, val, &size), 0) << "key " << key;
+      continue;
+    }
+    uint16_t expected_size = make_value(key, expected);
+    ASSERT_EQ(db_find(table_id, key, val, &size), 0) << "key " << key;
+    ASSERT_EQ(size, expected_size);
+    ASSERT_EQ(memcmp(val, expected, size), 0);
+  }
+  ASSERT_EQ(shutdown_db(), 0);
+}
+
+/*
+ * After splits, merges and redistributions, every page with a high key has
+ * a right sibling that starts at it, and holds only keys below it.
+ */
+TEST_F(BptTest, HighKeysBoundPages) {
+  constexpr int num_keys = 3001;
+  ASSERT_EQ(init_db(32), 0);
+  int64_t table_id = open_table(pathname);
+  ASSERT_GT(table_id, 0);
+  fill(table_id, num_keys);
+  for (int64_t key = 0; key < num_keys; key += 3)
+    ASSERT_EQ(db_delete(table_id, key), 0);
+  ASSERT_EQ(shutdown_db(), 0);
+
+  FILE* file = fopen(pathname, "rb");
+  ASSERT_NE(file, nullptr);
+  auto read_page = [&](pagenum_t pagenum, Page* page) {
+    ASSERT_EQ(fseek(file, pagenum * PG_SIZE, SEEK_SET), 0);
+    ASSERT_EQ(fread(page, PG_SIZE, 1, file), 1u);
+  };
+  // First and last key of a page (a separator of an internal page).
+  auto key_range = [](const Page* page, int64_t* first, int64_t* last) {
+    if (GET_IS_LEAF(page) == 1) {
+      auto leaf = reinterpret_cast<const LeafPage*>(page);
+      *first = LEAF_KEY(leaf, 0);
+      *last = LEAF_KEY(leaf, GET_NUM_KEYS(leaf) - 1);
+    } else {
+      auto internal = reinterpret_cast<const InternalPage*>(page);
+      *first = INTERNAL_KEY(internal, 0);
+      *last = INTERNAL_KEY(internal, GET_NUM_KEYS(internal) - 1);
+    }
+  };
+
+  Page page;
+  read_page(0, &page);
+  pagenum_t level =
+      GET_HEADER_ROOT_PAGE_NO(reinterpret_cast<HeaderPage*>(&page));
+  int num_bounded = 0;
+  // Walk each level left to right, from its leftmost page.
+  while (level != 0) {
+    read_page(level, &page);
+    bool is_leaf = GET_IS_LEAF(&page) == 1;
+    pagenum_t below =
+        is_leaf ? 0 : INTERNAL_VAL(reinterpret_cast<InternalPage*>(&page), 0);
+    for (pagenum_t pagenum = level; pagenum != 0;) {
+      read_page(pagenum, &page);
+      auto leaf = reinterpret_cast<LeafPage*>(&page);
+      auto internal = reinterpret_cast<InternalPage*>(&page);
+      pagenum_t right =
+          is_leaf ? GET_LEAF_SIBLING(leaf) : GET_RIGHT_LINK(internal);
+      bool bounded = is_leaf ? HAS_HIGH_KEY(leaf) : HAS_HIGH_KEY(internal);
+      int64_t high_key = is_leaf ? GET_HIGH_KEY(leaf) : GET_HIGH_KEY(internal);
+      int64_t first, last;
+      key_range(&page, &first, &last);
+      if (bounded) {
+        num_bounded++;
+        EXPECT_LT(last, high_key) << "page " << pagenum;
+        ASSERT_NE(right, 0u) << "page " << pagenum;
+        Page next;
+        read_page(right, &next);
+        key_range(&next, &first, &last);
+        EXPECT_GE(first, high_key) << "page " << right;
+      } else {
+        EXPECT_EQ(right, 0u) << "page " << pagenum;
+      }
+      pagenum = right;
+    }
+    level = below;
+  }
+  EXPECT_GT(num_bounded, 0);
+  fclose(file);
+}
+
+/*
+ * Keys that go up fill each leaf before the next one starts, also after
+ * the last leaves were merged away and the remembered one is gone.
+ */
+TEST_F(BptTest, AscendingInsertsFillLeaves) {
+  constexpr int num_keys = 3000;
+  constexpr int per_leaf = (PG_SIZE - PG_HEADER_SIZE) / (SLOT_SIZE + 100);
+  ASSERT_EQ(init_db(32), 0);
+  int64_t table_id = open_table(pathname);
+  ASSERT_GT(table_id, 0);
+
+  char val[112];
+  memset(val, 'v', sizeof(val));
+  for (int64_t key = 0; key < num_keys; ++key)
+    ASSERT_EQ(db_insert(table_id, key, val, 100), 0);
+  for (int64_t key = num_keys - 1; key >= num_keys - 1000; --key)
+    ASSERT_EQ(db_delete(table_id, key), 0);
+  for (int64_t key = num_keys - 1000; key < num_keys; ++key)
+    ASSERT_EQ(db_insert(table_id, key, val, 100), 0);
+  uint16_t size;
+  for (int64_t key = 0; key < num_keys; ++key)
+    ASSERT_EQ(db_find(table_id, key, val, &size), 0) << "key " << key;
+  ASSERT_EQ(shutdown_db(), 0);
+
+  FILE* file = fopen(pathname, "rb");
+  ASSERT_NE(file, nullptr);
+  auto read_page = [&](pagenum_t pagenum, Page* page) {
+    ASSERT_EQ(fseek(file, pagenum * PG_SIZE, SEEK_SET), 0);
+    ASSERT_EQ(fread(page, PG_SIZE, 1, file), 1u);
+  };
+  Page page;
+  read_page(0, &page);
+  pagenum_t pagenum =
+      GET_HEADER_ROOT_PAGE_NO(reinterpret_cast<HeaderPage*>(&page));
+  for (read_page(pagenum, &page); GET_IS_LEAF(&page) != 1;
+       read_page(pagenum, &page))
+    pagenum = INTERNAL_VAL(reinterpret_cast<InternalPage*>(&page), 0);
+
+  // Only the leaves left by the deletes and the last one are not full.
+  int num_leaves = 0, num_full = 0;
+  for (; pagenum != 0; ++num_leaves) {
+    read_page(pagenum, &page);
+    auto leaf = reinterpret_cast<LeafPage*>(&page);
+    num_full += GET_NUM_KEYS(leaf) == per_leaf;
+    pagenum = GET_LEAF_SIBLING(leaf);
+  }
+  EXPECT_LE(num_leaves, num_keys / per_leaf + 3);
+  EXPECT_GE(num_full, num_keys / per_leaf - 2);
+  fclose(file);
+}
+
+/*
+ * Internal pages in the older interleaved format are still read and
+ * updated next to pages in the separated format.
+ */
+TEST_F(BptTest, InterleavedInternalPages) {
+  constexpr int num_keys = 3001;
+  ASSERT_EQ(init_db(32), 0);
+  int64_t table_id = open_table(pathname);
+  ASSERT_GT(table_id, 0);
+  fill(table_id, num_keys);
+  ASSERT_EQ(shutdown_db(), 0);
+
+  // Rewrite every internal page in the interleaved format.
+  FILE* file = fopen(pathname, "r+b");
+  ASSERT_NE(file, nullptr);
+  Page page;
+  ASSERT_EQ(fread(&page, PG_SIZE, 1, file), 1u);
+  std::vector<pagenum_t> stack{
+      GET_HEADER_ROOT_PAGE_NO(reinterpret_cast<HeaderPage*>(&page))};
+  int num_internal = 0;
+  while (!stack.empty()) {
+    pagenum_t pagenum = stack.back();
+    stack.pop_back();
+    ASSERT_EQ(fseek(file, pagenum * PG_SIZE, SEEK_SET), 0);
+    ASSERT_EQ(fread(&page, PG_SIZE, 1, file), 1u);
+    if (GET_IS_LEAF(&page) == 1) continue;
+
+    auto internal = reinterpret_cast<InternalPage*>(&page);
+    ASSERT_EQ(GET_INTERNAL_FORMAT(internal), INTERNAL_SEPARATED);
+    InternalPage copy = *internal;
+    memset(internal->records, 0, sizeof(internal->records));
+    SET_INTERNAL_FORMAT(internal, INTERNAL_INTERLEAVED);
+    for (uint32_t i = 0; i <= GET_NUM_KEYS(internal); ++i) {
+      INTERNAL_VAL(internal, i) = INTERNAL_VAL(&copy, i);
+      if (i < GET_NUM_KEYS(internal))
+        INTERNAL_KEY(internal, i) = INTERNAL_KEY(&copy, i);
+      stack.push_back(INTERNAL_VAL(internal, i));
+    }
+    ASSERT_EQ(fseek(file, pagenum * PG_SIZE, SEEK_SET), 0);
+    ASSERT_EQ(fwrite(&page, PG_SIZE, 1, file), 1u);
+    num_internal++;
+  }
+  fclose(file);
+  ASSERT_GT(num_internal, 0);
+
+  ASSERT_EQ(init_db(32), 0);
+  table_id = open_table(pathname);
+  ASSERT_GT(table_id, 0);
+  char expected[112], val[112];
+  uint16_t size;
+  for (int64_t key = num_keys; key < 4 * num_keys; ++key) {
+    uint16_t expected_size = make_value(key, expected);
+    ASSERT_EQ(db_insert(table_id, key, expected, expected_size), 0);
+  }
+  for (int64_t key = 0; key < 4 * num_keys; ++key) {
+    uint16_t expected_size = make_value(key, expected);
+    ASSERT_EQ(db_find(table_id, key, val, &size), 0) << "key " << key;
+    ASSERT_EQ(size, expected_size);
+    ASSERT_EQ(memcmp(val, expected, size), 0);
+  }
+  ASSERT_EQ(shutdown_db(), 0);
+}
+
+/*
+ * Pins of the whole pool, taken and reset.
+ */
+static uint64_t take_pins() {
+  BufferStats stats;
+  buffer_get_stats(&stats);
+  buffer_reset_stats();
+  return stats.hits + stats.misses;
+}
+
+/*
+ * Splits and merges go up along the descent: past the pins a find of the
+ * same keys takes, an insert that splits a leaf pins little more than the
+ * new leaf, and a delete that merges little more than the neighbour. Going
+ * down again for them and pinning every parent and the header made it
+ * about 7 pins a split and 20 a merge.
+ */
+TEST_F(BptTest, SingleDescentWrites) {
+  constexpr int num_keys = 20011;  // prime
+  char val[112];
+  uint16_t size;
+
+  ASSERT_EQ(init_db(256), 0);
+  int64_t table_id = open_table(pathname);
+  ASSERT_GT(table_id, 0);
+  for (int64_t i = 0; i < num_keys; ++i) {
+    int64_t key = i * 7 % num_keys * 2;
+    ASSERT_EQ(db_insert(table_id, key, val, make_value(key, val)), 0);
+  }
+  ASSERT_EQ(shutdown_db(), 0);
+  int leaves_before = tree_levels(pathname)[0].first;
+
+  // odd keys between the even ones split most leaves once
+  ASSERT_EQ(init_db(256), 0);
+  table_id = open_table(pathname);
+  ASSERT_GT(table_id, 0);
+  take_pins();
+  for (int64_t i = 0; i < num_keys; ++i)
+    db_find(table_id, i * 7 % num_keys * 2 + 1, val, &size);
+  uint64_t find_pins = take_pins();
+  for (int64_t i = 0; i < num_keys; ++i) {
+    int64_t key = i * 7 % num_keys * 2 + 1;
+    ASSERT_EQ(db_insert(table_id, key, val, make_value(key, val)), 0);
+  }
+  uint64_t insert_pins = take_pins();
+  ASSERT_EQ(shutdown_db(), 0);
+  int leaves_after = tree_levels(pathname)[0].first;
+  int splits = leaves_after - leaves_before;
+  ASSERT_GT(splits, 0);
+  EXPECT_LT(insert_pins - find_pins, 3u * splits);
+
+  // deleting three keys of four merges most leaves
+  ASSERT_EQ(init_db(256), 0);
+  table_id = open_table(pathname);
+  ASSERT_GT(table_id, 0);
+  take_pins();
+  for (int64_t i = 0; i < 2 * num_keys; ++i) {
+    int64_t key = i * 7 % (2 * num_keys);
+    if (key % 4 != 0) db_find(table_id, key, val, &size);
+  }
+  find_pins = take_pins();
+  for (int64_t i = 0; i < 2 * num_keys; ++i) {
+    int64_t key = i * 7 % (2 * num_keys);
+    if (key % 4 != 0) ASSERT_EQ(db_delete(table_id, key), 0);
+  }
+  uint64_t delete_pins = take_pins();
+  ASSERT_EQ(shutdown_db(), 0);
+  int merges = leaves_after - tree_levels(pathname)[0].first;
+  ASSERT_GT(merges, 0);
+  EXPECT_LT(delete_pins - find_pins, 8u * merges);
+}
+
+/*
+ * Threads insert and delete interleaved keys in scattered order, so their
+ * splits and merges change the paths other threads descended and have to
+ * go down again. Every key ends up where it belongs.
+ */
+TEST_F(BptTest, ConcurrentSplitsAndMerges) {
+  constexpr int num_threads = 4;
+  constexpr int num_keys = 20011;  // prime
+  ASSERT_EQ(init_db(128), 0);
+  int64_t table_id = open_table(pathname);
+  ASSERT_GT(table_id, 0);
+
+  std::atomic<int> failures{0};
+  auto worker = [&](int t) {
+    char val[112];
+    // Thread t owns the keys equal to t modulo num_threads.
+    for (int64_t i = 0; i < num_keys; ++i) {
+      int64_t key = i * 7 % num_keys;
+      if (key % num_threads != t) continue;
+      if (db_insert(table_id, key, val, make_value(key, val)) != 0)
+        failures++;
+    }
+    // Then delete three keys of four of its own, and put half of them back.
+    for (int64_t i = 0; i < num_keys; ++i) {
+      int64_t key = i * 13 % num_keys;
+      if (key % num_threads != t || key / num_threads % 4 == 0) continue;
+      if (db_delete(table_id, key) != 0) failures++;
+    }
+    for (int64_t i = 0; i < num_keys; ++i) {
+      int64_t key = i * 11 % num_keys;
+      if (key % num_threads != t || key / num_threads % 4 != 2) continue;
+      if (db_insert(table_id, key, val, make_value(key, val)) != 0)
+        failures++;
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; ++t) threads.emplace_back(worker, t);
+  for (auto& thread : threads) thread.join();
+  EXPECT_EQ(failures, 0);
+
+  char expected[112], val[112];
+  uint16_t size;
+  for (int64_t key = 0; key < num_keys; ++key) {
+    int64_t quarter = key / num_threads % 4;
+    if (quarter == 1 || quarter == 3) {
+      EXPECT_NE(db_find(table_id, key, val, &size), 0) << "key " << key;
+      continue;
+    }
+    uint16_t expected_size = make_value(key, expected);
+    ASSERT_EQ(db_find(table_id, key, val, &size), 0) << "key " << key;
+    ASSERT_EQ(size, expected_size);
+    ASSERT_EQ(memcmp(val, expected, size), 0);
+  }
+  ASSERT_EQ(shutdown_db(), 0);
+
+  // one root, and no level lost a page on the way
+  auto levels = tree_levels(pathname);
+  ASSERT_FALSE(levels.empty());
+  EXPECT_EQ(levels.back().first, 1);
+}
+
+/*
+ * The binary and SIMD page searches find the same position as the linear
+ * one for every page size and internal page format, including keys below,
+ * between and above all keys.
+ */
+TEST(PageSearchTest, SearchesAgree) {
+  static InternalPage internal_page;
+  static LeafPage leaf_page;
+  std::mt19937_64 gen(1);
+
+  for (uint32_t format : {INTERNAL_SEPARATED, INTERNAL_INTERLEAVED}) {
+    SET_INTERNAL_FORMAT(&internal_page, format);
+    for (int num_keys = 0; num_keys < INTERNAL_ORDER; ++num_keys) {
+      int num_leaf_keys = num_keys % 65;
+      int64_t key = -100;
+      for (int i = 0; i < num_keys; ++i) {
+        key += 1 + gen() % 3;
+        INTERNAL_KEY(&internal_page, i) = key;
+        if (i < num_leaf_keys) LEAF_KEY(&leaf_page, i) = key;
+      }
+      for (int64_t target = -101; target <= key + 1; ++target) {
+        int expected = internal_upper_bound(&internal_page, num_keys, target,
+                                            PageSearch::LINEAR);
+        ASSERT_EQ(internal_upper_bound(&internal_page, num_keys, target,
+                                       PageSearch::BINARY), expected);
+        ASSERT_EQ(internal_upper_bound(&internal_page, num_keys, target,
+                                       PageSearch::SIMD), expected);
+        expected = leaf_lower_bound(&leaf_page, num_leaf_keys, target,
+                                    PageSearch::LINEAR);
+        ASSERT_EQ(leaf_lower_bound(&leaf_page, num_leaf_keys, target,
+                                   PageSearch::BINARY), expected);
+      }
+    }
+  }
+}
@@ -0,0 +1,1134 @@
+#include "buffer.h"
+#include "file.h"
+#include "free_space_map.h"
+#include "page_table.h"
+#include "replacer.h"
+
+#include <gtest/gtest.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <vector>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+
+/*
+ * TestFixture for the buffer manager.
+ * Each test starts from a fresh table file and a small buffer pool.
+ */
+class BufferTest : public ::testing::TestWithParam<ReplacePolicy> {
+ protected:
+  BufferTest() {
+    remove(pathname.c_str());
+    open_disk_manager();
+    init_buffer(num_buf, GetParam());
+    table_id = file_open_table_file(pathname.c_str());
+  }
+
+  ~BufferTest() {
+    shutdown_buffer();
+    close_disk_manager();
+    remove(pathname.c_str());
+  }
+
+  static constexpr int num_buf = 4;
+  int64_t table_id;
+  std::string pathname = "buffer_test.db";
+};
+
+/*
+ * A guard points straight into the frame, so two guards on the same page
+ * see each other's changes without any copy.
+ */
+TEST_P(BufferTest, GuardSharesFrame) {
+  pagenum_t pagenum = buffer_alloc_page(table_id);
+
+  PageGuard first(table_id, pagenum);
+  PageGuard second(table_id, pagenum);
+  ASSERT_TRUE(first);
+  ASSERT_TRUE(second);
+  EXPECT_EQ(first.get(), second.get());
+  EXPECT_EQ(first.page_no(), pagenum);
+
+  first->p.s[0] = 'x';
+  EXPECT_EQ(second->p.s[0], 'x');
+}
+
+/*
+ * Dirty pages survive eviction: touch more pages than there are frames and
+ * read the first one back.
+ */
+TEST_P(BufferTest, DirtyPageSurvivesEviction) {
+  pagenum_t pagenum = buffer_alloc_page(table_id);
+  {
+    PageGuard page(table_id, pagenum);
+    memset(page->p.s, 'a', PG_SIZE);
+    page.mark_dirty();
+  }
+
+  for (int i = 0; i < num_buf * 2; ++i) {
+    PageGuard other(table_id, buffer_alloc_page(table_id));
+    ASSERT_TRUE(other);
+  }
+
+  PageGuard page(table_id, pagenum);
+  ASSERT_TRUE(page);
+  for (size_t i = 0; i < PG_SIZE; ++i) {
+    ASSERT_EQ(page->p.s[i], 'a') << "byte " << i << " differs";
+  }
+}
+
+/*
+ * Moving a guard hands over the pin; the moved-from guard is empty.
+ */
+TEST_P(BufferTest, GuardMove) {
+  PageGuard page(table_id, 0);
+  Page* frame = page.get();
+
+  PageGuard moved(std::move(page));
+  EXPECT_FALSE(page);
+  EXPECT_EQ(moved.get(), frame);
+
+  moved.release();
+  EXPECT_FALSE(moved);
+}
+
+/*
+ * When every frame is pinned a miss fails instead of evicting a pinned page,
+ * and it succeeds again once a frame is unpinned.
+ */
+TEST_P(BufferTest, AllPinned) {
+  std::vector<PageGuard> guards;
+  for (int i = 0; i < num_buf; ++i) {
+    guards.emplace_back(table_id, buffer_alloc_page(table_id));
+    ASSERT_TRUE(guards.back());
+  }
+
+  pagenum_t pagenum = buffer_alloc_page(table_id);
+  EXPECT_FALSE(PageGuard(table_id, pagenum));
+
+  guards.pop_back();
+  EXPECT_TRUE(PageGuard(table_id, pagenum));
+}
+
+/*
+ * A page that cannot be read is not cached: the pin fails, and its frame
+ * goes back to the pool.
+ */
+TEST_P(BufferTest, ReadError) {
+  pagenum_t past_end = file_num_pages(table_id) + 10;
+  EXPECT_FALSE(PageGuard(table_id, past_end));
+  EXPECT_FALSE(PageGuard(table_id, past_end));
+
+  std::vector<PageGuard> guards;
+  for (int i = 0; i < num_buf; ++i) {
+    guards.emplace_back(table_id, buffer_alloc_page(table_id));
+    ASSERT_TRUE(guards.back());
+  }
+}
+
+/*
+ * The flusher writes dirty unpinned pages back on its own once the dirty
+ * ratio crosses the high watermark.
+ */
+TEST_P(BufferTest, FlusherWritesBack) {
+  pagenum_t pagenums[3];
+  for (auto& pagenum : pagenums) {
+    pagenum = buffer_alloc_page(table_id);
+    PageGuard guard(table_id, pagenum);
+    ASSERT_TRUE(guard);
+    guard->p.s[0] = 'f';
+    guard.mark_dirty();
+  }
+
+  ASSERT_EQ(buffer_start_flusher(0.5, 0.0, 10), 0);
+
+  Page page;
+  for (auto pagenum : pagenums) {
+    for (int i = 0; i < 200; ++i) {
+      file_read_page(table_id, pagenum, &page);
+      if (page.p.s[0] == 'f') break;
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(page.p.s[0], 'f');
+  }
+  buffer_stop_flusher();
+}
+
+/*
+ * Reader threads pin pages concurrently; misses are read without the pool
+ * latch, and every guard still sees its own page.
+ */
+TEST_P(BufferTest, ConcurrentReaders) {
+  std::vector<pagenum_t> pagenums(32);
+  for (size_t i = 0; i < pagenums.size(); ++i) {
+    pagenums[i] = buffer_alloc_page(table_id);
+    PageGuard guard(table_id, pagenums[i]);
+    ASSERT_TRUE(guard);
+    guard->p.s[0] = 'A' + i;
+    guard.mark_dirty();
+  }
+
+  std::atomic<int> errors {0};
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 4; ++t) {
+    readers.emplace_back([&, t]() {
+      std::mt19937 gen(t);
+      for (int i = 0; i < 2000; ++i) {
+        size_t k = gen() % pagenums.size();
+        PageGuard guard(table_id, pagenums[k]);
+        if (!guard) continue;  // every frame pinned by the others
+        if (guard->p.s[0] != (char)('A' + k) || guard.page_no() != pagenums[k])
+          errors++;
+      }
+    });
+  }
+  for (auto& reader : readers) reader.join();
+  EXPECT_EQ(errors, 0);
+}
+
+INSTANTIATE_TEST_SUITE_P(Policies, BufferTest,
+    ::testing::Values(ReplacePolicy::LRU, ReplacePolicy::CLOCK,
+                      ReplacePolicy::CLOCK_PRO, ReplacePolicy::TWO_Q,
+                      ReplacePolicy::ARC));
+
+/*
+ * A partitioned pool: pages spread over every partition, evicted pages come
+ * back intact, and the frame latch keeps concurrent writers of one page
+ * apart.
+ */
+class PartitionTest : public ::testing::TestWithParam<ReplacePolicy> {
+ protected:
+  PartitionTest() {
+    remove(pathname.c_str());
+    open_disk_manager(SyncMode::DEFERRED);
+    init_buffer(num_buf, GetParam(), false, num_partitions);
+    table_id = file_open_table_file(pathname.c_str());
+  }
+
+  ~PartitionTest() {
+    shutdown_buffer();
+    close_disk_manager();
+    remove(pathname.c_str());
+  }
+
+  static constexpr int num_buf = 64;
+  static constexpr int num_partitions = 8;
+  int64_t table_id;
+  std::string pathname = "partition_test.db";
+};
+
+TEST_P(PartitionTest, PagesSurviveEviction) {
+  EXPECT_EQ(buffer_num_partitions(), num_partitions);
+
+  std::vector<pagenum_t> pagenums(8 * num_buf);
+  for (size_t i = 0; i < pagenums.size(); ++i) {
+    pagenums[i] = buffer_alloc_page(table_id);
+    PageGuard guard(table_id, pagenums[i], LatchMode::EXCLUSIVE);
+    ASSERT_TRUE(guard);
+    memcpy(guard->p.s, &i, sizeof(i));
+    guard.mark_dirty();
+  }
+  for (size_t i = 0; i < pagenums.size(); ++i) {
+    PageGuard guard(table_id, pagenums[i], LatchMode::SHARED);
+    ASSERT_TRUE(guard);
+    size_t value;
+    memcpy(&value, guard->p.s, sizeof(value));
+    EXPECT_EQ(value, i);
+  }
+}
+
+TEST_P(PartitionTest, ExclusiveLatch) {
+  pagenum_t pagenum = buffer_alloc_page(table_id);
+  std::vector<pagenum_t> others(2 * num_buf);
+  for (auto& other : others) other = buffer_alloc_page(table_id);
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&, t]() {
+      std::mt19937 gen(t);
+      for (int i = 0; i < 1000; ++i) {
+        {
+          PageGuard guard(table_id, pagenum, LatchMode::EXCLUSIVE);
+          if (!guard) continue;
+          uint64_t count;
+          memcpy(&count, guard->p.s, sizeof(count));
+          count++;
+          memcpy(guard->p.s, &count, sizeof(count));
+          guard.mark_dirty();
+        }
+        // churn the other partitions meanwhile
+        PageGuard other(table_id, others[gen() % others.size()],
+                        LatchMode::SHARED);
+      }
+    });
+  }
+  for (auto& thread : threads) thread.join();
+
+  PageGuard guard(table_id, pagenum, LatchMode::SHARED);
+  ASSERT_TRUE(guard);
+  uint64_t count;
+  memcpy(&count, guard->p.s, sizeof(count));
+  EXPECT_EQ(count, 4000u);
+}
+
+TEST_P(PartitionTest, PinsSpillOver) {
+  // as many threads as partitions, together pinning most of the pool, so
+  // that some partitions get more pins than frames
+  constexpr int pins_per_thread = num_buf / num_partitions - 1;
+  constexpr int rounds = 8;
+  std::vector<pagenum_t> pagenums(4 * num_buf);
+  for (size_t i = 0; i < pagenums.size(); ++i) {
+    pagenums[i] = buffer_alloc_page(table_id);
+    PageGuard guard(table_id, pagenums[i], LatchMode::EXCLUSIVE);
+    ASSERT_TRUE(guard);
+    memcpy(guard->p.s, &i, sizeof(i));
+    guard.mark_dirty();
+  }
+
+  std::atomic<int> failed{0};
+  std::atomic<int> pinned{0};
+  std::mt19937 gen(1);
+  std::vector<size_t> order(pagenums.size());
+  for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+  for (int r = 0; r < rounds; ++r) {
+    std::shuffle(order.begin(), order.end(), gen);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_partitions; ++t) {
+      threads.emplace_back([&, r, t]() {
+        std::vector<PageGuard> guards;
+        for (int i = 0; i < pins_per_thread; ++i) {
+          size_t n = order[t * pins_per_thread + i];
+          PageGuard guard(table_id, pagenums[n]);
+          if (!guard) {
+            failed++;
+            continue;
+          }
+          size_t value;
+          memcpy(&value, guard->p.s, sizeof(value));
+          if (value != n) failed++;
+          guards.push_back(std::move(guard));
+        }
+        // hold the pins until every thread has its own
+        pinned++;
+        while (pinned < (r + 1) * num_partitions) std::this_thread::yield();
+      });
+    }
+    for (auto& thread : threads) thread.join();
+  }
+  EXPECT_EQ(failed, 0);
+
+  // pages that spilled are found again, and their frames are reused
+  for (size_t i = 0; i < pagenums.size(); ++i) {
+    PageGuard guard(table_id, pagenums[i], LatchMode::SHARED);
+    ASSERT_TRUE(guard);
+    size_t value;
+    memcpy(&value, guard->p.s, sizeof(value));
+    EXPECT_EQ(value, i);
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(Policies, PartitionTest,
+    ::testing::Values(ReplacePolicy::LRU, ReplacePolicy::CLOCK,
+                      ReplacePolicy::CLOCK_PRO, ReplacePolicy::TWO_Q,
+                      ReplacePolicy::ARC));
+
+/*
+ * Drive a policy with random hits, misses and pins the way the buffer
+ * manager does, and check every victim is a cached, unpinned frame.
+ */
+class ReplacerTest : public ::testing::TestWithParam<ReplacePolicy> {};
+
+TEST_P(ReplacerTest, VictimIsCachedAndUnpinned) {
+  constexpr int num_buf = 16;
+  ControlBlock cb[num_buf] = {};
+  auto replacer = make_replacer(GetParam(), cb, num_buf);
+  std::map<pagenum_t, int> cached;
+  std::set<int> used;
+  std::mt19937 gen(11);
+
+  for (int round = 0; round < 50000; ++round) {
+    // Skewed references: a hot set of 8 pages and a long cold tail.
+    pagenum_t pagenum = gen() % 4 ? gen() % 8 : 8 + gen() % 200;
+    auto it = cached.find(pagenum);
+
+    if (it != cached.end()) {
+      replacer->on_access(it->second);
+    } else {
+      int buf_index;
+      if ((int)used.size() < num_buf) {
+        buf_index = used.size();
+      } else {
+        buf_index = replacer->pick_victim();
+        ASSERT_NE(buf_index, -1);
+        ASSERT_EQ(cb[buf_index].is_pinned, 0u);
+        ASSERT_EQ(cached.erase(cb[buf_index].page_num), 1u);
+      }
+      used.insert(buf_index);
+      cb[buf_index].table_id = 1;
+      cb[buf_index].page_num = pagenum;
+      cached[pagenum] = buf_index;
+      replacer->on_insert(buf_index);
+    }
+
+    // Pin or unpin a random frame, keeping at least one frame unpinned.
+    int x = gen() % num_buf;
+    if (cb[x].is_pinned) cb[x].is_pinned = 0;
+    else if (x != 0) cb[x].is_pinned = gen() % 8 == 0;
+  }
+
+  for (int i = 0; i < num_buf; ++i) cb[i].is_pinned = 1;
+  EXPECT_EQ(replacer->pick_victim(), -1);
+}
+
+/*
+ * pick_clean_victim() passes over dirty frames and leaves them in the
+ * policy, so every one of them is still a victim afterwards.
+ */
+TEST_P(ReplacerTest, CleanVictimSkipsDirty) {
+  constexpr int num_buf = 16;
+  ControlBlock cb[num_buf] = {};
+  auto replacer = make_replacer(GetParam(), cb, num_buf);
+  for (int i = 0; i < num_buf; ++i) {
+    cb[i].table_id = 1;
+    cb[i].page_num = i;
+    cb[i].is_dirty = i != 5;
+    replacer->on_insert(i);
+  }
+  for (int i = 0; i < num_buf; i += 3) replacer->on_access(i);
+
+  EXPECT_EQ(replacer->pick_clean_victim(), 5);
+  EXPECT_EQ(replacer->pick_clean_victim(), -1);
+
+  std::set<int> victims;
+  for (int i = 0; i < num_buf - 1; ++i) victims.insert(replacer->pick_victim());
+  EXPECT_EQ(victims.size(), (size_t)num_buf - 1);
+  EXPECT_EQ(victims.count(-1), 0u);
+  EXPECT_EQ(victims.count(5), 0u);
+}
+
+INSTANTIATE_TEST_SUITE_P(Policies, ReplacerTest,
+    ::testing::Values(ReplacePolicy::LRU, ReplacePolicy::CLOCK,
+                      ReplacePolicy::CLOCK_PRO, ReplacePolicy::TWO_Q,
+                      ReplacePolicy::ARC));
+
+/*
+ * A hot set referenced between the pages of a long sweep stays cached with
+ * the scan-resistant policies, while plain LRU loses it on every sweep.
+ */
+class ScanResistantTest : public ::testing::TestWithParam<ReplacePolicy> {};
+
+TEST_P(ScanResistantTest, HotSetSurvivesSweep) {
+  constexpr int num_buf = 16;
+  constexpr int num_hot = 4;
+  ControlBlock cb[num_buf] = {};
+  auto replacer = make_replacer(GetParam(), cb, num_buf);
+  std::map<pagenum_t, int> cached;
+  int used = 0, hot_refs = 0, hot_misses = 0;
+
+  auto reference = [&](pagenum_t pagenum) {
+    auto it = cached.find(pagenum);
+    if (it != cached.end()) {
+      replacer->on_access(it->second);
+      return true;
+    }
+    int buf_index = used;
+    if (used < num_buf) {
+      used++;
+    } else {
+      buf_index = replacer->pick_victim();
+      if (buf_index == -1) return false;
+      cached.erase(cb[buf_index].page_num);
+    }
+    cb[buf_index].page_num = pagenum;
+    cached[pagenum] = buf_index;
+    replacer->on_insert(buf_index);
+    return false;
+  };
+
+  // Warm up: the hot pages are referenced among a small cold working set.
+  for (int i = 0; i < 200; ++i) {
+    reference(i % num_hot);
+    reference(100 + i % 40);
+  }
+
+  // One hot reference per 5 sweep pages: a reuse distance above num_buf.
+  for (pagenum_t pagenum = 1000; pagenum < 6000; ++pagenum) {
+    reference(pagenum);
+    if (pagenum % 5 == 0) {
+      hot_refs++;
+      if (!reference(pagenum / 5 % num_hot)) hot_misses++;
+    }
+  }
+
+  EXPECT_LT(hot_misses * 10, hot_refs);
+}
+
+INSTANTIATE_TEST_SUITE_P(Policies, ScanResistantTest,
+    ::testing::Values(ReplacePolicy::CLOCK_PRO, ReplacePolicy::TWO_Q,
+                      ReplacePolicy::ARC));
+
+/*
+ * A batch write with gaps between runs lands every page at its own offset,
+ * in each sync mode.
+ */
+class WriteBatchTest : public ::testing::TestWithParam<SyncMode> {};
+
+TEST_P(WriteBatchTest, PagesLandInPlace) {
+  const char* pathname = "write_batch_test.db";
+  remove(pathname);
+  ASSERT_EQ(open_disk_manager(GetParam()), 0);
+  int64_t table_id = file_open_table_file(pathname);
+
+  std::vector<pagenum_t> pagenums = {3, 4, 5, 9, 10, 20};
+  std::vector<Page> pages(pagenums.size());
+  std::vector<const Page*> srcs;
+  for (size_t i = 0; i < pages.size(); ++i) {
+    memset(&pages[i], 'a' + i, PG_SIZE);
+    srcs.push_back(&pages[i]);
+  }
+  file_write_batch(table_id, pagenums.data(), srcs.data(), srcs.size());
+  EXPECT_EQ(file_sync_table(table_id), 0);
+
+  Page page;
+  for (size_t i = 0; i < pages.size(); ++i) {
+    file_read_page(table_id, pagenums[i], &page);
+    EXPECT_EQ(memcmp(page.p.s, pages[i].p.s, PG_SIZE), 0);
+  }
+  // the pages between the runs are untouched
+  file_read_page(table_id, 6, &page);
+  EXPECT_EQ(GET_FREE_NEXT_PAGE_NO(&page), 0u);
+
+  close_disk_manager();
+  remove(pathname);
+}
+
+INSTANTIATE_TEST_SUITE_P(Modes, WriteBatchTest,
+    ::testing::Values(SyncMode::PER_WRITE, SyncMode::PER_BATCH,
+                      SyncMode::DEFERRED));
+
+/*
+ * Pages go through either I/O backend unchanged, and prefetched pages are
+ * hits once their reads complete.
+ */
+class IoBackendTest : public ::testing::TestWithParam<IoBackendType> {
+ protected:
+  IoBackendTest() {
+    remove(pathname.c_str());
+    open_disk_manager(SyncMode::PER_BATCH, GetParam());
+    init_buffer(num_buf);
+    table_id = file_open_table_file(pathname.c_str());
+  }
+
+  ~IoBackendTest() {
+    shutdown_buffer();
+    close_disk_manager();
+    remove(pathname.c_str());
+  }
+
+  // Write page i of 2 * num_buf pages, evicting as it goes.
+  void fill(std::vector<pagenum_t>& pagenums) {
+    for (int i = 0; i < 2 * num_buf; ++i) {
+      pagenums.push_back(buffer_alloc_page(table_id));
+      PageGuard guard(table_id, pagenums.back());
+      ASSERT_TRUE(guard);
+      memset(guard->p.s, 'a' + i, PG_SIZE);
+      guard.mark_dirty();
+    }
+  }
+
+  static constexpr int num_buf = 8;
+  int64_t table_id;
+  std::string pathname = "io_backend_test.db";
+};
+
+TEST_P(IoBackendTest, RoundTrip) {
+  std::vector<pagenum_t> pagenums;
+  fill(pagenums);
+
+  for (size_t i = 0; i < pagenums.size(); ++i) {
+    PageGuard guard(table_id, pagenums[i]);
+    ASSERT_TRUE(guard);
+    EXPECT_EQ(guard->p.s[0], (char)('a' + i));
+    EXPECT_EQ(guard->p.s[PG_SIZE - 1], (char)('a' + i));
+  }
+}
+
+TEST_P(IoBackendTest, Prefetch) {
+  std::vector<pagenum_t> pagenums;
+  fill(pagenums);
+  ASSERT_EQ(buffer_flush_table(table_id), 0);
+
+  // the first half was evicted by the second
+  EXPECT_EQ(buffer_prefetch(table_id, pagenums.data(), num_buf), num_buf);
+  buffer_reset_stats();
+  for (int i = 0; i < num_buf; ++i) {
+    PageGuard guard(table_id, pagenums[i]);
+    ASSERT_TRUE(guard);
+    EXPECT_EQ(guard->p.s[0], (char)('a' + i));
+  }
+
+  BufferStats stats;
+  buffer_get_stats(&stats);
+  EXPECT_EQ(stats.hits, (uint64_t)num_buf);
+  EXPECT_EQ(stats.misses, 0u);
+}
+
+INSTANTIATE_TEST_SUITE_P(Backends, IoBackendTest,
+    ::testing::Values(IoBackendType::POSIX, IoBackendType::IO_URING));
+
+/*
+ * A scan along the leaf sibling chain is read ahead, whether the leaves are
+ * laid out in chain order or not; random leaf pins read nothing ahead.
+ */
+class ReadAheadTest : public ::testing::TestWithParam<IoBackendType> {
+ protected:
+  ReadAheadTest() {
+    remove(pathname.c_str());
+    open_disk_manager(SyncMode::PER_BATCH, GetParam());
+    init_buffer(num_buf);
+    table_id = file_open_table_file(pathname.c_str());
+    for (int i = 0; i < num_leaves; ++i)
+      pagenums.push_back(file_alloc_page(table_id));
+  }
+
+  ~ReadAheadTest() {
+    shutdown_buffer();
+    close_disk_manager();
+    remove(pathname.c_str());
+  }
+
+  // Write the leaves straight to the file, chained in the given order.
+  void chain(const std::vector<pagenum_t>& order) {
+    for (size_t i = 0; i < order.size(); ++i) {
+      Page page = {};
+      SET_IS_LEAF(&page, 1);
+      SET_LEAF_SIBLING(reinterpret_cast<LeafPage*>(&page),
+                       i + 1 < order.size() ? order[i + 1] : 0);
+      file_write_page(table_id, order[i], &page);
+    }
+  }
+
+  // Follow the chain from pagenum and return the number of leaves.
+  int scan(pagenum_t pagenum) {
+    int count = 0;
+    while (pagenum != 0) {
+      PageGuard guard(table_id, pagenum);
+      if (!guard) return -1;
+      pagenum = GET_LEAF_SIBLING(guard.as<LeafPage>());
+      count++;
+    }
+    return count;
+  }
+
+  static constexpr int num_buf = 64;
+  static constexpr int num_leaves = 256;
+  int64_t table_id;
+  std::vector<pagenum_t> pagenums;
+  std::string pathname = "read_ahead_test.db";
+};
+
+TEST_P(ReadAheadTest, SequentialChain) {
+  chain(pagenums);
+  buffer_reset_stats();
+  EXPECT_EQ(scan(pagenums[0]), num_leaves);
+
+  BufferStats stats;
+  buffer_get_stats(&stats);
+  EXPECT_LE(stats.misses, 2u);
+  EXPECT_GE(stats.read_ahead, (uint64_t)num_leaves - 2);
+}
+
+TEST_P(ReadAheadTest, ShuffledChain) {
+  std::vector<pagenum_t> order(pagenums);
+  std::shuffle(order.begin(), order.end(), std::mt19937(7));
+  chain(order);
+  buffer_reset_stats();
+  EXPECT_EQ(scan(order[0]), num_leaves);
+
+  BufferStats stats;
+  buffer_get_stats(&stats);
+  EXPECT_LE(stats.misses, 2u);
+}
+
+TEST_P(ReadAheadTest, RandomPins) {
+  chain(pagenums);
+  buffer_reset_stats();
+  for (int i = 0; i < num_leaves; ++i) {
+    PageGuard guard(table_id, pagenums[(i * 37) % num_leaves]);
+    ASSERT_TRUE(guard);
+  }
+
+  BufferStats stats;
+  buffer_get_stats(&stats);
+  EXPECT_EQ(stats.read_ahead, 0u);
+  EXPECT_EQ(stats.misses, (uint64_t)num_leaves);
+}
+
+/*
+ * pread(2) of the test binary. Reads at or past slow_reads_from take
+ * SLOW_READ, like a cold disk.
+ */
+static std::atomic<off_t> slow_reads_from(-1);
+constexpr auto SLOW_READ = std::chrono::milliseconds(100);
+
+extern "C" ssize_t pread(int fd, void* buf, size_t count, off_t offset) {
+  off_t from = slow_reads_from;
+  if (from >= 0 && offset >= from) std::this_thread::sleep_for(SLOW_READ);
+  return syscall(SYS_pread64, fd, buf, count, offset);
+}
+
+/* A pin that starts read-ahead does not wait for it. */
+TEST_P(ReadAheadTest, PinDoesNotWait) {
+  chain(pagenums);
+  slow_reads_from = pagenums[2] * PG_SIZE;
+  {
+    PageGuard first(table_id, pagenums[0]);
+    ASSERT_TRUE(first);
+  }
+  auto start = std::chrono::steady_clock::now();
+  {
+    PageGuard second(table_id, pagenums[1]);  // reads 2.. ahead
+    ASSERT_TRUE(second);
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  EXPECT_LT(elapsed, SLOW_READ);
+
+  BufferStats stats;
+  buffer_get_stats(&stats);
+  EXPECT_GT(stats.read_ahead, 0u);
+  slow_reads_from = -1;
+  // the pages read ahead are there once their reads are done
+  EXPECT_EQ(scan(pagenums[2]), num_leaves - 2);
+}
+
+TEST_P(ReadAheadTest, SiblingPastEnd) {
+  std::vector<pagenum_t> order(pagenums.begin(), pagenums.begin() + 2);
+  chain(order);
+  Page page = {};
+  SET_IS_LEAF(&page, 1);
+  SET_LEAF_SIBLING(reinterpret_cast<LeafPage*>(&page),
+                   file_num_pages(table_id) + 1000);
+  file_write_page(table_id, order[1], &page);
+  buffer_reset_stats();
+  for (pagenum_t pagenum : order) {
+    PageGuard guard(table_id, pagenum);
+    ASSERT_TRUE(guard);
+  }
+
+  BufferStats stats;
+  buffer_get_stats(&stats);
+  EXPECT_EQ(stats.read_ahead, 0u);
+}
+
+INSTANTIATE_TEST_SUITE_P(Backends, ReadAheadTest,
+    ::testing::Values(IoBackendType::POSIX, IoBackendType::IO_URING));
+
+/*
+ * With warm_restart, the pages cached at shutdown are in the dump most
+ * recently used first, and are hits after the next open has loaded it.
+ */
+TEST(WarmRestartTest, DumpAndLoad) {
+  const char* pathname = "warm_restart_test.db";
+  std::string dump = std::string(pathname) + ".bufdump";
+  constexpr int num_buf = 8;
+  remove(pathname);
+  remove(dump.c_str());
+
+  ASSERT_EQ(open_disk_manager(), 0);
+  ASSERT_EQ(init_buffer(num_buf, ReplacePolicy::LRU, true), 0);
+  int64_t table_id = file_open_table_file(pathname);
+  std::vector<pagenum_t> pagenums;
+  for (int i = 0; i < num_buf; ++i) {
+    pagenums.push_back(buffer_alloc_page(table_id));
+    PageGuard guard(table_id, pagenums.back());
+    ASSERT_TRUE(guard);
+    memset(guard->p.s, 'a' + i, PG_SIZE);
+    guard.mark_dirty();
+  }
+  { PageGuard guard(table_id, pagenums[2]); }
+  shutdown_buffer();
+  close_disk_manager();
+
+  std::ifstream in(dump, std::ios::binary);
+  ASSERT_TRUE(in);
+  uint64_t head[2];
+  pagenum_t first;
+  in.read(reinterpret_cast<char*>(head), sizeof(head));
+  in.read(reinterpret_cast<char*>(&first), sizeof(first));
+  in.close();
+  EXPECT_EQ(head[1], (uint64_t)num_buf);
+  EXPECT_EQ(first, pagenums[2]);
+
+  ASSERT_EQ(open_disk_manager(), 0);
+  ASSERT_EQ(init_buffer(num_buf, ReplacePolicy::LRU, true), 0);
+  table_id = file_open_table_file(pathname);
+  EXPECT_EQ(buffer_load_dump(table_id), num_buf);
+  EXPECT_NE(access(dump.c_str(), F_OK), 0);
+  buffer_wait_warmup();
+
+  buffer_reset_stats();
+  for (int i = 0; i < num_buf; ++i) {
+    PageGuard guard(table_id, pagenums[i]);
+    ASSERT_TRUE(guard);
+    EXPECT_EQ(guard->p.s[0], (char)('a' + i));
+  }
+  BufferStats stats;
+  buffer_get_stats(&stats);
+  EXPECT_EQ(stats.hits, (uint64_t)num_buf);
+  EXPECT_EQ(stats.misses, 0u);
+  shutdown_buffer();
+  close_disk_manager();
+
+  remove(pathname);
+  remove(dump.c_str());
+}
+
+/*
+ * The two-level bitmap finds the same free page as a linear search over a
+ * std::set, across growth and wrap-around.
+ */
+TEST(FreeSpaceMapTest, MatchesSet) {
+  FreeSpaceMap map(100);
+  std::set<pagenum_t> used;
+  std::mt19937 gen(5);
+  map.set_used(0);
+  used.insert(0);
+
+  for (int round = 0; round < 20000; ++round) {
+    if (round % 5000 == 4999) map.resize(map.size() * 3 + 7);
+    pagenum_t hint = gen() % map.size();
+    pagenum_t expected = 0;
+    for (pagenum_t i = 0; i < map.size(); ++i) {
+      pagenum_t pagenum = (hint + i) % map.size();
+      if (!used.count(pagenum)) { expected = pagenum; break; }
+    }
+    ASSERT_EQ(map.find_free(hint), expected);
+
+    if (expected != 0 && gen() % 3 != 0) {
+      map.set_used(expected);
+      used.insert(expected);
+    } else if (used.size() > 1) {
+      auto it = used.upper_bound(gen() % map.size());
+      if (it == used.end()) it = std::next(used.begin());
+      map.set_free(*it);
+      used.erase(it);
+    }
+    ASSERT_EQ(map.num_free(), map.size() - used.size());
+  }
+}
+
+/*
+ * Pages come from the in-memory free-space map: in file order, freed pages
+ * are reused, and the file doubles with fallocate when it is full.
+ */
+TEST(FreeSpaceMapTest, AllocAndGrow) {
+  const char* pathname = "free_space_map_test.db";
+  struct stat st;
+  remove(pathname);
+  ASSERT_EQ(open_disk_manager(SyncMode::PER_BATCH), 0);
+  int64_t table_id = file_open_table_file(pathname);
+  ASSERT_EQ(stat(pathname, &st), 0);
+  EXPECT_EQ(st.st_size, 2560 * (off_t)PG_SIZE);
+
+  // page 1 is the map page
+  for (pagenum_t pagenum = 2; pagenum < 2560; ++pagenum)
+    ASSERT_EQ(file_alloc_page(table_id), pagenum);
+  file_free_page(table_id, 7);
+  EXPECT_EQ(file_alloc_page(table_id), 7u);
+
+  EXPECT_EQ(file_alloc_page(table_id), 2560u);
+  ASSERT_EQ(stat(pathname, &st), 0);
+  EXPECT_EQ(st.st_size, 2 * 2560 * (off_t)PG_SIZE);
+  file_free_page(table_id, 100);
+  close_disk_manager();
+
+  // the map saved at close is loaded as is
+  ASSERT_EQ(open_disk_manager(SyncMode::PER_BATCH), 0);
+  table_id = file_open_table_file(pathname);
+  HeaderPage header;
+  file_read_page(table_id, 0, reinterpret_cast<Page*>(&header));
+  EXPECT_EQ(GET_HEADER_NUM_OF_PAGES(&header), 2 * 2560u);
+  EXPECT_EQ(file_alloc_page(table_id), 100u);
+  EXPECT_EQ(file_alloc_page(table_id), 2561u);
+
+  close_disk_manager();
+  remove(pathname);
+}
+
+/*
+ * Hinted allocations follow their hint and keep their extents to
+ * themselves; the other allocations go around them.
+ */
+TEST(FreeSpaceMapTest, HintedAllocation) {
+  const char* pathname = "free_space_map_test.db";
+  remove(pathname);
+  ASSERT_EQ(open_disk_manager(SyncMode::PER_BATCH), 0);
+  int64_t table_id = file_open_table_file(pathname);
+
+  pagenum_t first = file_alloc_page(table_id);
+  EXPECT_EQ(first, 2u);
+  EXPECT_EQ(file_alloc_page(table_id, first), 3u);
+  // extent [0, 64) now belongs to the chain
+  EXPECT_EQ(file_alloc_page(table_id), EXTENT_PAGES);
+
+  pagenum_t pagenum = 3;
+  while (pagenum + 1 < EXTENT_PAGES) {
+    ASSERT_EQ(file_alloc_page(table_id, pagenum), pagenum + 1);
+    pagenum++;
+  }
+  // the chain moves on to the next empty extent
+  EXPECT_EQ(file_alloc_page(table_id, pagenum), 2 * EXTENT_PAGES);
+  EXPECT_EQ(file_alloc_page(table_id, 2 * EXTENT_PAGES), 2 * EXTENT_PAGES + 1);
+  EXPECT_EQ(file_alloc_page(table_id), EXTENT_PAGES + 1);
+
+  close_disk_manager();
+  remove(pathname);
+}
+
+/*
+ * A map that was not saved clean is rebuilt from the tree: pages allocated
+ * but never linked into it are free again.
+ */
+TEST(FreeSpaceMapTest, RebuildAfterCrash) {
+  const char* pathname = "free_space_map_test.db";
+  const char* crashed = "free_space_map_crashed.db";
+  remove(pathname);
+  remove(crashed);
+  ASSERT_EQ(open_disk_manager(SyncMode::PER_BATCH), 0);
+  int64_t table_id = file_open_table_file(pathname);
+
+  // root 2 -> leaves 3, 4; page 5 is allocated but unused
+  pagenum_t pagenums[4];
+  for (auto& pagenum : pagenums) pagenum = file_alloc_page(table_id);
+  Page page = {};
+  InternalPage* root = reinterpret_cast<InternalPage*>(&page);
+  SET_NUM_KEYS(root, 1);
+  INTERNAL_VAL(root, 0) = pagenums[1];
+  INTERNAL_VAL(root, 1) = pagenums[2];
+  file_write_page(table_id, pagenums[0], &page);
+  page = {};
+  SET_IS_LEAF(&page, 1);
+  file_write_page(table_id, pagenums[1], &page);
+  file_write_page(table_id, pagenums[2], &page);
+  HeaderPage header;
+  file_read_page(table_id, 0, reinterpret_cast<Page*>(&header));
+  SET_HEADER_ROOT_PAGE_NO(&header, pagenums[0]);
+  file_write_page(table_id, 0, reinterpret_cast<Page*>(&header));
+  ASSERT_EQ(file_sync_table(table_id), 0);
+
+  // copy the file as a crash would leave it
+  {
+    std::ifstream src(pathname, std::ios::binary);
+    std::ofstream dst(crashed, std::ios::binary);
+    dst << src.rdbuf();
+  }
+  close_disk_manager();
+
+  ASSERT_EQ(open_disk_manager(SyncMode::PER_BATCH), 0);
+  table_id = file_open_table_file(crashed);
+  EXPECT_EQ(file_alloc_page(table_id), pagenums[3]);
+  EXPECT_EQ(file_alloc_page(table_id), pagenums[3] + 1);
+  close_disk_manager();
+
+  remove(pathname);
+  remove(crashed);
+}
+
+/*
+ * A file from before the map (a free page list in the header) gets a map
+ * built from its tree when it is opened.
+ */
+TEST(FreeSpaceMapTest, LegacyFile) {
+  const char* pathname = "free_space_map_test.db";
+  remove(pathname);
+  int fd = open(pathname, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+  ASSERT_GE(fd, 0);
+  Page pages[4] = {};
+  HeaderPage* header = reinterpret_cast<HeaderPage*>(&pages[0]);
+  SET_HEADER_FREE_PAGE_NO(header, 1);
+  SET_HEADER_NUM_OF_PAGES(header, 4);
+  SET_HEADER_ROOT_PAGE_NO(header, 2);
+  SET_FREE_NEXT_PAGE_NO(&pages[1], 3);
+  SET_IS_LEAF(&pages[2], 1);
+  ASSERT_EQ(pwrite(fd, pages, sizeof(pages), 0), (ssize_t)sizeof(pages));
+  close(fd);
+
+  ASSERT_EQ(open_disk_manager(SyncMode::PER_BATCH), 0);
+  int64_t table_id = file_open_table_file(pathname);
+  // the map takes page 1, so 3 is left before the file grows
+  EXPECT_EQ(file_alloc_page(table_id), 3u);
+  EXPECT_EQ(file_alloc_page(table_id), 4u);
+
+  file_read_page(table_id, 0, &pages[0]);
+  EXPECT_EQ(GET_HEADER_FREE_MAP_PAGE_NO(header), 1u);
+  EXPECT_EQ(GET_HEADER_ROOT_PAGE_NO(header), 2u);
+
+  close_disk_manager();
+  remove(pathname);
+}
+
+/*
+ * With O_DIRECT, pages outside the (aligned) buffer pool go through the
+ * bounce page, and buffer pool frames go straight to the file.
+ */
+class DirectIoTest : public ::testing::TestWithParam<IoBackendType> {};
+
+/*
+ * open(2) of the test binary. While refuse_o_direct is set, it fails
+ * O_DIRECT with EINVAL like a file system without it: only once the file is
+ * found or created, as Linux does.
+ */
+static std::atomic<bool> refuse_o_direct(false);
+
+extern "C" int open(const char* pathname, int flags, ...) {
+  mode_t mode = 0;
+  if (flags & O_CREAT) {
+    va_list args;
+    va_start(args, flags);
+    mode = va_arg(args, int);
+    va_end(args);
+  }
+  if (refuse_o_direct && (flags & O_DIRECT) &&
+      ((flags & O_CREAT) || access(pathname, F_OK) == 0)) {
+    if (flags & O_CREAT) {
+      int fd = syscall(SYS_openat, AT_FDCWD, pathname, flags & ~O_DIRECT, mode);
+      if (fd >= 0) close(fd);
+    }
+    errno = EINVAL;
+    return -1;
+  }
+  return syscall(SYS_openat, AT_FDCWD, pathname, flags, mode);
+}
+
+TEST_P(DirectIoTest, RefusedOnCreate) {
+  const char* pathname = "direct_io_refused_test.db";
+  remove(pathname);
+  ASSERT_EQ(open_disk_manager(SyncMode::PER_BATCH, GetParam(), true), 0);
+  refuse_o_direct = true;
+  int64_t table_id = file_open_table_file(pathname);
+  refuse_o_direct = false;
+  ASSERT_GE(table_id, 1);
+
+  Page page;
+  memset(&page, 'x', PG_SIZE);
+  pagenum_t pagenum = file_alloc_page(table_id);
+  file_write_page(table_id, pagenum, &page);
+  file_checkpoint_table(table_id);
+  close_disk_manager();
+
+  // and the file it created opens again the same way
+  ASSERT_EQ(open_disk_manager(SyncMode::PER_BATCH, GetParam(), true), 0);
+  refuse_o_direct = true;
+  table_id = file_open_table_file(pathname);
+  refuse_o_direct = false;
+  ASSERT_GE(table_id, 1);
+  memset(&page, 0, PG_SIZE);
+  file_read_page(table_id, pagenum, &page);
+  EXPECT_EQ(page.p.s[PG_SIZE - 1], 'x');
+
+  close_disk_manager();
+  remove(pathname);
+}
+
+TEST_P(DirectIoTest, UnalignedPages) {
+  const char* pathname = "direct_io_test.db";
+  remove(pathname);
+  ASSERT_EQ(open_disk_manager(SyncMode::PER_BATCH, GetParam(), true), 0);
+  int64_t table_id = file_open_table_file(pathname);
+
+  // never 4 KiB aligned
+  std::vector<char> raw(4 * PG_SIZE + 8);
+  Page* pages[4];
+  for (int i = 0; i < 4; ++i) {
+    pages[i] = reinterpret_cast<Page*>(raw.data() + 8 + i * PG_SIZE);
+    memset(pages[i], 'a' + i, PG_SIZE);
+  }
+  // consecutive pages of a fresh file
+  pagenum_t pagenums[3];
+  for (int i = 0; i < 3; ++i) pagenums[i] = file_alloc_page(table_id);
+  ASSERT_EQ(pagenums[2], pagenums[0] + 2);
+  file_write_batch(table_id, pagenums, pages, 2);
+  file_write_page(table_id, pagenums[2], pages[2]);
+
+  Page* dests[] = {pages[3], pages[2], pages[1]};
+  memset(raw.data(), 0, raw.size());
+  file_read_pages(table_id, pagenums[0], dests, 3);
+  EXPECT_EQ(pages[3]->p.s[0], 'a');
+  EXPECT_EQ(pages[2]->p.s[PG_SIZE - 1], 'b');
+  EXPECT_EQ(pages[1]->p.s[0], 'c');
+
+  std::atomic<int> result(1);
+  file_read_page_async(table_id, pagenums[1], pages[0], [&](int res) { result = res; });
+  file_submit();
+  while (result == 1) std::this_thread::yield();
+  EXPECT_EQ(result, 0);
+  EXPECT_EQ(pages[0]->p.s[PG_SIZE - 1], 'b');
+
+  // the buffer pool reads and writes its frames in place
+  ASSERT_EQ(init_buffer(4), 0);
+  std::vector<pagenum_t> allocated;
+  for (int i = 0; i < 8; ++i) {
+    allocated.push_back(buffer_alloc_page(table_id));
+    PageGuard guard(table_id, allocated.back());
+    ASSERT_TRUE(guard);
+    memset(guard->p.s, 'k' + i, PG_SIZE);
+    guard.mark_dirty();
+  }
+  for (int i = 0; i < 8; ++i) {
+    PageGuard guard(table_id, allocated[i]);
+    ASSERT_TRUE(guard);
+    EXPECT_EQ(guard->p.s[PG_SIZE - 1], (char)('k' + i));
+  }
+  shutdown_buffer();
+
+  close_disk_manager();
+  remove(pathname);
+}
+
+INSTANTIATE_TEST_SUITE_P(Backends, DirectIoTest,
+    ::testing::Values(IoBackendType::POSIX, IoBackendType::IO_URING));
+
+/*
+ * The page directory agrees with std::map under random insert/erase,
+ * including erasures from the middle of probe runs.
+ */
+TEST(PageTableTest, MatchesMap) {
+  constexpr int num_buf = 64;
+  PageTable table(num_buf);
+  std::map<std::pair<int64_t, pagenum_t>, int> ref;
+  std::mt19937 gen(7);
+
+  for (int round = 0; round < 20000; ++round) {
+    int64_t tid = gen() % 3 + 1;
+    pagenum_t pagenum = gen() % 200;
+    auto it = ref.find({tid, pagenum});
+
+    if (it != ref.end()) {
+      ASSERT_EQ(table.find(tid, pagenum), it->second);
+      table.erase(tid, pagenum);
+      ref.erase(it);
+      ASSERT_EQ(table.find(tid, pagenum), -1);
+    } else if (ref.size() < num_buf) {
+      ASSERT_EQ(table.find(tid, pagenum), -1);
+      table.insert(tid, pagenum, round % num_buf);
+      ref[{tid, pagenum}] = round % num_buf;
+    }
+  }
+
+  for (const auto& x : ref) {
+    EXPECT_EQ(table.find(x.first.first, x.first.second), x.second);
+  }
+}